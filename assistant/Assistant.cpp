@@ -12,12 +12,13 @@
 #include <String.h>
 #include <kernel/image.h>
 
-#include <queue>
-
+#include <assert.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "NetworkScanner.h"
 #include "Protocol.h"
-#include "SambaContext.h"
+#include "ResourceBatch.h"
 #include "TreeNode.h"
 
 
@@ -34,28 +35,10 @@
 using namespace Smb;
 
 
-struct Assistant::DirHandleCloser {
-	DirHandleCloser(SMBCFILE* handle, SambaContext* context)
-		:
-		fHandle(handle),
-		fSambaContext(context)
-	{
-	}
-
-	~DirHandleCloser()
-	{
-		fSambaContext->CloseDir(fHandle);
-	}
-
-	SMBCFILE* fHandle;
-	SambaContext* fSambaContext;
-};
-
-
 Assistant::Assistant()
 	:
 	BApplication(kAssistantSignature),
-	fSambaContext(new SambaContext),
+	fScanner(new NetworkScanner(this)),
 	fNetworkTree(new TreeNode),
 	fLastScanTime(0),
 	fSmbFsMessenger(NULL)
@@ -65,6 +48,7 @@ Assistant::Assistant()
 
 Assistant::~Assistant()
 {
+	delete fScanner;
 }
 
 
@@ -112,74 +96,15 @@ Assistant::_Scan()
 
 	TRACE("scan request");
 
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-
-	TreeNode* newTree = new TreeNode;
-
-	std::queue<TreeNode*> scanQueue;
-	scanQueue.push(newTree);
-
-	while (!scanQueue.empty()) {
-		TreeNode* node = scanQueue.front();
-		scanQueue.pop();
-
-		TRACE("inspect %s", node->URL().String());
-
-		SMBCFILE* dirHandle = NULL;
-		status_t status = fSambaContext->OpenDir(node->URL(), &dirHandle);
-		if (status != B_OK) {
-			TRACE("failed to open %s : %s", node->URL().String(),
-				strerror(status));
-			continue;
-		}
-		DirHandleCloser handleCloser(dirHandle, fSambaContext);
-
-		for (;;) {
-			struct smbc_dirent* entry = NULL;
-			status = fSambaContext->GetDirectoryEntry(dirHandle, &entry);
-			if (status == B_ENTRY_NOT_FOUND) {
-				TRACE("no more entries");
-				break;
-			}
-			if (status != B_OK) {
-				TRACE("skip entry: %s", strerror(errno));
-				break;
-			}
-
-			TRACE("look at entry %s", entry->name);
-
-			TreeNode* newNode = NULL;
-			switch (entry->smbc_type) {
-				case SMBC_WORKGROUP:
-					TRACE("is workgroup entry");
-					newNode = node->AddWorkgroup(entry->name);
-					scanQueue.push(newNode);
-					break;
-
-				case SMBC_SERVER:
-					TRACE("is server entry");
-					newNode = node->AddServer(entry->name, entry->comment);
-					scanQueue.push(newNode);
-					break;
-
-				case SMBC_FILE_SHARE:
-					TRACE("is file share entry");
-					newNode = node->AddShare(entry->name, entry->comment);
-					break;
-
-				default:
-					TRACE("is other entry, skip");
-					continue;
-			}
-		}
+	// The changes are sent as the scan goes, see NodeScanned()
+	TreeNode* newTree = fScanner->Scan();
+	if (newTree == NULL) {
+		TRACE("scan failed");
+		return;
 	}
 
 	TRACE("scan finished");
 
-	newTree->Sort();
-
-	_TreeDiff(fNetworkTree, newTree);
-
 	delete fNetworkTree;
 	fNetworkTree = newTree;
 
@@ -193,84 +118,119 @@ Assistant::_Scan()
 }
 
 
+/*! Sends what changed in the node's children since the last scan, while the
+    scan is still going on. The node's own changes were sent along with its
+    parent, its children's children follow once those are listed.
+*/
 void
-Assistant::_TreeDiff(TreeNode* oldTree, TreeNode* newTree)
+Assistant::NodeScanned(TreeNode* node)
 {
-	if (oldTree->ChildCount() == 0) {
-		if (newTree->ChildCount() == 0) {
-			// Both empty
-			return;
-		}
+	ResourceBatch batch;
+	_ChildrenDiff(_FindOldNode(node), node, batch);
+	_SendBatch(batch);
+}
 
-		// All children are new
-		for (uint32 i = 0; i < newTree->ChildCount(); i++)
-			_NotifyNodeAdded(&newTree->ChildAt(i));
-		return;
-	}
 
-	if (newTree->ChildCount() == 0) {
-		// All children are gone
-		for (uint32 i = 0; i < oldTree->ChildCount(); i++)
-			_NotifyNodeRemoved(&oldTree->ChildAt(i));
-		return;
-	}
+/*! Returns the node of the last scan's tree which equals the given one of the
+    tree being scanned, or NULL if there is none. fNetworkTree is only
+    replaced after the scan, so the workers may look at it without locking.
+*/
+TreeNode*
+Assistant::_FindOldNode(TreeNode* node)
+{
+	if (node->Parent() == NULL)
+		return fNetworkTree;
+
+	TreeNode* const oldParent = _FindOldNode(node->Parent());
+	if (oldParent == NULL)
+		return NULL;
+	return oldParent->FindChild(*node);
+}
+
+
+/*! Compares the direct children of a node of the last scan and its
+    counterpart of this one (both sorted). oldNode may be NULL, then all
+    children are new.
+*/
+void
+Assistant::_ChildrenDiff(TreeNode* oldNode, TreeNode* newNode,
+	ResourceBatch& batch)
+{
+	const uint32 oldCount = oldNode != NULL ? oldNode->ChildCount() : 0;
+	const uint32 newCount = newNode->ChildCount();
 
 	uint32 o = 0, n = 0;
-	while (o < oldTree->ChildCount() && n < newTree->ChildCount()) {
-		if (oldTree->ChildAt(o) < newTree->ChildAt(n)) {
+	while (o < oldCount && n < newCount) {
+		if (oldNode->ChildAt(o) < newNode->ChildAt(n)) {
 			// Child is in old tree, but not in new
-			_NotifyNodeRemoved(&oldTree->ChildAt(o));
+			_NotifyNodeRemoved(&oldNode->ChildAt(o), batch);
 			o++;
-		} else if (oldTree->ChildAt(o) > newTree->ChildAt(n)) {
+		} else if (oldNode->ChildAt(o) > newNode->ChildAt(n)) {
 			// Child is in new tree, but not in old
-			_NotifyNodeAdded(&newTree->ChildAt(n));
+			_NotifyNodeAdded(&newNode->ChildAt(n), batch);
 			n++;
 		} else {
-			// Child is in both trees, compare the grandchildren
-			_TreeDiff(&oldTree->ChildAt(o), &newTree->ChildAt(n));
+			// Child is in both trees, its children are compared once it is
+			// scanned
 			o++;
 			n++;
 		}
 	}
 
 	// Remaining children from old tree
-	while (o < oldTree->ChildCount())
-		_NotifyNodeRemoved(&oldTree->ChildAt(o++));
+	while (o < oldCount)
+		_NotifyNodeRemoved(&oldNode->ChildAt(o++), batch);
 
 	// Remaining children from new tree
-	while (n < newTree->ChildCount())
-		_NotifyNodeAdded(&newTree->ChildAt(n++));
+	while (n < newCount)
+		_NotifyNodeAdded(&newNode->ChildAt(n++), batch);
 }
 
 
 void
-Assistant::_NotifyNodeAdded(TreeNode* node)
+Assistant::_NotifyNodeAdded(TreeNode* node, ResourceBatch& batch)
 {
-	assert(fSmbFsMessenger != NULL);
 	TRACE("notify new node: %s", node->URL().String());
 
-	BMessage message(kMsgFoundResource);
-	message.AddInt8("type", node->Type());
-	message.AddString("directory url", node->Parent()->URL());
-	message.AddString("name", node->Name());
-	message.AddString("comment", node->Comment());
-
-	fSmbFsMessenger->SendMessage(&message);
+	batch.AddFound(node->Type(), node->Parent()->URL(), node->Name(),
+		node->Comment());
+	if (batch.Size() >= kMaxBatchSize)
+		_SendBatch(batch);
 
 	for (uint32 i = 0; i < node->ChildCount(); i++)
-		_NotifyNodeAdded(&node->ChildAt(i));
+		_NotifyNodeAdded(&node->ChildAt(i), batch);
 }
 
 
 void
-Assistant::_NotifyNodeRemoved(TreeNode* node)
+Assistant::_NotifyNodeRemoved(TreeNode* node, ResourceBatch& batch)
 {
-	assert(fSmbFsMessenger != NULL);
 	TRACE("notify removed node: %s", node->URL().String());
 
-	BMessage message(kMsgLostResource);
-	message.AddString("directory url", node->Parent()->URL());
-	message.AddString("name", node->Name());
+	batch.AddLost(node->Parent()->URL(), node->Name());
+	if (batch.Size() >= kMaxBatchSize)
+		_SendBatch(batch);
+}
+
+
+/*! Sends the batch as one message, if there is anything in it, and empties
+    it.
+*/
+void
+Assistant::_SendBatch(ResourceBatch& batch)
+{
+	assert(fSmbFsMessenger != NULL);
+
+	if (batch.IsEmpty())
+		return;
+
+	BMessage message(kMsgResourceBatch);
+	status_t status = batch.AddTo(message);
+	if (status == B_OK)
+		status = fSmbFsMessenger->SendMessage(&message);
+	if (status != B_OK) {
+		TRACE("failed to send batch: %s", strerror(status));
+	}
 
-	fSmbFsMessenger->SendMessage(&message);
+	batch.MakeEmpty();
 }
@@ -10,6 +10,8 @@
 
 #include <ObjectList.h>
 
+#include "NetworkScanner.h"
+
 
 class BMessenger;
 
@@ -17,30 +19,41 @@ class BMessenger;
 namespace Smb {
 
 
-class SambaContext;
+class ResourceBatch;
 class TreeNode;
 
 
-class Assistant : public BApplication {
+class Assistant : public BApplication, private NetworkScanner::Listener {
 public:
 								Assistant();
 	virtual						~Assistant();
 
 	virtual	void				MessageReceived(BMessage* message);
 
+private:
+	// NetworkScanner::Listener
+	virtual	void				NodeScanned(TreeNode* node);
+
 private:
 			void				_Scan();
-			void				_TreeDiff(TreeNode* oldTree,
-									TreeNode* newTree);
+			TreeNode*			_FindOldNode(TreeNode* node);
+			void				_ChildrenDiff(TreeNode* oldNode,
+									TreeNode* newNode, ResourceBatch& batch);
 
-			void				_NotifyNodeAdded(TreeNode* node);
-			void				_NotifyNodeRemoved(TreeNode* node);
+			void				_NotifyNodeAdded(TreeNode* node,
+									ResourceBatch& batch);
+			void				_NotifyNodeRemoved(TreeNode* node,
+									ResourceBatch& batch);
+			void				_SendBatch(ResourceBatch& batch);
 
 private:
-	struct DirHandleCloser;
+	enum {
+		kMaxBatchSize = 64 * 1024
+			// in bytes, larger batches are sent in parts
+	};
 
 private:
-			SambaContext*		fSambaContext;
+			NetworkScanner*		fScanner;
 			TreeNode*			fNetworkTree;
 
 			bigtime_t			fLastScanTime;
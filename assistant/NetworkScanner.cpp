@@ -0,0 +1,296 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "NetworkScanner.h"
+
+#include <private/shared/AutoLocker.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "SmbClientContext.h"
+#include "TreeNode.h"
+
+
+//#define TRACE_NETWORK_SCANNER
+#ifdef TRACE_NETWORK_SCANNER
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS-Assistant [NetworkScanner %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+struct DirHandleCloser {
+	DirHandleCloser(SMBCFILE* handle, SambaContext* context)
+		:
+		fHandle(handle),
+		fSambaContext(context)
+	{
+	}
+
+	~DirHandleCloser()
+	{
+		fSambaContext->CloseDir(fHandle);
+	}
+
+	SMBCFILE* fHandle;
+	SambaContext* fSambaContext;
+};
+
+
+struct NetworkScanner::Worker {
+	Worker(NetworkScanner* owner)
+		:
+		fOwner(owner),
+		fContext(NULL),
+		fThread(-1)
+	{
+	}
+
+	~Worker()
+	{
+		delete fContext;
+	}
+
+	NetworkScanner*		fOwner;
+	SmbClientContext*	fContext;
+		// kept from scan to scan
+	thread_id			fThread;
+};
+
+
+// #pragma mark - NetworkScanner::Listener
+
+
+NetworkScanner::Listener::~Listener()
+{
+}
+
+
+// #pragma mark - NetworkScanner
+
+
+NetworkScanner::NetworkScanner(Listener* listener, int32 workerCount)
+	:
+	fListener(listener),
+	fWorkerCount(workerCount > 0 ? workerCount : 1),
+	fPendingCount(0),
+	fWorkSem(-1)
+{
+}
+
+
+NetworkScanner::~NetworkScanner()
+{
+	for (size_t i = 0; i < fWorkers.size(); i++)
+		delete fWorkers[i];
+}
+
+
+/*! Lists the whole network, returns the new tree, or NULL if out of
+    resources. Workgroups, servers or shares which couldn't be listed are
+    left out. The calling thread works along with the pool, the workers
+    are gone when this returns.
+*/
+TreeNode*
+NetworkScanner::Scan()
+{
+	status_t status = _InitWorkers();
+	if (status != B_OK)
+		return NULL;
+
+	TreeNode* const tree = new(std::nothrow) TreeNode;
+	if (tree == NULL)
+		return NULL;
+
+	fWorkSem = create_sem(0, "smb scan work");
+	if (fWorkSem < 0) {
+		delete tree;
+		return NULL;
+	}
+
+	AutoLocker<BLocker> locker(fLock);
+	_Queue(tree);
+	locker.Unlock();
+
+	for (size_t i = 1; i < fWorkers.size(); i++) {
+		Worker* const worker = fWorkers[i];
+		worker->fThread = spawn_thread(&_WorkerEntry, "smb scan worker",
+			B_NORMAL_PRIORITY, worker);
+		if (worker->fThread >= 0)
+			resume_thread(worker->fThread);
+	}
+
+	_Worker(fWorkers[0]);
+
+	for (size_t i = 1; i < fWorkers.size(); i++) {
+		Worker* const worker = fWorkers[i];
+		if (worker->fThread < 0)
+			continue;
+
+		status_t result;
+		wait_for_thread(worker->fThread, &result);
+		worker->fThread = -1;
+	}
+
+	delete_sem(fWorkSem);
+	fWorkSem = -1;
+
+	TRACE("scan finished");
+	return tree;
+}
+
+
+/*! Creates the workers and their contexts, if not done by an earlier scan
+    yet. It's fine to end up with fewer of them, as long as there is one.
+*/
+status_t
+NetworkScanner::_InitWorkers()
+{
+	while ((int32)fWorkers.size() < fWorkerCount) {
+		Worker* const worker = new(std::nothrow) Worker(this);
+		if (worker != NULL)
+			worker->fContext = new(std::nothrow) SmbClientContext;
+		if (worker == NULL || worker->fContext == NULL) {
+			delete worker;
+			break;
+		}
+
+		worker->fContext->SetTimeout(kServerTimeout);
+		fWorkers.push_back(worker);
+	}
+
+	return fWorkers.empty() ? B_NO_MEMORY : B_OK;
+}
+
+
+/*static*/ status_t
+NetworkScanner::_WorkerEntry(void* data)
+{
+	Worker* const worker = (Worker*)data;
+	worker->fOwner->_Worker(worker);
+	return B_OK;
+}
+
+
+void
+NetworkScanner::_Worker(Worker* worker)
+{
+	SambaContextLocker contextLocker(worker->fContext);
+
+	for (;;) {
+		acquire_sem(fWorkSem);
+
+		AutoLocker<BLocker> locker(fLock);
+		if (fQueue.empty()) {
+			// Everything is scanned
+			break;
+		}
+
+		TreeNode* const node = fQueue.front();
+		fQueue.pop_front();
+		locker.Unlock();
+
+		_ScanNode(worker->fContext, node);
+
+		locker.Lock();
+		if (--fPendingCount == 0) {
+			// Nothing more can come up, let all workers finish
+			release_sem_etc(fWorkSem, fWorkers.size(), 0);
+		}
+	}
+}
+
+
+/*! Lists the node, tells the listener, and queues the children which are
+    directories themselves. They are queued last, so the listener hears of
+    every node before any of its children.
+*/
+void
+NetworkScanner::_ScanNode(SmbClientContext* context, TreeNode* node)
+{
+	_ListNode(context, node);
+	node->Sort();
+
+	fListener->NodeScanned(node);
+
+	AutoLocker<BLocker> locker(fLock);
+	for (uint32 i = 0; i < node->ChildCount(); i++) {
+		TreeNode* const child = &node->ChildAt(i);
+		if (child->Type() != kShare)
+			_Queue(child);
+	}
+}
+
+
+/*! Adds the entries of the node's directory as its children. Only the worker
+    which took the node from the queue may add to it.
+*/
+void
+NetworkScanner::_ListNode(SmbClientContext* context, TreeNode* node)
+{
+	TRACE("inspect %s", node->URL().String());
+
+	SMBCFILE* dirHandle = NULL;
+	status_t status = context->OpenDir(node->URL(), &dirHandle);
+	if (status != B_OK) {
+		TRACE("failed to open %s : %s", node->URL().String(),
+			strerror(status));
+		return;
+	}
+	DirHandleCloser handleCloser(dirHandle, context);
+
+	for (;;) {
+		struct smbc_dirent* entry = NULL;
+		status = context->GetDirectoryEntry(dirHandle, &entry);
+		if (status == B_ENTRY_NOT_FOUND) {
+			TRACE("no more entries");
+			break;
+		}
+		if (status != B_OK) {
+			TRACE("skip entry: %s", strerror(status));
+			break;
+		}
+
+		TRACE("look at entry %s", entry->name);
+
+		switch (entry->smbc_type) {
+			case SMBC_WORKGROUP:
+				TRACE("is workgroup entry");
+				node->AddWorkgroup(entry->name);
+				break;
+
+			case SMBC_SERVER:
+				TRACE("is server entry");
+				node->AddServer(entry->name, entry->comment);
+				break;
+
+			case SMBC_FILE_SHARE:
+				TRACE("is file share entry");
+				node->AddShare(entry->name, entry->comment);
+				break;
+
+			default:
+				TRACE("is other entry, skip");
+				break;
+		}
+	}
+}
+
+
+/*! Must lock.
+*/
+void
+NetworkScanner::_Queue(TreeNode* node)
+{
+	fQueue.push_back(node);
+	fPendingCount++;
+	release_sem(fWorkSem);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_NETWORK_SCANNER_H
+#define SMBFS_NETWORK_SCANNER_H
+
+#include <Locker.h>
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include <deque>
+#include <vector>
+
+
+namespace Smb {
+
+
+class SmbClientContext;
+class TreeNode;
+
+
+/*! Builds the tree of workgroups, servers and shares of the network. The
+    workgroups and servers are listed by a pool of workers, each on a
+    connection of its own, so a server which doesn't answer only holds up
+    one worker, and only until the timeout.
+    The listener hears of every node as soon as it is listed, so results can
+    be passed on long before the slowest server has answered.
+*/
+class NetworkScanner {
+public:
+	class Listener {
+	public:
+		virtual					~Listener();
+
+		/*! The node's children are complete and sorted, none of them are
+		    listed yet. Called by the worker which listed the node, so maybe
+		    by several threads at once.
+		*/
+		virtual	void			NodeScanned(TreeNode* node) = 0;
+	};
+
+								NetworkScanner(Listener* listener,
+									int32 workerCount = kDefaultWorkerCount);
+								~NetworkScanner();
+
+			TreeNode*			Scan();
+
+private:
+	struct Worker;
+	typedef std::deque<TreeNode*> NodeQueue;
+	typedef std::vector<Worker*> WorkerList;
+
+	enum {
+		kDefaultWorkerCount	= 8,
+		kServerTimeout		= 5000
+			// in milliseconds
+	};
+
+private:
+			status_t			_InitWorkers();
+	static	status_t			_WorkerEntry(void* data);
+			void				_Worker(Worker* worker);
+			void				_ScanNode(SmbClientContext* context,
+									TreeNode* node);
+			void				_ListNode(SmbClientContext* context,
+									TreeNode* node);
+			void				_Queue(TreeNode* node);
+
+private:
+			Listener*			fListener;
+			BLocker				fLock;
+			WorkerList			fWorkers;
+			int32				fWorkerCount;
+			NodeQueue			fQueue;
+			int32				fPendingCount;
+				// queued, or being scanned
+			sem_id				fWorkSem;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_NETWORK_SCANNER_H
@@ -120,6 +120,24 @@ TreeNode::ChildAt(uint32 index)
 }
 
 
+/*! Returns the child which equals the given node (of another tree), or NULL
+    if there is none. The children must be sorted.
+*/
+TreeNode*
+TreeNode::FindChild(const TreeNode& node)
+{
+	if (ChildCount() == 0 || fChildren[0]->Type() != node.Type())
+		return NULL;
+
+	SortFunctor sorter;
+	NodeArray::iterator found = std::lower_bound(fChildren.begin(),
+		fChildren.end(), const_cast<TreeNode*>(&node), sorter);
+	if (found == fChildren.end() || **found > node)
+		return NULL;
+	return *found;
+}
+
+
 TreeNode*
 TreeNode::Parent() const
 {
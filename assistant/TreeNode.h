@@ -42,6 +42,7 @@ public:
 
 			uint32				ChildCount() const;
 			TreeNode&			ChildAt(uint32 index);
+			TreeNode*			FindChild(const TreeNode& node);
 
 			TreeNode*			Parent() const;
 
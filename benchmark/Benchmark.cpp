@@ -0,0 +1,225 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Benchmark.h"
+
+#include <OS.h>
+#include <driver_settings.h>
+#include <fs_volume.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Workloads.h"
+
+
+using namespace Smb;
+
+
+static const char* const kFileSystem = "userlandfs";
+static const char* const kClientFileSystem = "smb_fs";
+	// userlandfs takes the name of its client first in the parameters
+static const char* const kShare = "benchmark/share";
+	// server and share the backend makes up
+
+
+static status_t
+errno_status()
+{
+	return errno != 0 ? errno : B_ERROR;
+}
+
+
+static void
+remove_directory(const BString& path)
+{
+	DIR* const dir = opendir(path.String());
+	if (dir != NULL) {
+		while (struct dirent* entry = readdir(dir)) {
+			if (strcmp(entry->d_name, ".") == 0
+				|| strcmp(entry->d_name, "..") == 0) {
+				continue;
+			}
+
+			BString entryPath(path);
+			entryPath << '/' << entry->d_name;
+			struct stat st;
+			if (lstat(entryPath.String(), &st) == 0 && S_ISDIR(st.st_mode))
+				remove_directory(entryPath);
+			else
+				unlink(entryPath.String());
+		}
+		closedir(dir);
+	}
+	rmdir(path.String());
+}
+
+
+Benchmark::Benchmark(const char* mountPoint, const char* source)
+	:
+	fMountPoint(mountPoint),
+	fSource(source),
+	fBudgets(NULL),
+	fMounted(false)
+{
+}
+
+
+Benchmark::~Benchmark()
+{
+	if (fMounted)
+		_Unmount();
+
+	if (fBackendRoot.Length() > 0)
+		remove_directory(fBackendRoot);
+	if (fReportPath.Length() > 0)
+		unlink(fReportPath.String());
+
+	unload_driver_settings(fBudgets);
+}
+
+
+/*! Creates the directory the backend keeps the share in, and loads the
+    budgets, if there are any.
+*/
+status_t
+Benchmark::Init(const char* budgetsPath)
+{
+	char root[] = "/tmp/smb_fs_benchmark_XXXXXX";
+	if (mkdtemp(root) == NULL)
+		return errno_status();
+	fBackendRoot = root;
+
+	fReportPath = fBackendRoot;
+	fReportPath << ".report";
+
+	if (mkdir(fMountPoint.String(), 0755) != 0 && errno != EEXIST)
+		return errno_status();
+
+	if (budgetsPath != NULL) {
+		fBudgets = load_driver_settings(budgetsPath);
+		if (fBudgets == NULL)
+			return B_ENTRY_NOT_FOUND;
+	}
+	return B_OK;
+}
+
+
+/*! Mounts the volume, runs the workload, and unmounts it again. The calls
+    it made are then printed, _withinBudget tells whether they were within
+    the workload's budgets.
+*/
+status_t
+Benchmark::Run(const Workload& workload, bool* _withinBudget)
+{
+	printf("%s: %s\n", workload.name, workload.description);
+
+	status_t status = _Mount(workload);
+	if (status != B_OK)
+		return status;
+
+	BString share(fMountPoint);
+	share << '/' << kShare;
+
+	const bigtime_t startTime = system_time();
+	status = workload.function(fSource, share);
+	const bigtime_t runTime = system_time() - startTime;
+
+	status_t unmountStatus = _Unmount();
+	if (status != B_OK)
+		return status;
+	if (unmountStatus != B_OK)
+		return unmountStatus;
+
+	printf("%s: took %" B_PRId64 " ms\n", workload.name, runTime / 1000);
+	return _CheckReport(_withinBudget);
+}
+
+
+/*! The backend keeps the share in the local directory, counts the calls,
+    and writes them to the report file on unmount.
+*/
+BString
+Benchmark::_MountParameters(const Workload& workload)
+{
+	BString parameters(kClientFileSystem);
+	parameters << "\nbackend local"
+		<< "\nbackend_root \"" << fBackendRoot << '"'
+		<< "\nshares " << kShare
+		<< "\ncount_calls"
+		<< "\ncall_report \"" << fReportPath << '"';
+
+	const driver_settings* const budgets = get_driver_settings(fBudgets);
+	for (int32 i = 0; budgets != NULL && i < budgets->parameter_count; i++) {
+		const driver_parameter& section = budgets->parameters[i];
+		if (strcmp(section.name, workload.name) != 0)
+			continue;
+
+		for (int32 j = 0; j < section.parameter_count; j++) {
+			const driver_parameter& budget = section.parameters[j];
+			if (budget.value_count > 0) {
+				parameters << '\n' << budget.name << ' '
+					<< budget.values[0];
+			}
+		}
+	}
+
+	parameters << '\n';
+	return parameters;
+}
+
+
+status_t
+Benchmark::_Mount(const Workload& workload)
+{
+	unlink(fReportPath.String());
+
+	const dev_t volume = fs_mount_volume(fMountPoint.String(), NULL,
+		kFileSystem, 0, _MountParameters(workload).String());
+	if (volume < 0)
+		return volume;
+
+	fMounted = true;
+	return B_OK;
+}
+
+
+status_t
+Benchmark::_Unmount()
+{
+	status_t status = fs_unmount_volume(fMountPoint.String(), 0);
+	if (status == B_OK)
+		fMounted = false;
+	return status;
+}
+
+
+/*! Prints the report the volume wrote on unmount. Its last line says
+    whether the calls were within budget.
+*/
+status_t
+Benchmark::_CheckReport(bool* _withinBudget)
+{
+	FILE* const report = fopen(fReportPath.String(), "r");
+	if (report == NULL)
+		return errno_status();
+
+	char line[256];
+	BString lastLine;
+	while (fgets(line, sizeof(line), report) != NULL) {
+		fputs(line, stdout);
+		line[strcspn(line, "\n")] = '\0';
+		lastLine = line;
+	}
+	fclose(report);
+
+	*_withinBudget = lastLine == "within budget";
+	return B_OK;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_BENCHMARK_H
+#define SMBFS_BENCHMARK_H
+
+#include <String.h>
+#include <SupportDefs.h>
+
+
+namespace Smb {
+
+
+struct Workload;
+
+
+/*! Runs workloads against a share of a freshly mounted volume each, with
+    its backend calls counted per file system operation. The share is kept
+    in a local directory, so it survives from one workload to the next, and
+    each one starts with empty caches.
+    The call budgets of each workload come from a driver settings file, as
+    the parameters of a section named after the workload, e.g.
+    "browse { call_budget_read_stat 1 }".
+*/
+class Benchmark {
+public:
+								Benchmark(const char* mountPoint,
+									const char* source);
+								~Benchmark();
+
+			status_t			Init(const char* budgetsPath);
+
+			status_t			Run(const Workload& workload,
+									bool* _withinBudget);
+
+private:
+			BString				_MountParameters(const Workload& workload);
+			status_t			_Mount(const Workload& workload);
+			status_t			_Unmount();
+			status_t			_CheckReport(bool* _withinBudget);
+
+private:
+			BString				fMountPoint;
+			BString				fSource;
+			BString				fBackendRoot;
+			BString				fReportPath;
+			void*				fBudgets;
+			bool				fMounted;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_BENCHMARK_H
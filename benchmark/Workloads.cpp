@@ -0,0 +1,433 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Workloads.h"
+
+#include <OS.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <vector>
+
+
+using namespace Smb;
+
+
+static const char* const kTreeName = "tree";
+static const char* const kUntarName = "untar";
+
+static const size_t kCopyBufferSize = 64 * 1024;
+static uint8 sCopyBuffer[kCopyBufferSize];
+
+static const int32 kContentionRounds = 8;
+	// times each thread stats the whole tree
+
+typedef std::vector<BString> PathList;
+
+
+static status_t
+errno_status()
+{
+	return errno != 0 ? errno : B_ERROR;
+}
+
+
+static bool
+is_dot_entry(const char* name)
+{
+	return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
+
+
+/*! Copies the file's data, the target is opened with the given flags on top
+    of O_WRONLY | O_CREAT.
+*/
+static status_t
+copy_file(const BString& from, const BString& to, int openFlags, mode_t mode)
+{
+	const int source = open(from.String(), O_RDONLY);
+	if (source < 0)
+		return errno_status();
+
+	const int target = open(to.String(), O_WRONLY | O_CREAT | openFlags,
+		mode);
+	if (target < 0) {
+		status_t status = errno_status();
+		close(source);
+		return status;
+	}
+
+	status_t status = B_OK;
+	for (;;) {
+		const ssize_t bytesRead = read(source, sCopyBuffer, kCopyBufferSize);
+		if (bytesRead <= 0) {
+			if (bytesRead < 0)
+				status = errno_status();
+			break;
+		}
+		if (write(target, sCopyBuffer, bytesRead) != bytesRead) {
+			status = errno_status();
+			break;
+		}
+	}
+
+	close(source);
+	if (close(target) != 0 && status == B_OK)
+		status = errno_status();
+	return status;
+}
+
+
+static void
+restore_times(const BString& path, const struct stat& st)
+{
+	struct timeval times[2];
+	times[0].tv_sec = st.st_atime;
+	times[0].tv_usec = 0;
+	times[1].tv_sec = st.st_mtime;
+	times[1].tv_usec = 0;
+	utimes(path.String(), times);
+}
+
+
+/*! Copies the tree like "cp -r" does, checking for each entry whether the
+    target exists first. Like tar extracting an archive instead, files are
+    created exclusively, and the mode and times of every entry are restored
+    after it is written, those of a directory after its contents.
+*/
+static status_t
+copy_directory(const BString& from, const BString& to, bool likeTar)
+{
+	struct stat st;
+	if (stat(from.String(), &st) != 0)
+		return errno_status();
+
+	if (mkdir(to.String(), (st.st_mode & 0777) | 0700) != 0
+		&& errno != EEXIST) {
+		return errno_status();
+	}
+
+	DIR* const dir = opendir(from.String());
+	if (dir == NULL)
+		return errno_status();
+
+	status_t status = B_OK;
+	while (struct dirent* entry = readdir(dir)) {
+		if (is_dot_entry(entry->d_name))
+			continue;
+
+		BString entryFrom(from);
+		entryFrom << '/' << entry->d_name;
+		BString entryTo(to);
+		entryTo << '/' << entry->d_name;
+
+		struct stat entryStat;
+		if (lstat(entryFrom.String(), &entryStat) != 0) {
+			status = errno_status();
+			break;
+		}
+
+		if (S_ISDIR(entryStat.st_mode))
+			status = copy_directory(entryFrom, entryTo, likeTar);
+		else if (S_ISREG(entryStat.st_mode)) {
+			const mode_t mode = entryStat.st_mode & 0777;
+			if (likeTar)
+				status = copy_file(entryFrom, entryTo, O_EXCL, mode);
+			else {
+				struct stat targetStat;
+				if (stat(entryTo.String(), &targetStat) == 0
+					&& S_ISDIR(targetStat.st_mode)) {
+					status = B_IS_A_DIRECTORY;
+				} else
+					status = copy_file(entryFrom, entryTo, O_TRUNC, mode);
+			}
+
+			if (status == B_OK && likeTar) {
+				chmod(entryTo.String(), mode);
+				restore_times(entryTo, entryStat);
+			}
+		}
+			// anything else isn't copied
+
+		if (status != B_OK)
+			break;
+	}
+	closedir(dir);
+
+	if (status == B_OK && likeTar) {
+		chmod(to.String(), st.st_mode & 0777);
+		restore_times(to, st);
+	}
+	return status;
+}
+
+
+/*! Reads the directory, and stats its entries, going down into the
+    subdirectories if asked to. Like git, it can first look for an ignore
+    file, which usually isn't there.
+*/
+static status_t
+scan_directory(const BString& path, bool recursive, bool lookForIgnoreFile)
+{
+	if (lookForIgnoreFile) {
+		BString ignorePath(path);
+		ignorePath << "/.gitignore";
+		struct stat st;
+		stat(ignorePath.String(), &st);
+	}
+
+	DIR* const dir = opendir(path.String());
+	if (dir == NULL)
+		return errno_status();
+
+	status_t status = B_OK;
+	while (struct dirent* entry = readdir(dir)) {
+		if (is_dot_entry(entry->d_name))
+			continue;
+
+		BString entryPath(path);
+		entryPath << '/' << entry->d_name;
+
+		struct stat st;
+		if (lstat(entryPath.String(), &st) != 0) {
+			status = errno_status();
+			break;
+		}
+
+		if (recursive && S_ISDIR(st.st_mode)) {
+			status = scan_directory(entryPath, true, lookForIgnoreFile);
+			if (status != B_OK)
+				break;
+		}
+	}
+
+	closedir(dir);
+	return status;
+}
+
+
+/*! Adds the paths of all entries below the directory.
+*/
+static status_t
+collect_paths(const BString& path, PathList& paths)
+{
+	DIR* const dir = opendir(path.String());
+	if (dir == NULL)
+		return errno_status();
+
+	status_t status = B_OK;
+	while (struct dirent* entry = readdir(dir)) {
+		if (is_dot_entry(entry->d_name))
+			continue;
+
+		BString entryPath(path);
+		entryPath << '/' << entry->d_name;
+		paths.push_back(entryPath);
+
+		struct stat st;
+		if (lstat(entryPath.String(), &st) != 0) {
+			status = errno_status();
+			break;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			status = collect_paths(entryPath, paths);
+			if (status != B_OK)
+				break;
+		}
+	}
+
+	closedir(dir);
+	return status;
+}
+
+
+static status_t
+stat_paths(void* data)
+{
+	const PathList& paths = *static_cast<const PathList*>(data);
+	for (int32 round = 0; round < kContentionRounds; round++) {
+		for (size_t i = 0; i < paths.size(); i++) {
+			struct stat st;
+			if (stat(paths[i].String(), &st) != 0)
+				return errno_status();
+		}
+	}
+	return B_OK;
+}
+
+
+/*! Runs stat_paths() in the given number of threads at once, and prints how
+    many stats per second they made together.
+*/
+static status_t
+stat_paths_concurrently(PathList& paths, int32 threadCount)
+{
+	std::vector<thread_id> threads;
+	status_t status = B_OK;
+
+	const bigtime_t startTime = system_time();
+	for (int32 i = 0; i < threadCount; i++) {
+		const thread_id thread = spawn_thread(&stat_paths, "stat paths",
+			B_NORMAL_PRIORITY, &paths);
+		if (thread < 0) {
+			status = thread;
+			break;
+		}
+		threads.push_back(thread);
+		resume_thread(thread);
+	}
+
+	for (size_t i = 0; i < threads.size(); i++) {
+		status_t threadStatus;
+		if (wait_for_thread(threads[i], &threadStatus) == B_OK
+			&& status == B_OK) {
+			status = threadStatus;
+		}
+	}
+	const bigtime_t runTime = system_time() - startTime;
+
+	if (status != B_OK)
+		return status;
+
+	const int64 stats = (int64)threadCount * kContentionRounds
+		* (int64)paths.size();
+	printf("  %2" B_PRId32 " threads: %" B_PRId64 " stats/s\n", threadCount,
+		runTime > 0 ? stats * 1000000 / runTime : stats);
+	return B_OK;
+}
+
+
+// #pragma mark - Workloads
+
+
+static status_t
+copy_tree(const BString& source, const BString& share)
+{
+	BString target(share);
+	target << '/' << kTreeName;
+	return copy_directory(source, target, false);
+}
+
+
+static status_t
+untar(const BString& source, const BString& share)
+{
+	BString target(share);
+	target << '/' << kUntarName;
+	return copy_directory(source, target, true);
+}
+
+
+static status_t
+browse(const BString&, const BString& share)
+{
+	BString folder(share);
+	folder << '/' << kTreeName;
+	return scan_directory(folder, false, false);
+}
+
+
+static status_t
+stat_all(const BString&, const BString& share)
+{
+	BString tree(share);
+	tree << '/' << kTreeName;
+	return scan_directory(tree, true, false);
+}
+
+
+static status_t
+git_status(const BString&, const BString& share)
+{
+	BString tree(share);
+	tree << '/' << kTreeName;
+	return scan_directory(tree, true, true);
+}
+
+
+/*! Stats the copied tree from one thread, and then from twice as many each
+    time, up to the number of CPUs. The nodes are all known after the first
+    pass, so this is how much the lookups of the threads get in each other's
+    way.
+*/
+static status_t
+lookup_contention(const BString&, const BString& share)
+{
+	BString tree(share);
+	tree << '/' << kTreeName;
+
+	PathList paths;
+	status_t status = collect_paths(tree, paths);
+	if (status != B_OK)
+		return status;
+
+	system_info info;
+	get_system_info(&info);
+	const int32 maxThreadCount = info.cpu_count > 1 ? info.cpu_count : 2;
+
+	for (int32 threadCount = 1; threadCount <= maxThreadCount;
+			threadCount *= 2) {
+		status = stat_paths_concurrently(paths, threadCount);
+		if (status != B_OK)
+			return status;
+	}
+	return B_OK;
+}
+
+
+/*! Stats the copied tree once, which its budgets don't allow. If the run
+    ends up within budget anyway, the volume didn't get the budgets from its
+    mount parameters.
+*/
+static status_t
+budget_check(const BString&, const BString& share)
+{
+	BString tree(share);
+	tree << '/' << kTreeName;
+
+	struct stat st;
+	if (stat(tree.String(), &st) != 0)
+		return errno_status();
+	return B_OK;
+}
+
+
+const Workload Smb::kWorkloads[] = {
+	{ "copy-tree", &copy_tree,
+		"copy the source tree into the share, like cp -r", false },
+	{ "untar", &untar,
+		"extract the source tree into the share, like tar", false },
+	{ "browse", &browse,
+		"open the copied folder, and stat its entries", false },
+	{ "stat-all", &stat_all,
+		"stat every entry of the copied tree", false },
+	{ "git-status", &git_status,
+		"scan the copied tree for changes, like git status", false },
+	{ "lookup-contention", &lookup_contention,
+		"stat the copied tree from 1 up to as many threads as CPUs", false },
+	{ "budget-check", &budget_check,
+		"stat the copied folder against a budget of 0 calls", true }
+};
+
+const int32 Smb::kWorkloadCount = sizeof(kWorkloads) / sizeof(kWorkloads[0]);
+
+
+const Workload*
+Smb::find_workload(const char* name)
+{
+	for (int32 i = 0; i < kWorkloadCount; i++) {
+		if (strcmp(kWorkloads[i].name, name) == 0)
+			return &kWorkloads[i];
+	}
+	return NULL;
+}
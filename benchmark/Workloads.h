@@ -0,0 +1,43 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_WORKLOADS_H
+#define SMBFS_WORKLOADS_H
+
+#include <String.h>
+#include <SupportDefs.h>
+
+
+namespace Smb {
+
+
+/*! A scripted workload, which does to a share what an application
+    typically does, through the POSIX API. The source is a local tree to
+    take the files from. The workloads build on each other, in the order
+    they are listed: the first copies the tree the others look at.
+    A workload marked overBudget must exceed its budgets, it checks that
+    they reach the volume.
+*/
+struct Workload {
+	typedef status_t (*Function)(const BString& source, const BString& share);
+
+	const char*		name;
+	Function		function;
+	const char*		description;
+	bool			overBudget;
+};
+
+
+extern const Workload kWorkloads[];
+extern const int32 kWorkloadCount;
+
+
+const Workload* find_workload(const char* name);
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_WORKLOADS_H
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Benchmark.h"
+#include "Workloads.h"
+
+
+using namespace Smb;
+
+
+enum {
+	kExitWithinBudget	= 0,
+	kExitOverBudget		= 1,
+	kExitError			= 2
+};
+
+
+static void
+print_usage(const char* program)
+{
+	fprintf(stderr, "Usage: %s [-b <budgets>] <mount point> <source tree> "
+		"[<workload> ...]\n"
+		"Runs the workloads (all of them by default) against the SMB file\n"
+		"system, and counts its backend calls per file system operation.\n"
+		"Fails if any operation makes more calls than its budget allows.\n"
+		"The budgets are a driver settings file, with a section per\n"
+		"workload, see \"budgets\" next to the sources.\n\n"
+		"Workloads:\n", program);
+
+	for (int32 i = 0; i < kWorkloadCount; i++) {
+		fprintf(stderr, "  %-18s %s\n", kWorkloads[i].name,
+			kWorkloads[i].description);
+	}
+}
+
+
+int
+main(int argc, char** argv)
+{
+	const char* budgetsPath = NULL;
+
+	int option;
+	while ((option = getopt(argc, argv, "b:h")) != -1) {
+		switch (option) {
+			case 'b':
+				budgetsPath = optarg;
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return kExitError;
+		}
+	}
+
+	if (argc - optind < 2) {
+		print_usage(argv[0]);
+		return kExitError;
+	}
+
+	const char* const mountPoint = argv[optind++];
+	const char* const source = argv[optind++];
+
+	// Check the workload names before running any of them
+	for (int i = optind; i < argc; i++) {
+		if (find_workload(argv[i]) == NULL) {
+			fprintf(stderr, "Unknown workload: %s\n", argv[i]);
+			return kExitError;
+		}
+	}
+
+	Benchmark benchmark(mountPoint, source);
+	status_t status = benchmark.Init(budgetsPath);
+	if (status != B_OK) {
+		fprintf(stderr, "Can't set up the benchmark: %s\n", strerror(status));
+		return kExitError;
+	}
+
+	// The workloads build on each other, they always run in their order
+	bool withinBudget = true;
+	for (int32 i = 0; i < kWorkloadCount; i++) {
+		const Workload& workload = kWorkloads[i];
+		bool selected = optind == argc;
+		for (int j = optind; j < argc && !selected; j++)
+			selected = strcmp(argv[j], workload.name) == 0;
+
+		// The first workload copies the tree the others need, it always
+		// runs, but only counts if selected
+		if (!selected && i > 0)
+			continue;
+
+		// Without budgets, there's nothing to exceed
+		if (workload.overBudget && budgetsPath == NULL)
+			continue;
+
+		bool workloadWithinBudget;
+		status = benchmark.Run(workload, &workloadWithinBudget);
+		if (status != B_OK) {
+			fprintf(stderr, "%s failed: %s\n", workload.name,
+				strerror(status));
+			return kExitError;
+		}
+
+		if (selected && workloadWithinBudget == workload.overBudget) {
+			printf("%s: %s\n", workload.name, workload.overBudget
+				? "WITHIN BUDGET, the volume ignored its budgets"
+				: "OVER BUDGET");
+			withinBudget = false;
+		}
+	}
+
+	return withinBudget ? kExitWithinBudget : kExitOverBudget;
+}
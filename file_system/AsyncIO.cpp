@@ -0,0 +1,847 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "AsyncIO.h"
+
+#include <private/shared/AutoLocker.h>
+#include <private/shared/HashMap.h>
+#include <private/shared/HashString.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SambaContext.h"
+#include "SambaContextPool.h"
+#include "Volume.h"
+
+
+//#define TRACE_ASYNC_IO
+#ifdef TRACE_ASYNC_IO
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [AsyncIO %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+// #pragma mark - AsyncIO::Job
+
+
+struct AsyncIO::Job {
+	Job(ino_t nodeID, const BString& url, io_request* request,
+		Stripe* stripe = NULL)
+		:
+		fNodeID(nodeID),
+		fURL(url),
+		fRequest(request),
+		fStripe(stripe),
+		fCanceled(0)
+	{
+	}
+
+	ino_t			fNodeID;
+	BString			fURL;
+	io_request*		fRequest;
+		// NULL for helper jobs
+	Stripe*			fStripe;
+		// the stripe a helper job takes chunks of
+	int32			fCanceled;
+		// set while a worker runs the job, checked between transfers
+};
+
+
+// #pragma mark - AsyncIO::Stripe
+
+
+/*! A large transfer split into chunks, which the workers taking part grab
+    one after the other. Each chunk records how it went, so the results can
+    be put together in order once all of them are done. Referenced by the
+    one who started it and by each of its helper jobs.
+*/
+struct AsyncIO::Stripe {
+	struct Chunk {
+		status_t		fStatus;
+		size_t			fLength;
+	};
+
+	Stripe(bool isWrite, off_t offset, uint8* buffer, size_t length,
+		size_t chunkSize, int32* canceled)
+		:
+		fIsWrite(isWrite),
+		fOffset(offset),
+		fBuffer(buffer),
+		fLength(length),
+		fChunkSize(chunkSize),
+		fChunkCount((length + chunkSize - 1) / chunkSize),
+		fNextChunk(0),
+		fChunksDone(0),
+		fChunks(NULL),
+		fCanceled(canceled),
+		fDoneSem(-1),
+		fReferences(1)
+	{
+	}
+
+	~Stripe()
+	{
+		delete[] fChunks;
+		if (fDoneSem >= 0)
+			delete_sem(fDoneSem);
+	}
+
+	status_t Init()
+	{
+		fChunks = new(std::nothrow) Chunk[fChunkCount];
+		if (fChunks == NULL)
+			return B_NO_MEMORY;
+
+		fDoneSem = create_sem(0, "smb async io stripe");
+		return fDoneSem >= 0 ? B_OK : fDoneSem;
+	}
+
+	bool			fIsWrite;
+	off_t			fOffset;
+	uint8*			fBuffer;
+	size_t			fLength;
+	size_t			fChunkSize;
+	int32			fChunkCount;
+	int32			fNextChunk;
+	int32			fChunksDone;
+	Chunk*			fChunks;
+	int32*			fCanceled;
+		// of the job which started it
+	sem_id			fDoneSem;
+		// released when the last chunk is done
+	int32			fReferences;
+};
+
+
+// #pragma mark - AsyncIO::Worker
+
+
+/*! A worker thread with its own contexts (one per server) and the file
+    handles it opened through them. The worker holds fFileLock while it runs
+    a job, others only touch the handles with the lock held.
+*/
+struct AsyncIO::Worker {
+	struct File {
+		ino_t			fNodeID;
+		BString			fURL;
+		SambaContext*	fContext;
+		SMBCFILE*		fFile;
+		off_t			fPosition;
+		bool			fWritable;
+	};
+
+	typedef HashMap<HashString, SambaContext*> ContextMap;
+	typedef std::deque<File> FileList;
+
+	enum {
+		kMaxOpenFiles = 8
+	};
+
+	Worker(AsyncIO* owner)
+		:
+		fOwner(owner),
+		fThread(-1),
+		fJob(NULL),
+		fBuffer(NULL),
+		fBufferSize(0)
+	{
+	}
+
+	~Worker()
+	{
+		while (!fFiles.empty())
+			_CloseFile(fFiles.size() - 1);
+
+		ContextMap::Iterator iterator = fContexts.GetIterator();
+		while (iterator.HasNext())
+			delete *(iterator.NextValue());
+
+		free(fBuffer);
+	}
+
+	/*! Returns an open handle for the node, most recently used last. The
+	    node's URL is checked, so a renamed node gets a new handle.
+	*/
+	status_t GetFile(const Job* job, bool writable, File** outFile)
+	{
+		for (size_t i = 0; i < fFiles.size(); i++) {
+			File& file = fFiles[i];
+			if (file.fNodeID != job->fNodeID)
+				continue;
+
+			if (file.fURL != job->fURL || (writable && !file.fWritable)) {
+				_CloseFile(i);
+				break;
+			}
+
+			// Still open, make it the most recently used
+			File used = file;
+			fFiles.erase(fFiles.begin() + i);
+			fFiles.push_back(used);
+			*outFile = &fFiles.back();
+			return B_OK;
+		}
+
+		if (fFiles.size() >= kMaxOpenFiles)
+			_CloseFile(0);
+
+		SambaContext* const context = _GetContext(job->fURL);
+		if (context == NULL)
+			return B_NO_MEMORY;
+
+		SMBCFILE* handle;
+		SambaContextLease lease(context);
+		status_t status = lease->Open(job->fURL,
+			writable ? O_RDWR : O_RDONLY, &handle);
+		if (status != B_OK)
+			return status;
+
+		File file;
+		file.fNodeID = job->fNodeID;
+		file.fURL = job->fURL;
+		file.fContext = context;
+		file.fFile = handle;
+		file.fPosition = 0;
+		file.fWritable = writable;
+		fFiles.push_back(file);
+
+		*outFile = &fFiles.back();
+		return B_OK;
+	}
+
+	/*! Closes the handles of the URL, and those of the entries below it.
+	    fFileLock must be held.
+	*/
+	void CloseFiles(const BString& url)
+	{
+		BString directoryURL(url);
+		directoryURL << '/';
+
+		for (size_t i = fFiles.size(); i-- > 0;) {
+			const BString& fileURL = fFiles[i].fURL;
+			if (fileURL == url || fileURL.StartsWith(directoryURL))
+				_CloseFile(i);
+		}
+	}
+
+	/*! Reads or writes at the offset with the handle. Writes are complete
+	    or fail, reads are only short at the end of the file. How long it
+	    took goes to the volume's transfer size tuning.
+	*/
+	status_t Transfer(File* file, bool isWrite, off_t offset, uint8* buffer,
+		size_t* _length)
+	{
+		const size_t length = *_length;
+		const bigtime_t startTime = system_time();
+
+		SambaContextLease context(file->fContext);
+		status_t status = B_OK;
+		size_t transferred = 0;
+		if (!isWrite) {
+			transferred = length;
+			status = context->ReadAt(file->fFile, &file->fPosition, offset,
+				buffer, &transferred);
+		} else {
+			while (transferred < length) {
+				size_t count = length - transferred;
+				status = context->WriteAt(file->fFile, &file->fPosition,
+					offset + transferred, buffer + transferred, &count);
+				if (status == B_OK && count == 0)
+					status = B_IO_ERROR;
+				if (status != B_OK)
+					break;
+				transferred += count;
+			}
+		}
+		context.Release();
+
+		if (status == B_OK) {
+			fOwner->fVolume->IOSizes()->Record(file->fURL, transferred,
+				system_time() - startTime);
+		}
+
+		*_length = transferred;
+		return status;
+	}
+
+	/*! Makes sure the buffer holds at least the given size.
+	*/
+	status_t ReserveBuffer(size_t size)
+	{
+		if (fBufferSize >= size)
+			return B_OK;
+
+		uint8* const buffer = static_cast<uint8*>(realloc(fBuffer, size));
+		if (buffer == NULL)
+			return B_NO_MEMORY;
+
+		fBuffer = buffer;
+		fBufferSize = size;
+		return B_OK;
+	}
+
+	AsyncIO*		fOwner;
+	thread_id		fThread;
+	BLocker			fFileLock;
+	Job*			fJob;
+		// being run, protected by the AsyncIO's lock
+	uint8*			fBuffer;
+	size_t			fBufferSize;
+
+private:
+	SambaContext* _GetContext(const BString& url)
+	{
+		const BString serverName = SambaContextPool::ServerName(url);
+		SambaContext* context = fContexts.Get(serverName.String());
+		if (context != NULL)
+			return context;
+
+		context = fOwner->fVolume->SambaContexts()->CreateContext();
+		if (context == NULL
+			|| fContexts.Put(serverName.String(), context) != B_OK) {
+			delete context;
+			return NULL;
+		}
+		return context;
+	}
+
+	void _CloseFile(size_t index)
+	{
+		File& file = fFiles[index];
+		SambaContextLease lease(file.fContext);
+		lease->Close(file.fFile);
+		lease.Release();
+
+		fFiles.erase(fFiles.begin() + index);
+	}
+
+	ContextMap		fContexts;
+	FileList		fFiles;
+		// least recently used first
+};
+
+
+// #pragma mark - AsyncIO
+
+
+AsyncIO::AsyncIO(Volume* volume)
+	:
+	fVolume(volume),
+	fJobSem(-1),
+	fStopped(false),
+	fStripeWidth(kDefaultStripeWidth)
+{
+}
+
+
+AsyncIO::~AsyncIO()
+{
+	Stop();
+
+	if (fJobSem >= 0)
+		delete_sem(fJobSem);
+}
+
+
+/*! Takes over the request, notify_io_request() is called once it is done.
+    The URL of the node is needed by the workers to open their own handles.
+*/
+status_t
+AsyncIO::Queue(ino_t nodeID, const BString& url, io_request* request)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	if (fStopped)
+		return B_FILE_ERROR;
+
+	status_t status = _StartWorkers();
+	if (status != B_OK)
+		return status;
+
+	Job* const job = new(std::nothrow) Job(nodeID, url, request);
+	if (job == NULL)
+		return B_NO_MEMORY;
+
+	TRACE("queue %s at %" B_PRIdOFF ", %" B_PRIdOFF " bytes (%s)",
+		url.String(), io_request_offset(request), io_request_length(request),
+		io_request_is_write(request) ? "write" : "read");
+
+	fJobs.push_back(job);
+	release_sem(fJobSem);
+	return B_OK;
+}
+
+
+/*! A queued request is completed with B_CANCELED right away. One that is
+    already running stops before its next transfer.
+*/
+status_t
+AsyncIO::Cancel(io_request* request)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	for (JobQueue::iterator it = fJobs.begin(); it != fJobs.end(); it++) {
+		Job* const job = *it;
+		if (job->fRequest != request)
+			continue;
+
+		fJobs.erase(it);
+		locker.Unlock();
+
+		TRACE("canceled queued request %p", request);
+		notify_io_request(request, B_CANCELED);
+		delete job;
+		return B_OK;
+	}
+
+	for (size_t i = 0; i < fWorkers.size(); i++) {
+		Job* const job = fWorkers[i]->fJob;
+		if (job != NULL && job->fRequest == request) {
+			atomic_set(&job->fCanceled, 1);
+			return B_OK;
+		}
+	}
+
+	return B_BAD_VALUE;
+}
+
+
+/*! Cancels everything still queued and waits for the workers. Must be done
+    before the volume goes away.
+*/
+void
+AsyncIO::Stop()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	if (fStopped)
+		return;
+	fStopped = true;
+
+	JobQueue jobs;
+	jobs.swap(fJobs);
+	for (size_t i = 0; i < fWorkers.size(); i++) {
+		if (fWorkers[i]->fJob != NULL)
+			atomic_set(&fWorkers[i]->fJob->fCanceled, 1);
+	}
+
+	WorkerList workers;
+	workers.swap(fWorkers);
+	if (fJobSem >= 0)
+		release_sem_etc(fJobSem, workers.size(), 0);
+	locker.Unlock();
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+		Job* const job = jobs[i];
+		if (job->fStripe != NULL) {
+			// Nobody else takes the chunks left, they are canceled
+			_RunStripe(NULL, job, job->fStripe);
+			_ReleaseStripe(job->fStripe);
+		} else
+			notify_io_request(job->fRequest, B_CANCELED);
+		delete job;
+	}
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		status_t result;
+		wait_for_thread(workers[i]->fThread, &result);
+		delete workers[i];
+	}
+}
+
+
+/*! Closes the workers' handles of the URL, and of all entries below it,
+    once they are done with their current jobs. The handles don't share
+    deleting with other opens of the file, so they must be gone before the
+    entry is removed or renamed, and after the last cookie is closed.
+*/
+void
+AsyncIO::CloseFiles(const BString& url)
+{
+	AutoLocker<BLocker> locker(fLock);
+	WorkerList workers(fWorkers);
+	locker.Unlock();
+
+	// Stop() waits for the workers before deleting them, which can't happen
+	// while a node of the volume is still in use
+	for (size_t i = 0; i < workers.size(); i++) {
+		Worker* const worker = workers[i];
+		AutoLocker<BLocker> fileLocker(worker->fFileLock);
+		worker->CloseFiles(url);
+	}
+}
+
+
+/*! How many connections a large transfer is spread over, 1 turns striping
+    off. Only has an effect before the first request.
+*/
+void
+AsyncIO::SetStripeWidth(int32 width)
+{
+	AutoLocker<BLocker> locker(fLock);
+	fStripeWidth = max_c(width, 1);
+}
+
+
+bool
+AsyncIO::ShouldStripe(const BString& url, size_t length)
+{
+	return fStripeWidth > 1
+		&& length >= kStripeThreshold * fVolume->IOSizes()->IOSize(url);
+}
+
+
+/*! Moves a range of the node between the buffer and the server, striped
+    over the workers' connections, and waits for it. As with read() and
+    write(), *length is set to what was transferred, and an error is only
+    returned if that is nothing.
+*/
+status_t
+AsyncIO::Transfer(ino_t nodeID, const BString& url, bool isWrite,
+	off_t offset, void* buffer, size_t* length)
+{
+	Job job(nodeID, url, NULL);
+	status_t status = _Stripe(NULL, &job, isWrite, offset,
+		static_cast<uint8*>(buffer), length);
+	if (status != B_OK && *length > 0)
+		return B_OK;
+	return status;
+}
+
+
+/*static*/ status_t
+AsyncIO::_WorkerEntry(void* data)
+{
+	Worker* const worker = static_cast<Worker*>(data);
+	worker->fOwner->_Worker(worker);
+	return B_OK;
+}
+
+
+void
+AsyncIO::_Worker(Worker* worker)
+{
+	while (Job* job = _NextJob(worker)) {
+		AutoLocker<BLocker> fileLocker(worker->fFileLock);
+		const status_t status = job->fStripe != NULL
+			? _RunStripe(worker, job, job->fStripe)
+			: _Transfer(worker, job);
+		fileLocker.Unlock();
+
+		_Finish(worker, job, status);
+	}
+}
+
+
+status_t
+AsyncIO::_StartWorkers()
+{
+	if (!fWorkers.empty())
+		return B_OK;
+
+	if (fJobSem < 0) {
+		fJobSem = create_sem(0, "smb async io jobs");
+		if (fJobSem < 0)
+			return fJobSem;
+	}
+
+	const int32 workerCount = max_c((int32)kMinWorkerCount, fStripeWidth);
+	for (int32 i = 0; i < workerCount; i++) {
+		Worker* const worker = new(std::nothrow) Worker(this);
+		if (worker == NULL)
+			break;
+
+		worker->fThread = spawn_thread(&_WorkerEntry, "smb async io",
+			B_NORMAL_PRIORITY, worker);
+		if (worker->fThread < 0) {
+			delete worker;
+			break;
+		}
+		fWorkers.push_back(worker);
+		resume_thread(worker->fThread);
+	}
+
+	return fWorkers.empty() ? B_NO_MORE_THREADS : B_OK;
+}
+
+
+/*! Waits for the next job, returns NULL when the workers are stopped.
+*/
+AsyncIO::Job*
+AsyncIO::_NextJob(Worker* worker)
+{
+	for (;;) {
+		if (acquire_sem(fJobSem) != B_OK)
+			return NULL;
+
+		AutoLocker<BLocker> locker(fLock);
+		if (fStopped)
+			return NULL;
+		if (fJobs.empty()) {
+			// The job was canceled before anyone took it up
+			continue;
+		}
+
+		Job* const job = fJobs.front();
+		fJobs.pop_front();
+		worker->fJob = job;
+		return job;
+	}
+}
+
+
+void
+AsyncIO::_Finish(Worker* worker, Job* job, status_t status)
+{
+	AutoLocker<BLocker> locker(fLock);
+	worker->fJob = NULL;
+	locker.Unlock();
+
+	if (job->fStripe != NULL) {
+		_ReleaseStripe(job->fStripe);
+		delete job;
+		return;
+	}
+
+	TRACE("%s done: %s", job->fURL.String(), strerror(status));
+
+	if (io_request_is_write(job->fRequest)) {
+		// A stat taken while the write was running is outdated
+		fVolume->Stats()->Invalidate(job->fNodeID);
+	}
+
+	notify_io_request(job->fRequest, status);
+	delete job;
+}
+
+
+/*! Moves the data of the request in chunks of the volume's I/O size, with
+    the worker's own handle for the node.
+*/
+status_t
+AsyncIO::_Transfer(Worker* worker, Job* job)
+{
+	io_request* const request = job->fRequest;
+	const bool isWrite = io_request_is_write(request);
+
+	if (ShouldStripe(job->fURL, io_request_length(request))) {
+		uint8* const buffer = static_cast<uint8*>(
+			malloc(io_request_length(request)));
+		if (buffer != NULL) {
+			status_t status = _TransferStriped(worker, job, buffer);
+			free(buffer);
+			return status;
+		}
+		// Without the memory, it's done on one connection
+	}
+
+	const size_t ioSize = fVolume->IOSizes()->IOSize(job->fURL);
+	status_t status = worker->ReserveBuffer(ioSize);
+	if (status != B_OK)
+		return status;
+
+	Worker::File* file;
+	status = worker->GetFile(job, isWrite, &file);
+	if (status != B_OK)
+		return status;
+
+	off_t offset = io_request_offset(request);
+	off_t bytesLeft = io_request_length(request);
+	while (bytesLeft > 0) {
+		if (atomic_get(&job->fCanceled) != 0)
+			return B_CANCELED;
+
+		const size_t length = min_c(bytesLeft, (off_t)ioSize);
+		size_t transferred = length;
+
+		if (isWrite) {
+			status = read_from_io_request(request, worker->fBuffer, length);
+			if (status == B_OK) {
+				status = worker->Transfer(file, true, offset, worker->fBuffer,
+					&transferred);
+			}
+		} else {
+			status = worker->Transfer(file, false, offset, worker->fBuffer,
+				&transferred);
+			if (status == B_OK && transferred > 0) {
+				status = write_to_io_request(request, worker->fBuffer,
+					transferred);
+			}
+		}
+
+		if (status != B_OK)
+			return status;
+		if (transferred < length) {
+			// End of the file
+			break;
+		}
+
+		offset += length;
+		bytesLeft -= length;
+	}
+
+	return B_OK;
+}
+
+
+/*! Stripes the data of the request, which goes through the buffer. It must
+    be large enough for all of it.
+*/
+status_t
+AsyncIO::_TransferStriped(Worker* worker, Job* job, uint8* buffer)
+{
+	io_request* const request = job->fRequest;
+	const bool isWrite = io_request_is_write(request);
+	size_t length = io_request_length(request);
+
+	if (isWrite) {
+		status_t status = read_from_io_request(request, buffer, length);
+		if (status != B_OK)
+			return status;
+	}
+
+	status_t status = _Stripe(worker, job, isWrite,
+		io_request_offset(request), buffer, &length);
+
+	if (!isWrite && length > 0) {
+		// What came in before an error or the end of the file
+		status_t writeStatus = write_to_io_request(request, buffer, length);
+		if (status == B_OK)
+			status = writeStatus;
+	}
+
+	return status;
+}
+
+
+/*! Splits the range into chunks of the I/O size, and queues helper jobs, so
+    that up to the stripe width of workers move chunks at the same time. A
+    worker starting the stripe takes chunks itself. Waits until all chunks
+    are done, *length is then set to what was transferred before the first
+    failed chunk, or a short read.
+*/
+status_t
+AsyncIO::_Stripe(Worker* worker, Job* job, bool isWrite, off_t offset,
+	uint8* buffer, size_t* length)
+{
+	Stripe* const stripe = new(std::nothrow) Stripe(isWrite, offset, buffer,
+		*length, fVolume->IOSizes()->IOSize(job->fURL), &job->fCanceled);
+	if (stripe == NULL)
+		return B_NO_MEMORY;
+
+	status_t status = stripe->Init();
+	if (status != B_OK) {
+		delete stripe;
+		return status;
+	}
+
+	int32 helperCount = min_c(fStripeWidth, stripe->fChunkCount);
+	if (worker != NULL)
+		helperCount--;
+
+	AutoLocker<BLocker> locker(fLock);
+	int32 queued = 0;
+	if (!fStopped && _StartWorkers() == B_OK) {
+		for (; queued < helperCount; queued++) {
+			Job* const helper = new(std::nothrow) Job(job->fNodeID,
+				job->fURL, NULL, stripe);
+			if (helper == NULL)
+				break;
+
+			// Ahead of other requests, the stripe is waited for
+			atomic_add(&stripe->fReferences, 1);
+			fJobs.push_front(helper);
+		}
+		if (queued > 0)
+			release_sem_etc(fJobSem, queued, 0);
+	}
+	locker.Unlock();
+
+	TRACE("%s at %" B_PRIdOFF ", %" B_PRIuSIZE " bytes in %" B_PRId32
+		" chunks, %" B_PRId32 " helpers", job->fURL.String(), offset,
+		*length, stripe->fChunkCount, queued);
+
+	if (worker != NULL || queued == 0) {
+		// Without a worker, all chunks get canceled
+		_RunStripe(worker, job, stripe);
+	}
+
+	while (acquire_sem(stripe->fDoneSem) == B_INTERRUPTED)
+		;
+
+	// Put the chunks together in order
+	size_t transferred = 0;
+	status = B_OK;
+	for (int32 i = 0; i < stripe->fChunkCount; i++) {
+		const Stripe::Chunk& chunk = stripe->fChunks[i];
+		if (chunk.fStatus != B_OK) {
+			status = chunk.fStatus;
+			break;
+		}
+
+		transferred += chunk.fLength;
+		if (chunk.fLength < stripe->fChunkSize) {
+			// End of the file, or the last chunk
+			break;
+		}
+	}
+
+	_ReleaseStripe(stripe);
+
+	*length = transferred;
+	return status;
+}
+
+
+/*! Takes chunks of the stripe until there are none left. Without a worker,
+    or once canceled, the chunks taken are marked as such.
+*/
+status_t
+AsyncIO::_RunStripe(Worker* worker, Job* job, Stripe* stripe)
+{
+	for (;;) {
+		const int32 index = atomic_add(&stripe->fNextChunk, 1);
+		if (index >= stripe->fChunkCount)
+			return B_OK;
+
+		Stripe::Chunk& chunk = stripe->fChunks[index];
+		const size_t chunkOffset = (size_t)index * stripe->fChunkSize;
+		chunk.fLength = min_c(stripe->fLength - chunkOffset,
+			stripe->fChunkSize);
+
+		Worker::File* file = NULL;
+		if (worker == NULL || atomic_get(stripe->fCanceled) != 0
+			|| atomic_get(&job->fCanceled) != 0) {
+			chunk.fStatus = B_CANCELED;
+		} else
+			chunk.fStatus = worker->GetFile(job, stripe->fIsWrite, &file);
+
+		if (chunk.fStatus == B_OK) {
+			chunk.fStatus = worker->Transfer(file, stripe->fIsWrite,
+				stripe->fOffset + chunkOffset, stripe->fBuffer + chunkOffset,
+				&chunk.fLength);
+		}
+
+		if (atomic_add(&stripe->fChunksDone, 1) == stripe->fChunkCount - 1)
+			release_sem(stripe->fDoneSem);
+	}
+}
+
+
+void
+AsyncIO::_ReleaseStripe(Stripe* stripe)
+{
+	if (atomic_add(&stripe->fReferences, -1) == 1)
+		delete stripe;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_ASYNC_IO_H
+#define SMBFS_ASYNC_IO_H
+
+#include <Locker.h>
+#include <OS.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <fs_interface.h>
+
+#include <deque>
+#include <vector>
+
+
+namespace Smb {
+
+
+class Volume;
+
+
+/*! Runs the io_requests of file nodes in the background. Requests are queued
+    for a pool of worker threads. Each worker has Samba contexts and file
+    handles of its own, so several requests are in flight to the server at
+    the same time, and each completes as soon as its data is there,
+    regardless of the order they came in. Requests which are still queued
+    or between two transfers can be canceled.
+    Large transfers are striped: their range is split into chunks which up
+    to the stripe width of workers move at the same time, each on its own
+    connection to the server.
+*/
+class AsyncIO {
+public:
+								AsyncIO(Volume* volume);
+								~AsyncIO();
+
+			status_t			Queue(ino_t nodeID, const BString& url,
+									io_request* request);
+			status_t			Cancel(io_request* request);
+			void				Stop();
+
+			void				CloseFiles(const BString& url);
+
+			void				SetStripeWidth(int32 width);
+			bool				ShouldStripe(const BString& url,
+									size_t length);
+			status_t			Transfer(ino_t nodeID, const BString& url,
+									bool isWrite, off_t offset, void* buffer,
+									size_t* length);
+
+private:
+	struct Job;
+	struct Stripe;
+	struct Worker;
+	typedef std::deque<Job*> JobQueue;
+	typedef std::vector<Worker*> WorkerList;
+
+	enum {
+		kMinWorkerCount			= 4,
+			// requests in flight at the same time
+		kDefaultStripeWidth		= 4,
+		kStripeThreshold		= 2
+			// in I/O size chunks, smaller transfers aren't striped
+	};
+
+private:
+	static	status_t			_WorkerEntry(void* data);
+			void				_Worker(Worker* worker);
+			status_t			_StartWorkers();
+
+			Job*				_NextJob(Worker* worker);
+			void				_Finish(Worker* worker, Job* job,
+									status_t status);
+			status_t			_Transfer(Worker* worker, Job* job);
+			status_t			_TransferStriped(Worker* worker, Job* job,
+									uint8* buffer);
+
+			status_t			_Stripe(Worker* worker, Job* job,
+									bool isWrite, off_t offset,
+									uint8* buffer, size_t* length);
+			status_t			_RunStripe(Worker* worker, Job* job,
+									Stripe* stripe);
+			void				_ReleaseStripe(Stripe* stripe);
+
+private:
+			Volume*				fVolume;
+
+			BLocker				fLock;
+			sem_id				fJobSem;
+			JobQueue			fJobs;
+			WorkerList			fWorkers;
+			bool				fStopped;
+			int32				fStripeWidth;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_ASYNC_IO_H
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_ENTRY_KEY_H
+#define SMBFS_ENTRY_KEY_H
+
+#include <SupportDefs.h>
+
+#include <private/shared/HashMap.h>
+
+#include <string.h>
+
+#include "NodeDefs.h"
+
+
+namespace Smb {
+
+
+/*! Directory entry, by the ID of the directory. The key doesn't copy the
+    name, which has to stay valid as long as the key is used. The hash is
+    computed once, probes compare it before the name.
+*/
+struct EntryKey {
+	EntryKey()
+		:
+		directoryID(kInvalidNodeID),
+		name(""),
+		hash(0)
+	{
+	}
+
+	EntryKey(ino_t directoryID, const char* name)
+		:
+		directoryID(directoryID),
+		name(name),
+		hash(HashKey64<ino_t>(directoryID).GetHashCode())
+	{
+		for (const char* c = name; *c != '\0'; c++)
+			hash = 31 * hash + (uint8)*c;
+	}
+
+	uint32 GetHashCode() const
+	{
+		return hash;
+	}
+
+	bool operator==(const EntryKey& other) const
+	{
+		return hash == other.hash && directoryID == other.directoryID
+			&& strcmp(name, other.name) == 0;
+	}
+
+	bool operator!=(const EntryKey& other) const
+	{
+		return !(*this == other);
+	}
+
+	ino_t		directoryID;
+	const char*	name;
+	uint32		hash;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_ENTRY_KEY_H
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "IOSizeTuner.h"
+
+#include <private/shared/AutoLocker.h>
+
+#include <stdio.h>
+
+
+//#define TRACE_IO_SIZE_TUNER
+#ifdef TRACE_IO_SIZE_TUNER
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [IOSizeTuner %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+// #pragma mark - IOSizeTuner::Share
+
+
+IOSizeTuner::Share::Share()
+	:
+	fIOSize(kDefaultIOSize),
+	fDirection(1),
+	fHoldRounds(0),
+	fLastThroughput(0),
+	fBytes(0),
+	fTime(0),
+	fSamples(0)
+{
+}
+
+
+// #pragma mark - IOSizeTuner
+
+
+IOSizeTuner::IOSizeTuner()
+{
+}
+
+
+IOSizeTuner::~IOSizeTuner()
+{
+	ShareMap::Iterator iterator = fShares.GetIterator();
+	while (iterator.HasNext())
+		delete *(iterator.NextValue());
+}
+
+
+/*! Returns the size transfers with the share of the URL should have.
+*/
+size_t
+IOSizeTuner::IOSize(const BString& url)
+{
+	const BString name = ShareName(url);
+
+	AutoLocker<BLocker> locker(fLock);
+	Share* const share = fShares.Get(name.String());
+	return share != NULL ? share->fIOSize : (size_t)kDefaultIOSize;
+}
+
+
+/*! The largest transfer size of all shares, as reported for the volume.
+*/
+size_t
+IOSizeTuner::LargestIOSize()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	if (fShares.Size() == 0)
+		return kDefaultIOSize;
+
+	size_t largest = kMinIOSize;
+	ShareMap::Iterator iterator = fShares.GetIterator();
+	while (iterator.HasNext())
+		largest = max_c(largest, (*iterator.NextValue())->fIOSize);
+	return largest;
+}
+
+
+/*! Takes note of a transfer with the share of the URL. Only complete
+    transfers of the current size tell how well that size does, others
+    are ignored.
+*/
+void
+IOSizeTuner::Record(const BString& url, size_t bytes, bigtime_t duration)
+{
+	const BString name = ShareName(url);
+
+	AutoLocker<BLocker> locker(fLock);
+
+	Share* const share = _ShareFor(name);
+	if (share == NULL || bytes != share->fIOSize)
+		return;
+
+	if (duration > kMaxLatency && share->fIOSize > kMinIOSize) {
+		TRACE("%s: %" B_PRIuSIZE " bytes took %" B_PRId64 " µs",
+			name.String(), bytes, duration);
+		share->fDirection = -1;
+		share->fLastThroughput = 0;
+		_Resize(share, -1);
+		share->fHoldRounds = kHoldRounds;
+		return;
+	}
+
+	share->fBytes += bytes;
+	share->fTime += duration;
+	if (++share->fSamples >= kSamplesPerRound)
+		_EndRound(share);
+}
+
+
+/*! Returns "server/share" of an URL below a share.
+*/
+/*static*/ BString
+IOSizeTuner::ShareName(const BString& url)
+{
+	static const char kPrefix[] = "smb://";
+	const int32 prefixLength = sizeof(kPrefix) - 1;
+
+	const int32 start = url.FindFirst(kPrefix) == 0 ? prefixLength : 0;
+	int32 end = url.FindFirst('/', start);
+	if (end >= 0)
+		end = url.FindFirst('/', end + 1);
+	if (end < 0)
+		end = url.Length();
+
+	BString shareName;
+	url.CopyInto(shareName, start, end - start);
+	return shareName;
+}
+
+
+IOSizeTuner::Share*
+IOSizeTuner::_ShareFor(const BString& name)
+{
+	Share* share = fShares.Get(name.String());
+	if (share != NULL)
+		return share;
+
+	share = new(std::nothrow) Share;
+	if (share == NULL || fShares.Put(name.String(), share) != B_OK) {
+		delete share;
+		return NULL;
+	}
+	return share;
+}
+
+
+void
+IOSizeTuner::_EndRound(Share* share)
+{
+	const uint64 throughput = share->fTime > 0
+		? share->fBytes * 1000000 / share->fTime : 0;
+
+	TRACE("%" B_PRIu64 " bytes/s at %" B_PRIuSIZE " bytes", throughput,
+		share->fIOSize);
+
+	share->fBytes = 0;
+	share->fTime = 0;
+	share->fSamples = 0;
+
+	if (share->fHoldRounds > 0) {
+		// Staying with the best size found for now
+		share->fLastThroughput = throughput;
+		if (--share->fHoldRounds == 0)
+			_Resize(share, share->fDirection);
+		return;
+	}
+
+	if (throughput < share->fLastThroughput) {
+		// Worse than the size before, go back there and stay
+		share->fDirection = -share->fDirection;
+		_Resize(share, share->fDirection);
+		share->fHoldRounds = kHoldRounds;
+		return;
+	}
+
+	share->fLastThroughput = throughput;
+	_Resize(share, share->fDirection);
+}
+
+
+/*! Doubles or halves the transfer size, if it is not at the limit yet.
+    Otherwise it stays for a while, and then tries the other way.
+*/
+void
+IOSizeTuner::_Resize(Share* share, int32 direction)
+{
+	share->fBytes = 0;
+	share->fTime = 0;
+	share->fSamples = 0;
+
+	const size_t size = direction > 0
+		? share->fIOSize * 2 : share->fIOSize / 2;
+	if (size < kMinIOSize || size > kMaxIOSize) {
+		share->fDirection = -direction;
+		share->fHoldRounds = kHoldRounds;
+		return;
+	}
+
+	share->fIOSize = size;
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_IO_SIZE_TUNER_H
+#define SMBFS_IO_SIZE_TUNER_H
+
+#include <Locker.h>
+#include <OS.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <private/shared/HashMap.h>
+#include <private/shared/HashString.h>
+
+
+namespace Smb {
+
+
+/*! Finds the transfer size that works best for each share. Every share
+    starts out with the default size, then the measured throughput of
+    transfers decides: the size is doubled or halved for a round of
+    transfers, and kept going that way as long as the throughput gets
+    better. Once it gets worse, the size goes back and stays for a while
+    before trying again. A single transfer taking too long makes the size
+    smaller right away, so requests stay responsive on slow links.
+*/
+class IOSizeTuner {
+public:
+								IOSizeTuner();
+								~IOSizeTuner();
+
+			size_t				IOSize(const BString& url);
+			size_t				LargestIOSize();
+			void				Record(const BString& url, size_t bytes,
+									bigtime_t duration);
+
+	static	BString				ShareName(const BString& url);
+
+	enum {
+		kMinIOSize     = 32 * 1024,
+		kDefaultIOSize = 128 * 1024,
+		kMaxIOSize     = 4 * 1024 * 1024
+	};
+
+private:
+	struct Share {
+								Share();
+
+			size_t				fIOSize;
+			int32				fDirection;
+				// 1 to grow the size next, -1 to shrink it
+			int32				fHoldRounds;
+				// rounds left before trying another size
+			uint64				fLastThroughput;
+				// bytes per second in the last round
+
+			uint64				fBytes;
+			bigtime_t			fTime;
+			int32				fSamples;
+				// of the current round
+	};
+
+	typedef HashMap<HashString, Share*> ShareMap;
+
+	enum {
+		kSamplesPerRound = 16,
+		kHoldRounds      = 32,
+		kMaxLatency      = 1000 * 1000
+			// µsec a single transfer may take
+	};
+
+private:
+			Share*				_ShareFor(const BString& name);
+			void				_EndRound(Share* share);
+			void				_Resize(Share* share, int32 direction);
+
+private:
+			BLocker				fLock;
+			ShareMap			fShares;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_IO_SIZE_TUNER_H
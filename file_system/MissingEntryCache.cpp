@@ -0,0 +1,193 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "MissingEntryCache.h"
+
+#include <fs_cache.h>
+#include <private/shared/AutoLocker.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+
+
+//#define TRACE_MISSING_ENTRY_CACHE
+#ifdef TRACE_MISSING_ENTRY_CACHE
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [MissingEntryCache %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+MissingEntryCache::MissingEntryCache(dev_t volumeID)
+	:
+	fVolumeID(volumeID),
+	fNextExpirationCheck(B_INFINITE_TIMEOUT)
+{
+}
+
+
+MissingEntryCache::~MissingEntryCache()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	DirectoryMap::Iterator iterator = fDirectories.GetIterator();
+	while (iterator.HasNext())
+		delete *(iterator.NextValue());
+	fDirectories.Clear();
+}
+
+
+bool
+MissingEntryCache::Contains(ino_t directoryID, const char* name)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	const bigtime_t now = system_time();
+	_RemoveExpired(now);
+
+	Directory* const directory = fDirectories.Get(directoryID);
+	if (directory == NULL)
+		return false;
+
+	bigtime_t* expirationTime;
+	return directory->fEntries.Get(name, expirationTime)
+		&& *expirationTime > now;
+}
+
+
+void
+MissingEntryCache::Add(ino_t directoryID, const char* name)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	const bigtime_t now = system_time();
+	_RemoveExpired(now);
+
+	Directory* directory = fDirectories.Get(directoryID);
+	if (directory == NULL) {
+		if (fDirectories.Size() >= kMaxDirectories)
+			return;
+
+		directory = new(std::nothrow) Directory;
+		if (directory == NULL
+			|| fDirectories.Put(directoryID, directory) != B_OK) {
+			delete directory;
+			return;
+		}
+	}
+
+	if (directory->fEntries.Size() >= kMaxEntriesPerDirectory
+		&& !directory->fEntries.ContainsKey(name)) {
+		return;
+	}
+
+	const bigtime_t expirationTime = now + kTimeToLive;
+	if (directory->fEntries.Put(name, expirationTime) != B_OK)
+		return;
+	fNextExpirationCheck = std::min(fNextExpirationCheck, expirationTime);
+
+	TRACE("dir=0x%" B_PRIx64 " name=%s", directoryID, name);
+	entry_cache_add_missing(fVolumeID, directoryID, name);
+}
+
+
+void
+MissingEntryCache::Remove(ino_t directoryID, const char* name)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	Directory* const directory = fDirectories.Get(directoryID);
+	if (directory == NULL || !directory->fEntries.ContainsKey(name))
+		return;
+
+	directory->fEntries.Remove(name);
+	entry_cache_remove(fVolumeID, directoryID, name);
+
+	if (directory->fEntries.Size() == 0) {
+		fDirectories.Remove(directoryID);
+		delete directory;
+	}
+}
+
+
+/*! Forgets all missing entries of a directory, e.g. because something was
+    created in it.
+*/
+void
+MissingEntryCache::RemoveDirectory(ino_t directoryID)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	Directory* const directory = fDirectories.Remove(directoryID);
+	if (directory == NULL)
+		return;
+
+	_RemoveEntries(directoryID, directory);
+	delete directory;
+}
+
+
+/*! The VFS entry cache doesn't expire entries by itself, so it's up to us to
+    take expired ones back out of it. Called by the volume periodically.
+*/
+void
+MissingEntryCache::RemoveExpired()
+{
+	AutoLocker<BLocker> locker(fLock);
+	_RemoveExpired(system_time());
+}
+
+
+/*! Only walks the entries once the first of them has expired.
+*/
+void
+MissingEntryCache::_RemoveExpired(bigtime_t now)
+{
+	if (now < fNextExpirationCheck)
+		return;
+	fNextExpirationCheck = B_INFINITE_TIMEOUT;
+
+	DirectoryMap::Iterator directoryIterator = fDirectories.GetIterator();
+	while (directoryIterator.HasNext()) {
+		DirectoryMap::Entry entry = directoryIterator.Next();
+		Directory* const directory = entry.value;
+
+		ExpirationMap::Iterator iterator = directory->fEntries.GetIterator();
+		while (iterator.HasNext()) {
+			ExpirationMap::Entry nameEntry = iterator.Next();
+			if (nameEntry.value <= now) {
+				entry_cache_remove(fVolumeID, entry.key.value,
+					nameEntry.key.GetString());
+				iterator.Remove();
+			} else {
+				fNextExpirationCheck = std::min(fNextExpirationCheck,
+					nameEntry.value);
+			}
+		}
+
+		if (directory->fEntries.Size() == 0) {
+			directoryIterator.Remove();
+			delete directory;
+		}
+	}
+}
+
+
+void
+MissingEntryCache::_RemoveEntries(ino_t directoryID, Directory* directory)
+{
+	ExpirationMap::Iterator iterator = directory->fEntries.GetIterator();
+	while (iterator.HasNext()) {
+		entry_cache_remove(fVolumeID, directoryID,
+			iterator.Next().key.GetString());
+	}
+	directory->fEntries.Clear();
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_MISSING_ENTRY_CACHE_H
+#define SMBFS_MISSING_ENTRY_CACHE_H
+
+#include <Locker.h>
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include <private/shared/HashMap.h>
+#include <private/shared/HashString.h>
+
+
+namespace Smb {
+
+
+/*! Remembers, per directory and for a short time, names which were looked up
+    but don't exist. Build tools and path searches probe lots of those, and
+    every miss would otherwise cost a failed stat on the server. Entries are
+    also handed to the VFS entry cache, so repeated misses don't even reach
+    us; removing them here removes them there, too. That is also why
+    RemoveExpired() has to be called periodically: lookups of expired
+    entries don't come to us to notice.
+*/
+class MissingEntryCache {
+public:
+								MissingEntryCache(dev_t volumeID);
+								~MissingEntryCache();
+
+			bool				Contains(ino_t directoryID, const char* name);
+			void				Add(ino_t directoryID, const char* name);
+			void				Remove(ino_t directoryID, const char* name);
+			void				RemoveDirectory(ino_t directoryID);
+			void				RemoveExpired();
+
+private:
+	typedef HashMap<HashString, bigtime_t> ExpirationMap;
+		// name -> expiration time
+
+	struct Directory {
+			ExpirationMap		fEntries;
+	};
+	typedef HashMap<HashKey64<ino_t>, Directory*> DirectoryMap;
+
+	enum {
+		kTimeToLive              = 3 * 1000 * 1000,	// µsec
+		kMaxEntriesPerDirectory  = 64,
+		kMaxDirectories          = 256
+	};
+
+private:
+			void				_RemoveExpired(bigtime_t now);
+			void				_RemoveEntries(ino_t directoryID,
+									Directory* directory);
+
+private:
+			BLocker				fLock;
+			const dev_t			fVolumeID;
+			DirectoryMap		fDirectories;
+			bigtime_t			fNextExpirationCheck;
+				// when the first entry expires
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_MISSING_ENTRY_CACHE_H
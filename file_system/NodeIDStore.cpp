@@ -0,0 +1,380 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "NodeIDStore.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+//#define TRACE_NODE_ID_STORE
+#ifdef TRACE_NODE_ID_STORE
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [NodeIDStore %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+struct NodeIDStore::Header {
+	uint32			magic;
+	uint32			version;
+} _PACKED;
+
+
+/*! Followed by the name including the terminating null. A record without a
+    directory and name removes the ID's entry.
+*/
+struct NodeIDStore::Record {
+	int64			id;
+	int64			directoryID;
+	uint16			nameLength;
+} _PACKED;
+
+
+NodeIDStore::NodeIDStore(const char* path)
+	:
+	fPath(path),
+	fStatus(B_NO_INIT),
+	fFD(-1),
+	fMapping(NULL),
+	fMappingSize(0),
+	fNextID(kNetworkNodeID + 1),
+	fRecordCount(0)
+{
+}
+
+
+NodeIDStore::~NodeIDStore()
+{
+	if (fMapping != NULL)
+		munmap(fMapping, fMappingSize);
+	if (fFD >= 0)
+		close(fFD);
+
+	for (NameSet::iterator it = fNames.begin(); it != fNames.end(); it++)
+		free(*it);
+}
+
+
+/*! Returns the ID the entry had last, or kInvalidNodeID.
+*/
+ino_t
+NodeIDStore::Lookup(ino_t directoryID, const char* name)
+{
+	if (_Load() != B_OK)
+		return kInvalidNodeID;
+
+	return fIDs.Get(EntryKey(directoryID, name));
+}
+
+
+/*! The entry which has the node ID, if there is one.
+*/
+bool
+NodeIDStore::GetEntry(ino_t id, ino_t* _directoryID, BString* _name)
+{
+	if (_Load() != B_OK)
+		return false;
+
+	EntryKey* key;
+	if (!fKeys.Get(id, key))
+		return false;
+
+	*_directoryID = key->directoryID;
+	*_name = key->name;
+	return true;
+}
+
+
+/*! The entry has the node ID now. Whatever entry the ID had before is
+    dropped, e.g. when the node was renamed.
+*/
+void
+NodeIDStore::Add(ino_t directoryID, const char* name, ino_t id)
+{
+	if (_Load() != B_OK)
+		return;
+
+	// Entries are added again each time they are looked up afresh
+	if (fIDs.Get(EntryKey(directoryID, name)) == id)
+		return;
+
+	char* const copy = strdup(name);
+	if (copy == NULL)
+		return;
+	fNames.insert(copy);
+
+	_Append(id, directoryID, copy);
+	_Put(EntryKey(directoryID, copy), id);
+	if ((int64)id >= fNextID)
+		fNextID = id + 1;
+}
+
+
+/*! The node is gone, its entry must not get the ID again.
+*/
+void
+NodeIDStore::Remove(ino_t id)
+{
+	if (_Load() != B_OK || !fKeys.ContainsKey(id))
+		return;
+
+	_Append(id, kInvalidNodeID, NULL);
+	_Forget(id);
+}
+
+
+/*! Lowest ID not used in any mount so far.
+*/
+int64
+NodeIDStore::NextID()
+{
+	_Load();
+	return fNextID;
+}
+
+
+status_t
+NodeIDStore::_Load()
+{
+	if (fStatus != B_NO_INIT)
+		return fStatus;
+	fStatus = B_ERROR;
+
+	fFD = open(fPath.String(), O_RDWR | O_CREAT | O_APPEND, 0600);
+	if (fFD < 0) {
+		TRACE("can't open %s: %s", fPath.String(), strerror(errno));
+		return fStatus;
+	}
+
+	struct stat st;
+	if (fstat(fFD, &st) != 0)
+		return fStatus;
+
+	if (st.st_size == 0) {
+		Header header;
+		header.magic = kMagic;
+		header.version = kVersion;
+		if (write(fFD, &header, sizeof(header)) != (ssize_t)sizeof(header))
+			return fStatus;
+		fStatus = B_OK;
+		return fStatus;
+	}
+
+	if ((size_t)st.st_size < sizeof(Header))
+		return fStatus;
+
+	fMappingSize = st.st_size;
+	fMapping = mmap(NULL, fMappingSize, PROT_READ, MAP_SHARED, fFD, 0);
+	if (fMapping == MAP_FAILED) {
+		fMapping = NULL;
+		return fStatus;
+	}
+
+	const uint8* const data = static_cast<const uint8*>(fMapping);
+	Header header;
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != kMagic || header.version != kVersion) {
+		TRACE("%s isn't a node ID map", fPath.String());
+		return fStatus;
+	}
+
+	const size_t validSize = _ReadRecords(data, fMappingSize);
+	if (validSize < fMappingSize) {
+		// The last record was cut short, e.g. by a crash. Appending behind
+		// it would garble the records that follow.
+		if (ftruncate(fFD, validSize) != 0)
+			return fStatus;
+	}
+
+	if (fRecordCount >= kMinCompactRecords
+		&& fRecordCount > 2 * (size_t)fIDs.Size()) {
+		// Not fatal, the log just stays as long as it is
+		_Compact();
+	}
+
+	TRACE("loaded %" B_PRId32 " entries, next ID 0x%" B_PRIx64,
+		fIDs.Size(), fNextID);
+
+	fStatus = B_OK;
+	return fStatus;
+}
+
+
+/*! Returns the size of the part of the file which holds complete records.
+*/
+size_t
+NodeIDStore::_ReadRecords(const uint8* data, size_t size)
+{
+	size_t offset = sizeof(Header);
+	while (offset + sizeof(Record) <= size) {
+		Record record;
+		memcpy(&record, data + offset, sizeof(record));
+
+		const size_t end = offset + sizeof(Record) + record.nameLength;
+		if (end > size)
+			break;
+
+		const char* const name
+			= reinterpret_cast<const char*>(data + offset + sizeof(Record));
+		if (record.nameLength == 0)
+			_Forget(record.id);
+		else if (name[record.nameLength - 1] == '\0')
+			_Put(EntryKey(record.directoryID, name), record.id);
+		else
+			break;
+
+		if (record.id >= fNextID)
+			fNextID = record.id + 1;
+		fRecordCount++;
+		offset = end;
+	}
+	return offset;
+}
+
+
+/*! Replaces the file by one with only the current entries. The names stay
+    in the old mapping, which remains valid after the file is replaced.
+*/
+status_t
+NodeIDStore::_Compact()
+{
+	BString tempPath(fPath);
+	tempPath << ".new";
+
+	const int fd = open(tempPath.String(), O_RDWR | O_CREAT | O_TRUNC
+		| O_APPEND, 0600);
+	if (fd < 0)
+		return errno;
+
+	Header header;
+	header.magic = kMagic;
+	header.version = kVersion;
+	status_t status = B_OK;
+	if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header))
+		status = B_IO_ERROR;
+
+	size_t recordCount = 0;
+	KeyByID::Iterator iterator = fKeys.GetIterator();
+	while (status == B_OK && iterator.HasNext()) {
+		const KeyByID::Entry entry = iterator.Next();
+		status = _WriteRecord(fd, entry.key.value, entry.value.directoryID,
+			entry.value.name);
+		recordCount++;
+	}
+
+	// The highest ID may belong to a removed entry, still it must not be
+	// handed out again
+	if (status == B_OK && !fKeys.ContainsKey(fNextID - 1)) {
+		status = _WriteRecord(fd, fNextID - 1, kInvalidNodeID, NULL);
+		recordCount++;
+	}
+
+	if (status == B_OK && fsync(fd) != 0)
+		status = errno;
+	if (status == B_OK && rename(tempPath.String(), fPath.String()) != 0)
+		status = errno;
+	if (status != B_OK) {
+		TRACE("can't compact %s: %s", fPath.String(), strerror(status));
+		close(fd);
+		unlink(tempPath.String());
+		return status;
+	}
+
+	TRACE("compacted %" B_PRIuSIZE " records to %" B_PRIuSIZE,
+		fRecordCount, recordCount);
+
+	close(fFD);
+	fFD = fd;
+	fRecordCount = recordCount;
+	return B_OK;
+}
+
+
+/*! Writes the record in one go, so that a crash leaves at most the last
+    record incomplete.
+*/
+/*static*/ status_t
+NodeIDStore::_WriteRecord(int fd, ino_t id, ino_t directoryID,
+	const char* name)
+{
+	const size_t nameLength = name != NULL ? strlen(name) + 1 : 0;
+
+	Record record;
+	record.id = id;
+	record.directoryID = directoryID;
+	record.nameLength = nameLength;
+
+	const size_t size = sizeof(record) + nameLength;
+	uint8* const buffer = static_cast<uint8*>(malloc(size));
+	if (buffer == NULL)
+		return B_NO_MEMORY;
+	memcpy(buffer, &record, sizeof(record));
+	if (nameLength > 0)
+		memcpy(buffer + sizeof(record), name, nameLength);
+
+	status_t status = B_OK;
+	if (write(fd, buffer, size) != (ssize_t)size)
+		status = errno != 0 ? errno : B_IO_ERROR;
+	free(buffer);
+	return status;
+}
+
+
+void
+NodeIDStore::_Append(ino_t id, ino_t directoryID, const char* name)
+{
+	const status_t status = _WriteRecord(fFD, id, directoryID, name);
+	if (status != B_OK) {
+		TRACE("can't append to %s: %s", fPath.String(), strerror(status));
+		return;
+	}
+	fRecordCount++;
+}
+
+
+void
+NodeIDStore::_Put(const EntryKey& key, ino_t id)
+{
+	_Forget(id);
+
+	// The entry may have belonged to another node before
+	const ino_t previousID = fIDs.Get(key);
+	if (previousID != kInvalidNodeID)
+		_Forget(previousID);
+
+	fIDs.Put(key, id);
+	fKeys.Put(id, key);
+}
+
+
+void
+NodeIDStore::_Forget(ino_t id)
+{
+	if (!fKeys.ContainsKey(id))
+		return;
+
+	const EntryKey key = fKeys.Get(id);
+	fIDs.Remove(key);
+	fKeys.Remove(id);
+
+	// Names in the mapping aren't in the set
+	NameSet::iterator name = fNames.find(const_cast<char*>(key.name));
+	if (name != fNames.end()) {
+		free(*name);
+		fNames.erase(name);
+	}
+}
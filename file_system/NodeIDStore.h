@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_NODE_ID_STORE_H
+#define SMBFS_NODE_ID_STORE_H
+
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <private/shared/HashMap.h>
+
+#include <set>
+
+#include "EntryKey.h"
+
+
+namespace Smb {
+
+
+/*! On-disk map of directory entries to node IDs, so entries keep their IDs
+    across mounts. Entries are keyed by the ID of their directory and their
+    name, which unlike the URL stays the same when a directory further up is
+    renamed.
+    The file is a log of records which is only appended to while mounted. It
+    is mapped and read when the store is first used, the names of the records
+    loaded stay in the mapping. If most of its records have been superseded,
+    it is rewritten with only the current ones at that point. Not thread
+    safe, the volume must be locked.
+*/
+class NodeIDStore {
+public:
+								NodeIDStore(const char* path);
+								~NodeIDStore();
+
+			ino_t				Lookup(ino_t directoryID, const char* name);
+			bool				GetEntry(ino_t id, ino_t* _directoryID,
+									BString* _name);
+			void				Add(ino_t directoryID, const char* name,
+									ino_t id);
+			void				Remove(ino_t id);
+			int64				NextID();
+
+private:
+	struct Header;
+	struct Record;
+
+	typedef HashMap<EntryKey, ino_t> IDByKey;
+		// keys refer to names in the mapping, or in fNames
+	typedef HashMap<HashKey64<ino_t>, EntryKey> KeyByID;
+	typedef std::set<char*> NameSet;
+
+	enum {
+		kMagic   = 0x534d4249,
+		kVersion = 1
+	};
+
+	enum {
+		kMinCompactRecords = 1024
+			// don't bother rewriting smaller logs
+	};
+
+private:
+			status_t			_Load();
+			size_t				_ReadRecords(const uint8* data,
+									size_t size);
+			status_t			_Compact();
+	static	status_t			_WriteRecord(int fd, ino_t id,
+									ino_t directoryID, const char* name);
+			void				_Append(ino_t id, ino_t directoryID,
+									const char* name);
+			void				_Put(const EntryKey& key, ino_t id);
+			void				_Forget(ino_t id);
+
+private:
+			BString				fPath;
+			status_t			fStatus;
+				// B_NO_INIT until loaded
+			int					fFD;
+			void*				fMapping;
+			size_t				fMappingSize;
+			int64				fNextID;
+			size_t				fRecordCount;
+				// in the file
+
+			IDByKey				fIDs;
+			KeyByID				fKeys;
+				// current entry of each ID
+			NameSet				fNames;
+				// of the current entries added since loading, the
+				// others are in the mapping
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_NODE_ID_STORE_H
@@ -0,0 +1,300 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "NodeTable.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "nodes/Node.h"
+
+
+using namespace Smb;
+
+
+// #pragma mark - NodeTable::Block
+
+
+/*! Slots hold the blocks of the next level, or the nodes in the last one.
+*/
+struct NodeTable::Block {
+	void*			slots[kBlockSlots];
+	uint32			used;
+		// slots which aren't NULL
+};
+
+
+// #pragma mark - NodeTable
+
+
+NodeTable::NodeTable()
+	:
+	fRoot(NULL),
+	fEpoch(0),
+	fReclaiming(false)
+{
+	fReaders[0] = 0;
+	fReaders[1] = 0;
+}
+
+
+NodeTable::~NodeTable()
+{
+	assert(fRetiredNodes[0].empty() && fRetiredNodes[1].empty());
+
+	for (int32 parity = 0; parity < 2; parity++) {
+		for (uint32 i = 0; i < fRetiredBlocks[parity].size(); i++)
+			free(fRetiredBlocks[parity][i]);
+	}
+
+	if (fRoot != NULL)
+		_FreeBlock(fRoot, kLevels - 1);
+}
+
+
+/*! Enters the current epoch, returns it for FinishReading(). Anything read
+    from the table stays valid until then.
+*/
+int32
+NodeTable::StartReading()
+{
+	for (;;) {
+		const int32 epoch = atomic_get(&fEpoch);
+		atomic_add(&fReaders[epoch & 1], 1);
+
+		// If the epoch moved on meanwhile, reclamation may not have seen
+		// us, try again in the new one
+		if (atomic_get(&fEpoch) == epoch)
+			return epoch;
+		atomic_add(&fReaders[epoch & 1], -1);
+	}
+}
+
+
+void
+NodeTable::FinishReading(int32 epoch)
+{
+	atomic_add(&fReaders[epoch & 1], -1);
+}
+
+
+/*! Needs no lock, but readers must be in an epoch (see StartReading()).
+*/
+Node*
+NodeTable::Get(ino_t id)
+{
+	if (!_IsValid(id))
+		return NULL;
+
+	Block* block = atomic_pointer_get(&fRoot);
+	for (int32 level = kLevels - 1; block != NULL && level > 0; level--) {
+		block = static_cast<Block*>(
+			atomic_pointer_get(&block->slots[_SlotIndex(id, level)]));
+	}
+	if (block == NULL)
+		return NULL;
+
+	return static_cast<Node*>(
+		atomic_pointer_get(&block->slots[_SlotIndex(id, 0)]));
+}
+
+
+/*! Volume must be locked
+*/
+status_t
+NodeTable::Put(ino_t id, Node* node)
+{
+	if (!_IsValid(id))
+		return B_BAD_VALUE;
+
+	if (fRoot == NULL) {
+		Block* const root = static_cast<Block*>(calloc(1, sizeof(Block)));
+		if (root == NULL)
+			return B_NO_MEMORY;
+		atomic_pointer_set(&fRoot, root);
+	}
+
+	Block* block = fRoot;
+	for (int32 level = kLevels - 1; level > 0; level--) {
+		void** const slot = &block->slots[_SlotIndex(id, level)];
+		Block* child = static_cast<Block*>(*slot);
+		if (child == NULL) {
+			child = static_cast<Block*>(calloc(1, sizeof(Block)));
+			if (child == NULL)
+				return B_NO_MEMORY;
+			// Readers must see the cleared block before the pointer to it,
+			// the atomic store orders that
+			atomic_pointer_set(slot, static_cast<void*>(child));
+			block->used++;
+		}
+		block = child;
+	}
+
+	void** const slot = &block->slots[_SlotIndex(id, 0)];
+	if (*slot == NULL)
+		block->used++;
+	atomic_pointer_set(slot, static_cast<void*>(node));
+	return B_OK;
+}
+
+
+/*! Blocks which become empty are freed, but only once no reader can see them
+    anymore. Volume must be locked.
+*/
+void
+NodeTable::Remove(ino_t id)
+{
+	if (!_IsValid(id) || fRoot == NULL)
+		return;
+
+	Block* path[kLevels];
+	Block* block = fRoot;
+	for (int32 level = kLevels - 1; level > 0; level--) {
+		path[level] = block;
+		block = static_cast<Block*>(block->slots[_SlotIndex(id, level)]);
+		if (block == NULL)
+			return;
+	}
+	path[0] = block;
+
+	void** const slot = &block->slots[_SlotIndex(id, 0)];
+	if (*slot == NULL)
+		return;
+	atomic_pointer_set(slot, (void*)NULL);
+	block->used--;
+
+	// The root stays
+	for (int32 level = 0; level < kLevels - 1 && path[level]->used == 0;
+			level++) {
+		Block* const parent = path[level + 1];
+		atomic_pointer_set(&parent->slots[_SlotIndex(id, level + 1)],
+			(void*)NULL);
+		parent->used--;
+		fRetiredBlocks[fEpoch & 1].push_back(path[level]);
+	}
+	_Reclaim();
+}
+
+
+/*! Deletes a node which was removed from the table, as soon as no reader
+    can still see it. Volume must be locked.
+*/
+void
+NodeTable::Retire(Node* node)
+{
+	fRetiredNodes[fEpoch & 1].push_back(node);
+	_Reclaim();
+}
+
+
+/*! Deletes all retired nodes right away, for when there can't be any readers
+    anymore. Volume must be locked.
+*/
+void
+NodeTable::DeleteRetired()
+{
+	fReclaiming = true;
+
+	// Deleting a node may retire its parent in turn
+	for (;;) {
+		NodeList nodes;
+		if (!fRetiredNodes[0].empty())
+			nodes.swap(fRetiredNodes[0]);
+		else if (!fRetiredNodes[1].empty())
+			nodes.swap(fRetiredNodes[1]);
+		else
+			break;
+
+		for (uint32 i = 0; i < nodes.size(); i++)
+			delete nodes[i];
+	}
+
+	fReclaiming = false;
+}
+
+
+/*! Appends all nodes in the table to the list, whatever their IDs are.
+    Volume must be locked.
+*/
+void
+NodeTable::GetNodes(std::vector<Node*>& nodes)
+{
+	if (fRoot != NULL)
+		_GetNodes(fRoot, kLevels - 1, nodes);
+}
+
+
+/*static*/ uint32
+NodeTable::_SlotIndex(ino_t id, int32 level)
+{
+	return (id >> (level * kBitsPerLevel)) & (kBlockSlots - 1);
+}
+
+
+/*static*/ bool
+NodeTable::_IsValid(ino_t id)
+{
+	return id >= 0 && (id >> (kLevels * kBitsPerLevel)) == 0;
+}
+
+
+/*static*/ void
+NodeTable::_FreeBlock(Block* block, int32 level)
+{
+	if (level > 0) {
+		for (int32 i = 0; i < kBlockSlots; i++) {
+			if (block->slots[i] != NULL)
+				_FreeBlock(static_cast<Block*>(block->slots[i]), level - 1);
+		}
+	}
+	free(block);
+}
+
+
+/*static*/ void
+NodeTable::_GetNodes(Block* block, int32 level, std::vector<Node*>& nodes)
+{
+	for (int32 i = 0; i < kBlockSlots; i++) {
+		if (block->slots[i] == NULL)
+			continue;
+		if (level > 0) {
+			_GetNodes(static_cast<Block*>(block->slots[i]), level - 1,
+				nodes);
+		} else
+			nodes.push_back(static_cast<Node*>(block->slots[i]));
+	}
+}
+
+
+/*! Whatever was removed in the previous epoch can be deleted once the
+    readers of that epoch are gone; readers of the current one started after
+    it was removed. Then the next epoch begins. Volume must be locked.
+*/
+void
+NodeTable::_Reclaim()
+{
+	if (fReclaiming)
+		return;
+
+	const int32 previous = (fEpoch - 1) & 1;
+	if (atomic_get(&fReaders[previous]) != 0)
+		return;
+
+	NodeList nodes;
+	nodes.swap(fRetiredNodes[previous]);
+	BlockList blocks;
+	blocks.swap(fRetiredBlocks[previous]);
+
+	// From here on, the lists of the previous epoch collect what is removed
+	// in the new one
+	atomic_add(&fEpoch, 1);
+
+	fReclaiming = true;
+	for (uint32 i = 0; i < nodes.size(); i++)
+		delete nodes[i];
+	for (uint32 i = 0; i < blocks.size(); i++)
+		free(blocks[i]);
+	fReclaiming = false;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_NODE_TABLE_H
+#define SMBFS_NODE_TABLE_H
+
+#include <SupportDefs.h>
+
+#include <vector>
+
+
+namespace Smb {
+
+
+class Node;
+
+
+/*! Maps node IDs to nodes. IDs are handed out sequentially, so instead of
+    hashing them, the table is a radix tree of fixed size blocks indexed by
+    the bits of the ID.
+    Get() doesn't take any lock. Readers enter the current epoch with
+    StartReading() instead, and nodes (and blocks) removed from the table are
+    only deleted once all readers which might still see them are gone. All
+    other methods must be called with the volume locked.
+*/
+class NodeTable {
+public:
+								NodeTable();
+								~NodeTable();
+
+			int32				StartReading();
+			void				FinishReading(int32 epoch);
+
+			Node*				Get(ino_t id);
+			status_t			Put(ino_t id, Node* node);
+			void				Remove(ino_t id);
+
+			void				Retire(Node* node);
+			void				DeleteRetired();
+
+			void				GetNodes(std::vector<Node*>& nodes);
+
+private:
+	struct Block;
+	typedef std::vector<Node*> NodeList;
+	typedef std::vector<Block*> BlockList;
+
+	enum {
+		kBitsPerLevel = 10,
+		kBlockSlots   = 1 << kBitsPerLevel,
+		kLevels       = 4
+			// IDs up to 2^40
+	};
+
+private:
+	static	uint32				_SlotIndex(ino_t id, int32 level);
+	static	bool				_IsValid(ino_t id);
+	static	void				_FreeBlock(Block* block, int32 level);
+	static	void				_GetNodes(Block* block, int32 level,
+									std::vector<Node*>& nodes);
+
+			void				_Reclaim();
+
+private:
+			Block*				fRoot;
+			int32				fEpoch;
+			int32				fReaders[2];
+				// by epoch parity
+			NodeList			fRetiredNodes[2];
+			BlockList			fRetiredBlocks[2];
+				// by parity of the epoch they were removed in
+			bool				fReclaiming;
+};
+
+
+/*! Keeps a NodeTable's epoch entered while in scope.
+*/
+class NodeTableReader {
+public:
+	NodeTableReader(NodeTable& table)
+		:
+		fTable(table),
+		fEpoch(table.StartReading())
+	{
+	}
+
+	~NodeTableReader()
+	{
+		fTable.FinishReading(fEpoch);
+	}
+
+private:
+			NodeTable&			fTable;
+			int32				fEpoch;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_NODE_TABLE_H
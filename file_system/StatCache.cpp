@@ -0,0 +1,226 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "StatCache.h"
+
+#include <private/shared/AutoLocker.h>
+
+#include <stdio.h>
+
+
+//#define TRACE_STAT_CACHE
+#ifdef TRACE_STAT_CACHE
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [StatCache %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+StatCache::StatCache()
+	:
+	fTimeToLive(kDefaultTimeToLive),
+	fGeneration(0),
+	fOldestGeneration(0),
+	fNextListing(1)
+{
+}
+
+
+StatCache::~StatCache()
+{
+	_Clear();
+}
+
+
+/*! A time to live of 0 disables the cache.
+*/
+void
+StatCache::SetTimeToLive(bigtime_t timeToLive)
+{
+	AutoLocker<BLocker> locker(fLock);
+	fTimeToLive = timeToLive;
+	if (fTimeToLive <= 0)
+		_Clear();
+}
+
+
+bool
+StatCache::Get(ino_t id, struct stat* destination)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	Entry* const entry = fEntries.Get(id);
+	if (entry == NULL)
+		return false;
+
+	if (_ExpirationTime(entry) <= system_time()) {
+		_Remove(entry);
+		return false;
+	}
+
+	fEntryList.Remove(entry);
+	fEntryList.Add(entry);
+
+	*destination = entry->fStat;
+	return true;
+}
+
+
+/*! When the entry expires, 0 if there is none.
+*/
+bigtime_t
+StatCache::ExpirationTime(ino_t id)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	Entry* const entry = fEntries.Get(id);
+	if (entry == NULL)
+		return 0;
+	return _ExpirationTime(entry);
+}
+
+
+/*! To be passed to Put() along with the stat data taken after this call.
+*/
+uint32
+StatCache::Generation()
+{
+	AutoLocker<BLocker> locker(fLock);
+	return fGeneration;
+}
+
+
+/*! Does nothing if the node was invalidated since \a generation was taken,
+    the stat data may be from before the change then. Pass the \a listing
+    the stat data came from, if any.
+*/
+void
+StatCache::Put(ino_t id, const struct stat& source, uint32 generation,
+	uint32 listing)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	if (fTimeToLive <= 0)
+		return;
+
+	uint32* invalidation;
+	if (generation < fOldestGeneration
+		|| (fInvalidations.Get(id, invalidation)
+			&& *invalidation > generation)) {
+		TRACE("%lld invalidated meanwhile", (long long)id);
+		return;
+	}
+
+	Entry* entry = fEntries.Get(id);
+	if (entry != NULL)
+		fEntryList.Remove(entry);
+	else {
+		if (fEntries.Size() >= kMaxEntries)
+			_Remove(fEntryList.Head());
+
+		entry = new(std::nothrow) Entry;
+		if (entry == NULL)
+			return;
+		entry->fID = id;
+		if (fEntries.Put(id, entry) != B_OK) {
+			delete entry;
+			return;
+		}
+	}
+
+	entry->fStat = source;
+	entry->fExpirationTime = system_time() + fTimeToLive;
+	entry->fListing = listing;
+	fEntryList.Add(entry);
+}
+
+
+void
+StatCache::Invalidate(ino_t id)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	Entry* const entry = fEntries.Get(id);
+	if (entry != NULL)
+		_Remove(entry);
+
+	fGeneration++;
+	if (fInvalidations.Size() >= kMaxInvalidations
+		&& !fInvalidations.ContainsKey(id)) {
+		fInvalidations.Clear();
+		fOldestGeneration = fGeneration;
+	}
+	fInvalidations.Put(id, fGeneration);
+}
+
+
+/*! Starts a directory listing, whose entries stay valid until a time to live
+    after the last RefreshListing().
+*/
+uint32
+StatCache::StartListing()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	// Forget the listings that are over
+	const bigtime_t now = system_time();
+	ListingMap::Iterator iterator = fListings.GetIterator();
+	while (iterator.HasNext()) {
+		if (iterator.Next().value <= now)
+			iterator.Remove();
+	}
+
+	uint32 listing = fNextListing++;
+	if (listing == 0)
+		listing = fNextListing++;
+	return listing;
+}
+
+
+/*! To be called whenever the next entries of the listing are read.
+*/
+void
+StatCache::RefreshListing(uint32 listing)
+{
+	AutoLocker<BLocker> locker(fLock);
+	if (fTimeToLive > 0)
+		fListings.Put(listing, system_time() + fTimeToLive);
+}
+
+
+bigtime_t
+StatCache::_ExpirationTime(Entry* entry)
+{
+	bigtime_t* listingValidUntil;
+	if (entry->fListing != 0
+		&& fListings.Get(entry->fListing, listingValidUntil)) {
+		return max_c(entry->fExpirationTime, *listingValidUntil);
+	}
+	return entry->fExpirationTime;
+}
+
+
+void
+StatCache::_Remove(Entry* entry)
+{
+	fEntries.Remove(entry->fID);
+	fEntryList.Remove(entry);
+	delete entry;
+}
+
+
+void
+StatCache::_Clear()
+{
+	fEntries.Clear();
+	fListings.Clear();
+	while (Entry* entry = fEntryList.RemoveHead())
+		delete entry;
+}
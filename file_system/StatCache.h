@@ -0,0 +1,95 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_STAT_CACHE_H
+#define SMBFS_STAT_CACHE_H
+
+#include <Locker.h>
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include <private/shared/DoublyLinkedList.h>
+#include <private/shared/HashMap.h>
+
+#include <sys/stat.h>
+
+
+namespace Smb {
+
+
+/*! Remembers stat data of share nodes for a limited time, so repeated
+    read_stat calls (e.g. Tracker browsing a folder) don't go to the server
+    each time. Local changes invalidate the affected entries. When it's
+    full, the least recently used entries make room.
+
+    A stat taken from the server may be outdated by an invalidation that
+    comes in while it's underway, so the caller gets the Generation() before
+    asking the server, and Put() drops the result if the node was
+    invalidated since.
+
+    Entries put while listing a directory stay valid as long as the listing
+    goes on, plus the time to live, since Tracker only gets to stat them
+    after reading all the entries of a large folder.
+*/
+class StatCache {
+public:
+								StatCache();
+								~StatCache();
+
+			void				SetTimeToLive(bigtime_t timeToLive);
+
+			bool				Get(ino_t id, struct stat* destination);
+			bigtime_t			ExpirationTime(ino_t id);
+			uint32				Generation();
+			void				Put(ino_t id, const struct stat& source,
+									uint32 generation, uint32 listing = 0);
+			void				Invalidate(ino_t id);
+
+			uint32				StartListing();
+			void				RefreshListing(uint32 listing);
+
+private:
+	struct Entry : DoublyLinkedListLinkImpl<Entry> {
+			ino_t				fID;
+			struct stat			fStat;
+			bigtime_t			fExpirationTime;
+			uint32				fListing;
+	};
+	typedef HashMap<HashKey64<ino_t>, Entry*> EntryMap;
+	typedef DoublyLinkedList<Entry> EntryList;
+	typedef HashMap<HashKey64<ino_t>, uint32> GenerationMap;
+	typedef HashMap<HashKey32<uint32>, bigtime_t> ListingMap;
+
+	enum {
+		kDefaultTimeToLive = 2 * 1000 * 1000,	// µsec
+		kMaxEntries        = 32 * 1024,
+			// a few folders with 10,000 files each
+		kMaxInvalidations  = 256
+			// recent invalidations we remember the generation of, puts
+			// started before the oldest of them are dropped
+	};
+
+private:
+			bigtime_t			_ExpirationTime(Entry* entry);
+			void				_Remove(Entry* entry);
+			void				_Clear();
+
+private:
+			BLocker				fLock;
+			EntryMap			fEntries;
+			EntryList			fEntryList;	// LRU first
+			bigtime_t			fTimeToLive;
+			uint32				fGeneration;
+			GenerationMap		fInvalidations;
+			uint32				fOldestGeneration;
+			ListingMap			fListings;	// listing -> valid until
+			uint32				fNextListing;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_STAT_CACHE_H
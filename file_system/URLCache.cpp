@@ -0,0 +1,116 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "URLCache.h"
+
+#include <private/shared/AutoLocker.h>
+
+#include <string.h>
+
+
+using namespace Smb;
+
+
+URLCache::URLCache()
+{
+}
+
+
+URLCache::~URLCache()
+{
+	while (Entry* entry = fEntryList.RemoveHead())
+		delete entry;
+}
+
+
+bool
+URLCache::Get(ino_t id, BString& url)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	Entry* const entry = fEntries.Get(id);
+	if (entry == NULL)
+		return false;
+
+	fEntryList.Remove(entry);
+	fEntryList.Add(entry);
+
+	url = entry->fURL;
+	return true;
+}
+
+
+/*! The URL must have been built with the volume locked, and it must still be
+    locked, so that no rename can come in between.
+*/
+void
+URLCache::Put(ino_t id, const BString& url)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	Entry* entry = fEntries.Get(id);
+	if (entry != NULL) {
+		entry->fURL = url;
+		fEntryList.Remove(entry);
+		fEntryList.Add(entry);
+		return;
+	}
+
+	if (fEntries.Size() >= kMaxEntries)
+		_Remove(fEntryList.Head());
+
+	entry = new(std::nothrow) Entry;
+	if (entry == NULL)
+		return;
+	entry->fID = id;
+	entry->fURL = url;
+	if (fEntries.Put(id, entry) != B_OK) {
+		delete entry;
+		return;
+	}
+	fEntryList.Add(entry);
+}
+
+
+void
+URLCache::Remove(ino_t id)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	Entry* const entry = fEntries.Get(id);
+	if (entry != NULL)
+		_Remove(entry);
+}
+
+
+/*! Removes the URL and all URLs below it, e.g. because the node with that
+    URL is renamed.
+*/
+void
+URLCache::RemoveTree(const BString& url)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	const int32 length = url.Length();
+	Entry* entry = fEntryList.Head();
+	while (entry != NULL) {
+		Entry* const next = fEntryList.GetNext(entry);
+		const char* const entryURL = entry->fURL.String();
+		if (strncmp(entryURL, url.String(), length) == 0
+			&& (entryURL[length] == '\0' || entryURL[length] == '/')) {
+			_Remove(entry);
+		}
+		entry = next;
+	}
+}
+
+
+void
+URLCache::_Remove(Entry* entry)
+{
+	fEntries.Remove(entry->fID);
+	fEntryList.Remove(entry);
+	delete entry;
+}
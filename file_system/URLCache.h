@@ -0,0 +1,59 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_URL_CACHE_H
+#define SMBFS_URL_CACHE_H
+
+#include <Locker.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <private/shared/DoublyLinkedList.h>
+#include <private/shared/HashMap.h>
+
+
+namespace Smb {
+
+
+/*! Remembers the URLs of the nodes which were used last, so building them
+    from the parent links, under the volume lock, is only needed for the
+    others. Renaming a directory only drops the URLs below it.
+*/
+class URLCache {
+public:
+								URLCache();
+								~URLCache();
+
+			bool				Get(ino_t id, BString& url);
+			void				Put(ino_t id, const BString& url);
+			void				Remove(ino_t id);
+			void				RemoveTree(const BString& url);
+
+private:
+	struct Entry : DoublyLinkedListLinkImpl<Entry> {
+			ino_t				fID;
+			BString				fURL;
+	};
+	typedef HashMap<HashKey64<ino_t>, Entry*> EntryMap;
+	typedef DoublyLinkedList<Entry> EntryList;
+
+	enum {
+		kMaxEntries = 512
+	};
+
+private:
+			void				_Remove(Entry* entry);
+
+private:
+			BLocker				fLock;
+			EntryMap			fEntries;
+			EntryList			fEntryList;	// LRU first
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_URL_CACHE_H
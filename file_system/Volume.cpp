@@ -8,18 +8,30 @@
 #include <Application.h>
 #include <fs_interface.h>
 #include <kernel/OS.h>
+#include <MessageRunner.h>
 #include <private/shared/AutoLocker.h>
 #include <Roster.h>
+#include <driver_settings.h>
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
+
+#include "Backend.h"
+#include "CountingBackend.h"
 #include "nodes/DiscoveryNode.h"
 #include "nodes/Node.h"
 #include "nodes/ShareDirectoryNode.h"
 #include "nodes/ShareFileNode.h"
+#include "NodeIDStore.h"
 #include "Protocol.h"
+#include "ResourceBatch.h"
 #include "SambaContext.h"
+#include "SambaContextPool.h"
+#include "SimulatedNetworkBackend.h"
 
 
 //#define TRACE_VOLUME
@@ -35,23 +47,81 @@
 using namespace Smb;
 
 
-Volume::Volume(const char*, uint32, fs_volume* vfsVolume)
+static const char* const kVFSOperationNames[] = {
+	"other",
+	"read_fs_info",
+	"lookup",
+	"get_vnode",
+	"read_stat",
+	"write_stat",
+	"open",
+	"close",
+	"fsync",
+	"rename",
+	"unlink",
+	"read",
+	"write",
+	"io",
+	"create",
+	"open_dir",
+	"close_dir",
+	"read_dir",
+	"rewind_dir",
+	"create_dir",
+	"remove_dir"
+};
+
+
+Volume::Volume(const char* args, uint32, fs_volume* vfsVolume)
 	:
 	fStatus(B_NO_INIT),
-	fSambaContext(new(std::nothrow) SambaContext),
+	fCallCounts(NULL),
+	fBackend(_CreateBackend(args, &fCallCounts)),
+	fSambaContextPool(new(std::nothrow) SambaContextPool(fBackend)),
 	fVFSVolume(vfsVolume),
 	fReadOnly(false),
 	fLastScanTime(0),
-	fNetworkNode(new(std::nothrow) DiscoveryNode(this, fSambaContext)),
+	fBufferMemoryUsed(0),
+	fMissingEntries(vfsVolume->id),
+	fAsyncIO(this),
+	fNetworkNode(new(std::nothrow) DiscoveryNode(this, fSambaContextPool)),
 	fNextNodeID(fNetworkNode->ID() + 1),
-	fAssistantMessenger(NULL)
+	fNodeIDStore(NULL),
+	fUnusedNodeCount(0),
+	fDroppedEvictions(0),
+	fBackendListsShares(false),
+	fAssistantMessenger(NULL),
+	fExpiryRunner(NULL)
 {
+	_ParseArgs(args);
 	_InitFsInfo();
 	_RegisterAsMessageHandler();
-	fStatus = _LaunchAssistant();
+
+	// Missing entries are served by the VFS entry cache, which doesn't
+	// expire them by itself. Without the runner they just stay longer.
+	BMessage expireMessage(kMsgRemoveExpiredEntries);
+	fExpiryRunner = new(std::nothrow) BMessageRunner(BMessenger(this),
+		&expireMessage, kExpiryInterval);
 
 	AutoLocker<BLocker> locker(fLock);
 	MemorizeNode(fNetworkNode);
+	locker.Unlock();
+
+	if (fBackend == NULL) {
+		fStatus = B_BAD_VALUE;
+		return;
+	}
+
+	// The shares are there right after mounting, unless they are on the
+	// network
+	_CreateShares(args);
+	fStatus = _ScanBackend(false);
+	if (fStatus == B_NOT_SUPPORTED)
+		fStatus = _LaunchAssistant();
+	else {
+		fBackendListsShares = true;
+		fStatus = B_OK;
+	}
 }
 
 
@@ -59,6 +129,8 @@ Volume::~Volume()
 {
 	AutoLocker<BLocker> locker(fLock);
 
+	delete fExpiryRunner;
+
 	be_app->Lock();
 	be_app->RemoveHandler(this);
 	be_app->Unlock();
@@ -66,17 +138,51 @@ Volume::~Volume()
 	if (fAssistantMessenger != NULL)
 		fAssistantMessenger->SendMessage(kMsgQuit);
 
-	delete fSambaContext;
 	delete fAssistantMessenger;
 
-	NodeByURL::Iterator iterator = fNodeURLMemory.GetIterator();
-	while (iterator.HasNext()) {
-		Node* node = *(iterator.NextValue());
-		if (node->Type() == kShareDirectory)
-			delete node;
+	// The workers use the volume
+	fAsyncIO.Stop();
+
+	// The VFS has put all nodes, nobody reads the node table anymore
+	fNodeTable.DeleteRetired();
+
+	// Cut the parent links first, so the nodes left can be deleted in any
+	// order. IDs from the node ID map may lie anywhere, so walk the table
+	// rather than an ID range.
+	std::vector<Node*> nodes;
+	fNodeTable.GetNodes(nodes);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		Node* const node = nodes[i];
+		node->fParent = NULL;
+		if (!node->fUnused) {
+			node->fUnused = true;
+			fUnusedNodes.Add(node);
+		}
+	}
+	for (int32 i = 0; i < (1 << kEntryShardBits); i++)
+		fNodeEntryMemory[i].nodes.Clear();
+	fDiscoveryNodes.Clear();
+
+	while (Node* node = fUnusedNodes.RemoveHead())
+		delete node;
+
+	EvictedNodeByID::Iterator evictedIterator = fEvictedNodes.GetIterator();
+	while (evictedIterator.HasNext())
+		delete *(evictedIterator.NextValue());
+	fEvictedNodes.Clear();
+	fEvictedNodeEntries.Clear();
+
+	if (fDroppedEvictions > 0) {
+		fprintf(stderr, "SMB-FS: %" B_PRId64 " evicted node IDs were dropped\n",
+			fDroppedEvictions);
 	}
-	fNodeIDMemory.Clear();
-	fNodeURLMemory.Clear();
+
+	delete fNodeIDStore;
+	delete fSambaContextPool;
+
+	if (fCallCounts != NULL)
+		_ReportCalls();
+	delete fBackend;
 }
 
 
@@ -104,6 +210,22 @@ Volume::VFSVolume() const
 }
 
 
+SambaContextPool*
+Volume::SambaContexts() const
+{
+	return fSambaContextPool;
+}
+
+
+/*! NULL unless the backend calls are counted.
+*/
+CountingBackend*
+Volume::CallCounts() const
+{
+	return fCallCounts;
+}
+
+
 // #pragma mark - File system
 
 
@@ -117,6 +239,13 @@ Volume::NetworkScan()
 		return;
 	}
 
+	if (fBackendListsShares) {
+		// Scanned by our own looper, the caller may hold the locks of
+		// discovery nodes
+		BMessenger(this).SendMessage(kMsgScan);
+		return;
+	}
+
 	fAssistantMessenger->SendMessage(kMsgScan);
 }
 
@@ -132,97 +261,439 @@ status_t
 Volume::FsInfo(struct fs_info* info)
 {
 	*info = fFsInfo;
+
+	// There is only one fs_info for all shares, the largest size is the
+	// one that lets none of them down
+	info->io_size = fIOSizes.LargestIOSize();
 	return B_OK;
 }
 
 
+IOSizeTuner*
+Volume::IOSizes()
+{
+	return &fIOSizes;
+}
+
+
+StatCache*
+Volume::Stats()
+{
+	return &fStatCache;
+}
+
+
+URLCache*
+Volume::URLs()
+{
+	return &fURLCache;
+}
+
+
+MissingEntryCache*
+Volume::MissingEntries()
+{
+	return &fMissingEntries;
+}
+
+
+AsyncIO*
+Volume::IO()
+{
+	return &fAsyncIO;
+}
+
+
+// #pragma mark - Buffer memory
+
+
+/*! Accounts for size bytes of file data buffered by this volume. Returns false
+    if that would exceed the volume's buffer memory budget.
+*/
+bool
+Volume::ReserveBufferMemory(size_t size)
+{
+	if (atomic_add64(&fBufferMemoryUsed, size) + (int64)size
+			> kBufferMemoryLimit) {
+		atomic_add64(&fBufferMemoryUsed, -(int64)size);
+		return false;
+	}
+	return true;
+}
+
+
+void
+Volume::UnreserveBufferMemory(size_t size)
+{
+	atomic_add64(&fBufferMemoryUsed, -(int64)size);
+}
+
+
 // #pragma mark - Nodes
 
 
-/*! Volume must be locked
+/*! Needs no lock, IDs are handed out by an atomic counter.
 */
 ino_t
 Volume::MakeFreshNodeID()
 {
-	assert(fLock.IsLocked());
-	ino_t id = fNextNodeID++;
+	ino_t id = atomic_add64(&fNextNodeID, 1);
 	if (id < 0)
 		debugger("woah, you overflowed an int64");
 	return id;
 }
 
 
-/*! Volume must be locked
+/*! ID for a new node of the given directory entry. With a node ID map, an
+    entry gets the ID it had in earlier mounts. Volume must be locked.
+*/
+ino_t
+Volume::MakeNodeID(Node* directory, const char* name)
+{
+	assert(fLock.IsLocked());
+
+	if (fNodeIDStore == NULL)
+		return MakeFreshNodeID();
+
+	// Skip the IDs of earlier mounts, also before handing out one of them,
+	// so fresh IDs never collide with stored ones. All IDs are made with the
+	// volume locked, so this can't race with MakeFreshNodeID().
+	const int64 nextID = fNodeIDStore->NextID();
+	if (atomic_get64(&fNextNodeID) < nextID)
+		atomic_set64(&fNextNodeID, nextID);
+
+	ino_t id = fNodeIDStore->Lookup(directory->ID(), name);
+	if (id != kInvalidNodeID && fNodeTable.Get(id) == NULL
+		&& !fEvictedNodes.ContainsKey(id)) {
+		return id;
+	}
+
+	id = MakeFreshNodeID();
+	fNodeIDStore->Add(directory->ID(), name, id);
+	return id;
+}
+
+
+/*! Nodes which are marked evictable may be deleted by the volume while the
+    VFS doesn't hold them, they must be entries of a directory. Volume must be
+    locked.
 */
 void
-Volume::MemorizeNode(Node* node)
+Volume::MemorizeNode(Node* node, bool evictable)
 {
-	TRACE("memorize node, URL=%s ID=0x%" B_PRIx64, node->URL().String(),
+	TRACE("memorize node, name=%s ID=0x%" B_PRIx64, node->Name(),
 		node->ID());
 
 	assert(fLock.IsLocked());
-	assert(RecallNode(node->URL()) == NULL);
-		// node must not be known yet
 	assert(node->ID() != kInvalidNodeID);
 		// node must already have an ID
+	assert(node->fParent != NULL || !evictable);
+
+	fNodeTable.Put(node->ID(), node);
+	if (node->fParent != NULL) {
+		assert(RecallNode(node->fParent, node->Name()) == NULL);
+			// entry must not be known yet
+		_PutEntryNode(EntryKey(node->fParent->ID(), node->Name()), node);
+	}
+
+	switch (node->Type()) {
+		case kNetwork:
+		case kWorkgroup:
+		case kServer:
+			fDiscoveryNodes.Put(node->URL().String(), node);
+			break;
+
+		default:
+			break;
+	}
 
-	fNodeIDMemory.Put(node->ID(), node);
-	fNodeURLMemory.Put(node->URL().String(), node);
+	node->fEvictable = evictable;
+	_UpdateUnusedNode(node);
 }
 
 
 /*! Volume must be locked
 */
 Node*
-Volume::RecallNode(const BString& url)
+Volume::RecallNode(Node* directory, const char* name)
 {
 	assert(fLock.IsLocked());
-	return fNodeURLMemory.Get(url.String());
+
+	// Only writers change the map, and they hold the volume lock as well
+	const EntryKey key(directory->ID(), name);
+	return _EntryShardFor(key).nodes.Get(key);
 }
 
 
 /*! Volume must be locked
 */
-Node*
-Volume::ForgetNode(const BString& url)
+void
+Volume::ForgetNode(Node* node)
 {
-	TRACE("forget node URL=%s", url.String());
+	TRACE("forget node name=%s ID=0x%" B_PRIx64, node->Name(), node->ID());
 
 	assert(fLock.IsLocked());
 
-	Node* const node = fNodeURLMemory.Remove(url.String());
-	if (node == NULL)
-		return NULL;
-	fNodeIDMemory.Remove(node->ID());
-	return node;
+	if (fNodeTable.Get(node->ID()) != node)
+		return;
+			// not memorized (anymore)
+
+	fNodeTable.Remove(node->ID());
+	if (node->fParent != NULL)
+		_RemoveEntryNode(EntryKey(node->fParent->ID(), node->Name()));
+	if (node->Type() == kWorkgroup || node->Type() == kServer)
+		fDiscoveryNodes.Remove(node->URL().String());
+	fStatCache.Invalidate(node->ID());
+	fURLCache.Remove(node->ID());
+
+	node->fEvictable = false;
+	_UpdateUnusedNode(node);
 }
 
 
+/*! Forgets a node whose entry is gone. The node is deleted right away,
+    unless the VFS holds it. Volume must be locked.
+*/
+void
+Volume::RemoveNode(Node* node)
+{
+	ForgetNode(node);
+	if (fNodeIDStore != NULL)
+		fNodeIDStore->Remove(node->ID());
+
+	// GetVNode() may still have found the node in the table, whoever changes
+	// the state first wins
+	if (atomic_test_and_set(&node->fReferenceState, Node::kDead,
+			Node::kUnreferenced) == Node::kUnreferenced) {
+		_RetireNode(node);
+	} else {
+		// Node::Delete() is called once the VFS is done with it
+		remove_vnode(fVFSVolume, node->ID());
+	}
+}
+
+
+/*! Deletes a forgotten node the VFS is done with. The VFS doesn't get a node
+    again while putting it, so there's no race with GetVNode() here. Volume
+    must be locked.
+*/
+void
+Volume::DeleteNode(Node* node)
+{
+	assert(fLock.IsLocked());
+
+	atomic_set(&node->fReferenceState, Node::kDead);
+	_RetireNode(node);
+}
+
+
+/*! A node's entry was renamed, the node keeps its ID. Renaming a directory
+    thereby moves all nodes below it along, as their URLs are built from the
+    parent links, only their cached URLs are outdated.
+    Volume must be locked.
+*/
+void
+Volume::MoveNode(Node* node, Node* toDirectory, const char* toName)
+{
+	assert(fLock.IsLocked());
+
+	Node* const fromDirectory = node->fParent;
+	const bool memorized = fNodeTable.Get(node->ID()) == node;
+	if (memorized)
+		_RemoveEntryNode(EntryKey(fromDirectory->ID(), node->Name()));
+
+	fURLCache.RemoveTree(node->_BuildURL(NULL));
+	node->fParent = toDirectory;
+	node->fName = toName;
+	_AddChildNode(toDirectory);
+	if (memorized)
+		_PutEntryNode(EntryKey(toDirectory->ID(), node->Name()), node);
+	if (fNodeIDStore != NULL)
+		fNodeIDStore->Add(toDirectory->ID(), toName, node->ID());
+
+	// Last, the old directory may get evicted or deleted now
+	_RemoveChildNode(fromDirectory);
+}
+
+
+/*! A new node was created as an entry of its parent. Volume must be locked.
+*/
+void
+Volume::AttachNode(Node* node)
+{
+	assert(fLock.IsLocked());
+	_AddChildNode(node->fParent);
+}
+
+
+/*! A node is going away, its parent might be evicted or deleted now. Volume
+    must be locked.
+*/
+void
+Volume::DetachNode(Node* node)
+{
+	assert(fLock.IsLocked());
+	_RemoveChildNode(node->fParent);
+}
+
+
+/*! The VFS got the node, it must not be evicted until released again.
+    Returns false if it was referenced already. Volume must be locked.
+*/
+bool
+Volume::ReferenceNode(Node* node)
+{
+	assert(fLock.IsLocked());
+
+	if (atomic_test_and_set(&node->fReferenceState, Node::kReferenced,
+			Node::kUnreferenced) != Node::kUnreferenced) {
+		return false;
+	}
+
+	_UpdateUnusedNode(node);
+	return true;
+}
+
+
+/*! The VFS is done with an evictable node. Volume must be locked.
+*/
+void
+Volume::ReleaseNode(Node* node)
+{
+	assert(fLock.IsLocked());
+	assert(node->fEvictable);
+
+	if (atomic_get(&node->fReferenceState) != Node::kReferenced)
+		return;
+
+	atomic_set(&node->fReferenceState, Node::kUnreferenced);
+	if (node->fUnused) {
+		// Referenced by GetVNode() without the lock, so it was left in the
+		// list. It is the most recently used now.
+		fUnusedNodes.Remove(node);
+		fUnusedNodes.Add(node);
+	}
+	_UpdateUnusedNode(node);
+}
+
+
+/*! Returns the ID an evicted node of the given directory entry had, and
+    forgets about the eviction. Returns kInvalidNodeID if there is none.
+    Volume must be locked.
+*/
+ino_t
+Volume::TakeEvictedNodeID(ino_t directoryID, const char* name)
+{
+	assert(fLock.IsLocked());
+
+	EvictedNode* const evicted
+		= fEvictedNodeEntries.Get(EntryKey(directoryID, name));
+	if (evicted == NULL)
+		return kInvalidNodeID;
+
+	const ino_t id = evicted->id;
+	_ForgetEvictedNode(id);
+	return id;
+}
+
+
+/*! An evicted node's entry was renamed, it keeps its ID, which is returned.
+    Returns kInvalidNodeID if the entry had no evicted node. Volume must be
+    locked.
+*/
+ino_t
+Volume::MoveEvictedNode(ino_t fromDirectoryID, const char* fromName,
+	ino_t toDirectoryID, const char* toName)
+{
+	assert(fLock.IsLocked());
+
+	EvictedNode* const evicted
+		= fEvictedNodeEntries.Get(EntryKey(fromDirectoryID, fromName));
+	if (evicted == NULL)
+		return kInvalidNodeID;
+
+	fEvictedNodeEntries.Remove(evicted->Entry());
+	TakeEvictedNodeID(toDirectoryID, toName);
+		// in case it replaced another evicted node
+
+	const ino_t id = evicted->id;
+	evicted->directoryID = toDirectoryID;
+	evicted->name = toName;
+	if (fNodeIDStore != NULL)
+		fNodeIDStore->Add(toDirectoryID, toName, id);
+	if (fEvictedNodeEntries.Put(evicted->Entry(), evicted) != B_OK) {
+		fEvictedNodes.Remove(id);
+		delete evicted;
+	}
+	return id;
+}
+
+
+/*! Resolves one component of a path. Entries whose nodes the volume knows
+    take a single probe of the entry map, only unknown entries go to the
+    directory (and the server). That probe only read locks one shard of the
+    map, so lookups don't wait for each other.
+*/
 status_t
 Volume::Lookup(Node* directory, const char* name, ino_t* outNodeID)
 {
-	BString url(directory->URL());
-	url << "/" << name;
+	if (strcmp(name, ".") == 0) {
+		*outNodeID = directory->ID();
+		return B_OK;
+	}
 
-	AutoLocker<BLocker> locker(fLock);
-	Node* const node = fNodeURLMemory.Get(url.String());
+	if (strcmp(name, "..") == 0) {
+		// The root is its own parent. Parent links change on renames.
+		AutoLocker<BLocker> locker(fLock);
+		*outNodeID = directory->fParent != NULL
+			? directory->fParent->ID() : directory->ID();
+		return B_OK;
+	}
+
+	const EntryKey key(directory->ID(), name);
+	EntryShard& shard = _EntryShardFor(key);
+	EntryShardReadLocker shardLocker(shard);
+	Node* const node = shard.nodes.Get(key);
 	if (node != NULL) {
+		// A node is taken out of the map before it goes away
 		*outNodeID = node->ID();
 		return B_OK;
 	}
-	locker.Unlock();
+	shardLocker.Unlock();
 
 	return directory->Lookup(name, outNodeID);
 }
 
 
+/*! Nodes the volume knows are referenced without locking it. The lock is only
+    taken for nodes which have to be brought back, or are about to be
+    deleted.
+*/
 status_t
 Volume::GetVNode(ino_t id, void** outNode)
 {
+	{
+		NodeTableReader reader(fNodeTable);
+		Node* const node = fNodeTable.Get(id);
+		if (node != NULL && atomic_test_and_set(&node->fReferenceState,
+				Node::kReferenced, Node::kUnreferenced) != Node::kDead) {
+			// If it's in the unused list, it's just skipped when its turn
+			// to be evicted comes
+			*outNode = (void*)node;
+			return B_OK;
+		}
+	}
+
 	AutoLocker<BLocker> locker(fLock);
-	Node* const node = fNodeIDMemory.Get(id);
-	if (node == NULL)
-		return B_ENTRY_NOT_FOUND;
+	Node* node = fNodeTable.Get(id);
+	if (node == NULL) {
+		// Maybe evicted, e.g. an application kept a node_ref for a long time
+		node = _ResurrectNode(id);
+		if (node == NULL)
+			return B_ENTRY_NOT_FOUND;
+	}
+
+	ReferenceNode(node);
 
 	*outNode = (void*)node;
 	return B_OK;
@@ -243,6 +714,14 @@ void
 Volume::MessageReceived(BMessage* message)
 {
 	switch (message->what) {
+		case kMsgScan:
+			_ScanBackend(true);
+			break;
+
+		case kMsgRemoveExpiredEntries:
+			fMissingEntries.RemoveExpired();
+			break;
+
 		case kMsgScanFinished:
 			TRACE("scan finished");
 			fLastScanTime = system_time();
@@ -267,7 +746,14 @@ Volume::MessageReceived(BMessage* message)
 			status = message->FindString("comment", &comment);
 			if (status != B_OK)
 				return;
-			_FoundResource(static_cast<NodeType>(type), dirURL, name, comment);
+
+			EntryNotificationList notifications;
+			AutoLocker<BLocker> locker(fLock);
+			_FoundResource(static_cast<NodeType>(type), dirURL, name, comment,
+				notifications);
+			locker.Unlock();
+
+			_SendNotifications(notifications);
 			break;
 		}
 
@@ -282,10 +768,21 @@ Volume::MessageReceived(BMessage* message)
 			status = message->FindString("name", &name);
 			if (status != B_OK)
 				return;
-			_LostResource(dirURL, name);
+
+			EntryNotificationList notifications;
+			AutoLocker<BLocker> locker(fLock);
+			_LostResource(dirURL, name, notifications);
+			locker.Unlock();
+
+			_SendNotifications(notifications);
 			break;
 		}
 
+		case kMsgResourceBatch:
+			TRACE("resource batch");
+			_ApplyResourceBatch(message);
+			break;
+
 		default:
 			BHandler::MessageReceived(message);
 			break;
@@ -296,14 +793,143 @@ Volume::MessageReceived(BMessage* message)
 // #pragma mark - Internal
 
 
+/*! Picks the backend from the mount parameters: "backend memory" keeps the
+    shares in memory, "backend local" together with "backend_root <dir>" in a
+    local directory. Without them, the SMB network is used. Returns NULL for
+    an unknown backend.
+    Network conditions to simulate in front of the backend (see
+    SimulatedNetworkBackend::Conditions) can be given in a settings file with
+    "sim_settings <file>", and in the mount parameters, which win.
+    With "count_calls", the calls are counted per file system operation (see
+    CountingBackend), and reported on unmount.
+*/
+/*static*/ Backend*
+Volume::_CreateBackend(const char* args, CountingBackend** _callCounts)
+{
+	void* const settings = args != NULL
+		? parse_driver_settings_string(args) : NULL;
+
+	Backend* backend = Backend::Create(
+		get_driver_parameter(settings, "backend", NULL, NULL),
+		get_driver_parameter(settings, "backend_root", NULL, NULL));
+
+	SimulatedNetworkBackend::Conditions conditions;
+	bool simulate = false;
+
+	const char* path = get_driver_parameter(settings, "sim_settings", NULL,
+		NULL);
+	if (path != NULL) {
+		void* const fileSettings = load_driver_settings(path);
+		simulate = conditions.Parse(fileSettings);
+		unload_driver_settings(fileSettings);
+	}
+	simulate = conditions.Parse(settings) || simulate;
+
+	if (backend != NULL && simulate) {
+		Backend* const simulatedBackend
+			= new(std::nothrow) SimulatedNetworkBackend(backend, conditions);
+		if (simulatedBackend == NULL)
+			delete backend;
+		backend = simulatedBackend;
+	}
+
+	if (backend != NULL && get_driver_boolean_parameter(settings,
+			"count_calls", false, true)) {
+		CountingBackend* countingBackend = new(std::nothrow) CountingBackend(
+			backend, kVFSOperationNames, kVFSOperationCount);
+		if (countingBackend == NULL)
+			delete backend;
+		else if (countingBackend->InitCheck() != B_OK) {
+			delete countingBackend;
+			countingBackend = NULL;
+		} else
+			countingBackend->SetBudgets(settings);
+		backend = countingBackend;
+		*_callCounts = countingBackend;
+	}
+
+	unload_driver_settings(settings);
+	return backend;
+}
+
+
+/*! Writes the counted calls to the report file, or to stderr. A benchmark
+    tells from the last line whether they were within budget.
+*/
+void
+Volume::_ReportCalls()
+{
+	FILE* output = stderr;
+	if (fCallReportPath.Length() > 0) {
+		output = fopen(fCallReportPath.String(), "w");
+		if (output == NULL) {
+			fprintf(stderr, "SMB-FS: can't write call report to %s\n",
+				fCallReportPath.String());
+			output = stderr;
+		}
+	}
+
+	if (output == stderr)
+		fprintf(stderr, "SMB-FS: calls per file system operation\n");
+	if (!fCallCounts->Report(output))
+		fprintf(stderr, "SMB-FS: calls over budget\n");
+
+	if (output != stderr)
+		fclose(output);
+}
+
+
+/*! Mount parameters are given in driver settings syntax, e.g.
+    "stat_cache_ttl 1000".
+*/
+void
+Volume::_ParseArgs(const char* args)
+{
+	if (args == NULL)
+		return;
+
+	void* const settings = parse_driver_settings_string(args);
+	if (settings == NULL)
+		return;
+
+	const char* value = get_driver_parameter(settings, "stat_cache_ttl", NULL,
+		NULL);
+	if (value != NULL) {
+		// In milliseconds, 0 turns the cache off
+		fStatCache.SetTimeToLive(strtoll(value, NULL, 10) * 1000);
+	}
+
+	value = get_driver_parameter(settings, "node_id_map", NULL, NULL);
+	if (value != NULL) {
+		// File to keep the node IDs in across mounts
+		fNodeIDStore = new(std::nothrow) NodeIDStore(value);
+	}
+
+	value = get_driver_parameter(settings, "call_report", NULL, NULL);
+	if (value != NULL) {
+		// File the counted calls go to on unmount, instead of stderr
+		fCallReportPath = value;
+	}
+
+	value = get_driver_parameter(settings, "stripe_width", NULL, NULL);
+	if (value != NULL) {
+		// Connections per server a large transfer is spread over, 1 turns
+		// striping off
+		fAsyncIO.SetStripeWidth(strtol(value, NULL, 10));
+	}
+
+	unload_driver_settings(settings);
+}
+
+
 void
 Volume::_InitFsInfo()
 {
 	memset(&fFsInfo, 0, sizeof(fFsInfo));
 
 	fFsInfo.block_size = 4096;
-	fFsInfo.io_size = 128 * 1024;
-		// Empirically determined to yield good performance
+	fFsInfo.io_size = IOSizeTuner::kDefaultIOSize;
+		// FsInfo() reports what the shares are tuned to
 
 	fFsInfo.total_blocks = (100ULL * 1024 * 1024 * 1024) / fFsInfo.block_size;
 	fFsInfo.free_blocks = fFsInfo.total_blocks;
@@ -347,15 +973,155 @@ Volume::_LaunchAssistant()
 }
 
 
+/*! Makes sure the shares given in the mount parameters, as "shares
+    <server>/<share> ...", exist. Backends which aren't the network make up
+    servers and shares when first used, this is how a new one gets them.
+*/
+void
+Volume::_CreateShares(const char* args)
+{
+	if (args == NULL)
+		return;
+
+	void* const handle = parse_driver_settings_string(args);
+	const driver_settings* const settings = get_driver_settings(handle);
+	if (settings == NULL) {
+		unload_driver_settings(handle);
+		return;
+	}
+
+	for (int32 i = 0; i < settings->parameter_count; i++) {
+		const driver_parameter& parameter = settings->parameters[i];
+		if (strcmp(parameter.name, "shares") != 0)
+			continue;
+
+		for (int32 j = 0; j < parameter.value_count; j++) {
+			BString url("smb://");
+			url << parameter.values[j];
+
+			SambaContextLease context(fSambaContextPool, url);
+			if (context.InitCheck() != B_OK)
+				continue;
+
+			SMBCFILE* dir;
+			if (context->OpenDir(url, &dir) != B_OK) {
+				TRACE("can't create share %s", url.String());
+				continue;
+			}
+			context->CloseDir(dir);
+		}
+	}
+
+	unload_driver_settings(handle);
+}
+
+
+/*! Discovers the servers and shares of a backend which has its own, rather
+    than those of the network. There are no workgroups, the servers are
+    right in the network node. Returns B_NOT_SUPPORTED for the network,
+    which the assistant scans. Entry notifications are only sent if asked
+    to, the volume isn't published while mounting.
+*/
+status_t
+Volume::_ScanBackend(bool notify)
+{
+	Backend::NameList servers;
+	status_t status = fBackend->GetServers(servers);
+	if (status != B_OK)
+		return status;
+
+	std::vector<Backend::NameList> shares(servers.size());
+	for (size_t i = 0; i < servers.size(); i++) {
+		// A server whose shares can't be listed has none
+		fBackend->GetShares(servers[i].String(), shares[i]);
+	}
+
+	EntryNotificationList notifications;
+	AutoLocker<BLocker> locker(fLock);
+	fLastScanTime = system_time();
+
+	_UpdateResources(fNetworkNode->URL(), kServer, servers, notifications);
+	for (size_t i = 0; i < servers.size(); i++) {
+		_UpdateResources(fNetworkNode->EntryURL(servers[i].String()), kShare,
+			shares[i], notifications);
+	}
+
+	locker.Unlock();
+
+	if (notify)
+		_SendNotifications(notifications);
+	return B_OK;
+}
+
+
+/*! Makes the entries of the discovery directory those with the given names,
+    all of them of the type. Volume must be locked.
+*/
+void
+Volume::_UpdateResources(const BString& dirURL, NodeType type,
+	std::vector<BString>& names, EntryNotificationList& notifications)
+{
+	DiscoveryNode* const directory = dynamic_cast<DiscoveryNode*>(
+		fDiscoveryNodes.Get(dirURL.String()));
+	if (directory == NULL)
+		return;
+
+	std::vector<BString> known;
+	directory->GetEntryNames(known);
+	std::sort(known.begin(), known.end());
+	std::sort(names.begin(), names.end());
+
+	for (size_t i = 0; i < known.size(); i++) {
+		if (!std::binary_search(names.begin(), names.end(), known[i]))
+			_LostResource(dirURL, known[i], notifications);
+	}
+	for (size_t i = 0; i < names.size(); i++) {
+		if (!std::binary_search(known.begin(), known.end(), names[i]))
+			_FoundResource(type, dirURL, names[i], "", notifications);
+	}
+}
+
+
+/*! Applies all found and lost resources of a kMsgResourceBatch message with
+    one volume lock, and sends the entry notifications afterwards. Entries
+    which came and went again within the batch aren't notified at all.
+*/
+void
+Volume::_ApplyResourceBatch(const BMessage* message)
+{
+	ResourceBatch batch;
+	if (batch.SetTo(*message) != B_OK)
+		return;
+
+	EntryNotificationList notifications;
+	AutoLocker<BLocker> locker(fLock);
+
+	ResourceBatch::Record record;
+	while (batch.GetNextRecord(record)) {
+		if (record.found) {
+			_FoundResource(record.type, record.directoryURL, record.name,
+				record.comment, notifications);
+		} else
+			_LostResource(record.directoryURL, record.name, notifications);
+	}
+
+	locker.Unlock();
+
+	_SendNotifications(notifications);
+}
+
+
+/*! Volume must be locked
+*/
 void
 Volume::_FoundResource(NodeType type, const BString& dirURL,
-	const BString& name, const BString& comment)
+	const BString& name, const BString& comment,
+	EntryNotificationList& notifications)
 {
 	TRACE("add resource dir=%s name=%s comment=%s",
 		dirURL.String(), name.String(), comment.String());
 
-	AutoLocker<BLocker> locker(fLock);
-	Node* const dirNode = fNodeURLMemory.Get(dirURL.String());
+	Node* const dirNode = fDiscoveryNodes.Get(dirURL.String());
 	if (dirNode == NULL)
 		debugger("directory not found");
 
@@ -365,22 +1131,28 @@ Volume::_FoundResource(NodeType type, const BString& dirURL,
 		debugger("unexpected node type");
 
 	Node* const newNode = discoveryDirNode->AddEntry(type, name, comment);
+	if (newNode == NULL)
+		return;
 
-	if (newNode != NULL) {
-		notify_entry_created(ID(), dirNode->ID(), name.String(),
-			newNode->ID());
-	}
+	EntryNotification notification;
+	notification.created = true;
+	notification.directoryID = dirNode->ID();
+	notification.name = name;
+	notification.id = newNode->ID();
+	notifications.push_back(notification);
 }
 
 
+/*! Volume must be locked
+*/
 void
-Volume::_LostResource(const BString& dirURL, const BString& name)
+Volume::_LostResource(const BString& dirURL, const BString& name,
+	EntryNotificationList& notifications)
 {
 	TRACE("remove resource dir=%s name=%s",
 		dirURL.String(), name.String());
 
-	AutoLocker<BLocker> locker(fLock);
-	Node* const dirNode = fNodeURLMemory.Get(dirURL.String());
+	Node* const dirNode = fDiscoveryNodes.Get(dirURL.String());
 	if (dirNode == NULL)
 		debugger("directory not found");
 
@@ -393,5 +1165,357 @@ Volume::_LostResource(const BString& dirURL, const BString& name)
 	if (id == kInvalidNodeID)
 		debugger("entry not found");
 
-	notify_entry_removed(ID(), dirNode->ID(), name.String(), id);
+	// Nobody heard of the entry yet if it was only created since the
+	// notifications were last sent
+	for (size_t i = notifications.size(); i-- > 0;) {
+		const EntryNotification& created = notifications[i];
+		if (created.created && created.id == id
+			&& created.directoryID == dirNode->ID()
+			&& created.name == name) {
+			notifications.erase(notifications.begin() + i);
+			return;
+		}
+	}
+
+	EntryNotification notification;
+	notification.created = false;
+	notification.directoryID = dirNode->ID();
+	notification.name = name;
+	notification.id = id;
+	notifications.push_back(notification);
+}
+
+
+void
+Volume::_SendNotifications(const EntryNotificationList& notifications)
+{
+	for (size_t i = 0; i < notifications.size(); i++) {
+		const EntryNotification& notification = notifications[i];
+		if (notification.created) {
+			notify_entry_created(ID(), notification.directoryID,
+				notification.name.String(), notification.id);
+		} else {
+			notify_entry_removed(ID(), notification.directoryID,
+				notification.name.String(), notification.id);
+		}
+	}
+}
+
+
+/*! The shard is picked by the top bits of the mixed hash, the hash map of
+    the shard uses the low ones.
+*/
+Volume::EntryShard&
+Volume::_EntryShardFor(const EntryKey& key)
+{
+	return fNodeEntryMemory[(key.GetHashCode() * 0x9e3779b1U)
+		>> (32 - kEntryShardBits)];
+}
+
+
+/*! Volume must be locked, RecallNode() relies on it.
+*/
+status_t
+Volume::_PutEntryNode(const EntryKey& key, Node* node)
+{
+	EntryShard& shard = _EntryShardFor(key);
+	EntryShardWriteLocker shardLocker(shard);
+	return shard.nodes.Put(key, node);
+}
+
+
+/*! Volume must be locked, RecallNode() relies on it.
+*/
+void
+Volume::_RemoveEntryNode(const EntryKey& key)
+{
+	EntryShard& shard = _EntryShardFor(key);
+	EntryShardWriteLocker shardLocker(shard);
+	shard.nodes.Remove(key);
+}
+
+
+/*! Puts a node into the list of nodes to evict, or takes it out, depending
+    on whether it is still needed: it is held by the VFS, or other nodes
+    need it as their parent. Volume must be locked.
+*/
+void
+Volume::_UpdateUnusedNode(Node* node)
+{
+	const bool unused = node->fEvictable
+		&& atomic_get(&node->fReferenceState) == Node::kUnreferenced
+		&& node->fChildCount == 0;
+	if (unused == node->fUnused)
+		return;
+
+	node->fUnused = unused;
+	if (unused) {
+		fUnusedNodes.Add(node);
+		fUnusedNodeCount++;
+		_EvictUnusedNodes();
+	} else {
+		fUnusedNodes.Remove(node);
+		fUnusedNodeCount--;
+	}
+}
+
+
+/*! Volume must be locked
+*/
+void
+Volume::_AddChildNode(Node* parent)
+{
+	if (parent != NULL && parent->fChildCount++ == 0)
+		_UpdateUnusedNode(parent);
+}
+
+
+/*! Volume must be locked
+*/
+void
+Volume::_RemoveChildNode(Node* parent)
+{
+	if (parent == NULL)
+		return;
+
+	assert(parent->fChildCount > 0);
+	if (--parent->fChildCount > 0)
+		return;
+
+	if (atomic_get(&parent->fReferenceState) == Node::kDead) {
+		// Forgotten directory which was only kept for its entries' nodes
+		fNodeTable.Retire(parent);
+	} else
+		_UpdateUnusedNode(parent);
+}
+
+
+/*! Evicts the least recently used nodes which aren't needed, until no more
+    than kMaxUnusedNodes are left. Volume must be locked.
+*/
+void
+Volume::_EvictUnusedNodes()
+{
+	while (fUnusedNodeCount > kMaxUnusedNodes) {
+		Node* const node = fUnusedNodes.RemoveHead();
+		fUnusedNodeCount--;
+		node->fUnused = false;
+
+		// GetVNode() may have referenced it meanwhile, then it is put back
+		// into the list when released
+		if (atomic_test_and_set(&node->fReferenceState, Node::kDead,
+				Node::kUnreferenced) == Node::kUnreferenced) {
+			_EvictNode(node);
+		}
+	}
+}
+
+
+/*! Deletes an unused node, but remembers its directory entry by ID, so the
+    node can be brought back with the same ID. Volume must be locked.
+*/
+void
+Volume::_EvictNode(Node* node)
+{
+	TRACE("evict node name=%s ID=0x%" B_PRIx64, node->Name(), node->ID());
+
+	_RemoveEntryNode(EntryKey(node->fParent->ID(), node->Name()));
+	fNodeTable.Remove(node->ID());
+	fURLCache.Remove(node->ID());
+
+	EvictedNode* const evicted = new(std::nothrow) EvictedNode;
+	if (evicted != NULL) {
+		evicted->id = node->ID();
+		evicted->directoryID = node->fParent->ID();
+		evicted->name = node->Name();
+		evicted->type = node->Type();
+		_AddEvictedNode(evicted);
+	}
+
+	_RetireNode(node);
+		// its directory may become unused and get evicted in turn
+}
+
+
+/*! Deletes a node which isn't in the node table anymore, as soon as
+    GetVNode() can't see it anymore. A directory stays until the last node of
+    its entries is gone, they need it for their URLs. Volume must be locked.
+*/
+void
+Volume::_RetireNode(Node* node)
+{
+	if (node->fChildCount == 0)
+		fNodeTable.Retire(node);
+}
+
+
+/*! Takes over the evicted node. Volume must be locked.
+*/
+void
+Volume::_AddEvictedNode(EvictedNode* evicted)
+{
+	TakeEvictedNodeID(evicted->directoryID, evicted->name.String());
+		// an older eviction of the same entry is outdated
+
+	if (fEvictedNodes.Put(evicted->id, evicted) != B_OK) {
+		delete evicted;
+		return;
+	}
+	if (fEvictedNodeEntries.Put(evicted->Entry(), evicted) != B_OK) {
+		fEvictedNodes.Remove(evicted->id);
+		delete evicted;
+		return;
+	}
+
+	fEvictionOrder.push_back(evicted->id);
+	_TrimEvictedNodes();
+}
+
+
+/*! Re-creates an evicted node with its old ID. Its directory is brought back,
+    too, if it was evicted as well. Volume must be locked.
+*/
+Node*
+Volume::_ResurrectNode(ino_t id)
+{
+	EvictedNode* evicted = fEvictedNodes.Get(id);
+	if (evicted == NULL)
+		return _ResurrectStoredNode(id);
+
+	Node* directory = fNodeTable.Get(evicted->directoryID);
+	if (directory == NULL) {
+		directory = _ResurrectNode(evicted->directoryID);
+		if (directory == NULL)
+			return NULL;
+
+		// Bringing back the directory may have evicted other nodes, and
+		// dropped old evictions with them
+		evicted = fEvictedNodes.Get(id);
+		if (evicted == NULL)
+			return NULL;
+	}
+
+	const char* const name = evicted->name.String();
+	if (RecallNode(directory, name) != NULL) {
+		// Entry was replaced by another node meanwhile
+		_ForgetEvictedNode(id);
+		return NULL;
+	}
+
+	TRACE("resurrect node name=%s ID=0x%" B_PRIx64, name, id);
+
+	Node* node;
+	if (evicted->type == kShareDirectory)
+		node = new(std::nothrow) ShareDirectoryNode(directory, name, id);
+	else
+		node = new(std::nothrow) ShareFileNode(directory, name, id);
+	if (node == NULL)
+		return NULL;
+
+	_ForgetEvictedNode(id);
+	MemorizeNode(node, true);
+	return node;
+}
+
+
+/*! Brings back a node whose eviction was dropped, by the entry the node ID
+    store has for its ID. Whether it's a file or a directory isn't stored, so
+    the entry is stat'ed on the server, with the volume locked. That's only
+    needed for node_refs older than kMaxEvictedNodes evictions. Volume must
+    be locked.
+*/
+Node*
+Volume::_ResurrectStoredNode(ino_t id)
+{
+	ino_t directoryID;
+	BString name;
+	if (fNodeIDStore == NULL
+		|| !fNodeIDStore->GetEntry(id, &directoryID, &name)) {
+		return NULL;
+	}
+
+	Node* directory = fNodeTable.Get(directoryID);
+	if (directory == NULL)
+		directory = _ResurrectNode(directoryID);
+	if (directory == NULL)
+		return NULL;
+
+	Node* node = RecallNode(directory, name.String());
+	if (node != NULL)
+		return node->ID() == id ? node : NULL;
+
+	const BString url(directory->EntryURL(name.String()));
+	struct stat st;
+	SambaContextLease context(fSambaContextPool, url);
+	status_t status = context.InitCheck();
+	if (status == B_OK)
+		status = context->Stat(url, &st);
+	context.Release();
+	if (status != B_OK)
+		return NULL;
+
+	TRACE("resurrect stored node name=%s ID=0x%" B_PRIx64, name.String(), id);
+
+	if (S_ISDIR(st.st_mode))
+		node = new(std::nothrow) ShareDirectoryNode(directory,
+			name.String(), id);
+	else
+		node = new(std::nothrow) ShareFileNode(directory, name.String(),
+			id);
+	if (node == NULL)
+		return NULL;
+
+	MemorizeNode(node, true);
+	return node;
+}
+
+
+/*! Volume must be locked
+*/
+void
+Volume::_ForgetEvictedNode(ino_t id)
+{
+	EvictedNode* const evicted = fEvictedNodes.Get(id);
+	if (evicted == NULL)
+		return;
+
+	if (fEvictedNodeEntries.Get(evicted->Entry()) == evicted)
+		fEvictedNodeEntries.Remove(evicted->Entry());
+	fEvictedNodes.Remove(id);
+	delete evicted;
+}
+
+
+/*! Drops the oldest evictions beyond kMaxEvictedNodes. Nodes with those IDs
+    can only be brought back through the node ID store, if there is one.
+    Volume must be locked.
+*/
+void
+Volume::_TrimEvictedNodes()
+{
+	while (fEvictedNodes.Size() > kMaxEvictedNodes
+		&& !fEvictionOrder.empty()) {
+		const ino_t id = fEvictionOrder.front();
+		fEvictionOrder.pop_front();
+		if (!fEvictedNodes.ContainsKey(id))
+			continue;
+
+		_ForgetEvictedNode(id);
+		if (fDroppedEvictions++ == 0) {
+			fprintf(stderr, "SMB-FS: over %d evicted nodes, old node IDs %s\n",
+				(int)kMaxEvictedNodes, fNodeIDStore != NULL
+					? "are looked up in the node ID store"
+					: "can't be brought back anymore");
+		}
+	}
+
+	// Nodes which were brought back leave stale IDs in the eviction order
+	if (fEvictionOrder.size() > 2 * (size_t)kMaxEvictedNodes) {
+		std::deque<ino_t> order;
+		for (size_t i = 0; i < fEvictionOrder.size(); i++) {
+			if (fEvictedNodes.ContainsKey(fEvictionOrder[i]))
+				order.push_back(fEvictionOrder[i]);
+		}
+		fEvictionOrder.swap(order);
+	}
 }
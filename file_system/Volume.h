@@ -11,17 +11,67 @@
 
 #include <fs_interface.h>
 #include <kernel/fs_info.h>
+#include <private/shared/AutoLocker.h>
+#include <private/shared/DoublyLinkedList.h>
 #include <private/shared/HashMap.h>
 #include <private/shared/HashString.h>
 
+#include <pthread.h>
+
+#include <deque>
+#include <vector>
+
+#include "AsyncIO.h"
+#include "EntryKey.h"
+#include "IOSizeTuner.h"
+#include "MissingEntryCache.h"
 #include "NodeDefs.h"
+#include "NodeTable.h"
+#include "StatCache.h"
+#include "URLCache.h"
+
+
+class BMessageRunner;
 
 
 namespace Smb {
 
 
+class Backend;
+class CountingBackend;
 class Node;
-class SambaContext;
+class NodeIDStore;
+class SambaContextPool;
+
+
+// The file system operations backend calls are counted for, see
+// CountingBackend::Scope
+enum VFSOperation {
+	kVFSOther = 0,
+		// calls of background threads
+	kVFSReadFsInfo,
+	kVFSLookup,
+	kVFSGetVNode,
+	kVFSReadStat,
+	kVFSWriteStat,
+	kVFSOpen,
+	kVFSClose,
+	kVFSFsync,
+	kVFSRename,
+	kVFSUnlink,
+	kVFSRead,
+	kVFSWrite,
+	kVFSIO,
+	kVFSCreate,
+	kVFSOpenDir,
+	kVFSCloseDir,
+	kVFSReadDir,
+	kVFSRewindDir,
+	kVFSCreateDir,
+	kVFSRemoveDir,
+
+	kVFSOperationCount
+};
 
 
 class Volume : public BHandler {
@@ -34,17 +84,47 @@ public:
 			status_t		InitCheck() const;
 			dev_t			ID() const;
 			fs_volume*		VFSVolume() const;
+			SambaContextPool* SambaContexts() const;
+			CountingBackend* CallCounts() const;
 
 // ----- File system ----------------------------------------------------------
 			void			NetworkScan();
 			status_t		Unmount();
 			status_t		FsInfo(struct fs_info* info);
+			IOSizeTuner*	IOSizes();
+			StatCache*		Stats();
+			URLCache*		URLs();
+			MissingEntryCache* MissingEntries();
+			AsyncIO*		IO();
+
+// ----- Buffer memory --------------------------------------------------------
+			bool			ReserveBufferMemory(size_t size);
+			void			UnreserveBufferMemory(size_t size);
 
 // ----- Nodes ----------------------------------------------------------------
-			ino_t			MakeFreshNodeID();					// must lock
-			void			MemorizeNode(Node* node);			// must lock
-			Node*			RecallNode(const BString& url);		// must lock
-			Node*			ForgetNode(const BString& url);		// must lock
+			ino_t			MakeFreshNodeID();
+			ino_t			MakeNodeID(Node* directory,			// must lock
+								const char* name);
+			void			MemorizeNode(Node* node,			// must lock
+								bool evictable = false);
+			Node*			RecallNode(Node* directory,			// must lock
+								const char* name);
+			void			ForgetNode(Node* node);				// must lock
+			void			RemoveNode(Node* node);				// must lock
+			void			DeleteNode(Node* node);				// must lock
+			void			MoveNode(Node* node, Node* toDirectory,
+								const char* toName);			// must lock
+
+			void			AttachNode(Node* node);				// must lock
+			void			DetachNode(Node* node);				// must lock
+
+			bool			ReferenceNode(Node* node);			// must lock
+			void			ReleaseNode(Node* node);			// must lock
+			ino_t			TakeEvictedNodeID(ino_t directoryID,
+								const char* name);				// must lock
+			ino_t			MoveEvictedNode(ino_t fromDirectoryID,
+								const char* fromName, ino_t toDirectoryID,
+								const char* toName);			// must lock
 
 			status_t		Lookup(Node* directory, const char* name,
 								ino_t* outNodeID);
@@ -59,39 +139,172 @@ public:
 			void			Unlock() { fLock.Unlock(); }
 
 private:
+	// Entry notifications are collected while the volume is locked, and
+	// sent after it is unlocked
+	struct EntryNotification {
+		bool		created;
+		ino_t		directoryID;
+		BString		name;
+		ino_t		id;
+	};
+
+	typedef std::vector<EntryNotification> EntryNotificationList;
+
+private:
+	static	Backend*		_CreateBackend(const char* args,
+								CountingBackend** _callCounts);
+			void			_ReportCalls();
+			void			_ParseArgs(const char* args);
 			void			_InitFsInfo();
 			void			_RegisterAsMessageHandler();
 			status_t		_LaunchAssistant();
+			void			_CreateShares(const char* args);
+			status_t		_ScanBackend(bool notify);
+			void			_UpdateResources(const BString& dirURL,
+								NodeType type, std::vector<BString>& names,
+								EntryNotificationList& notifications);
 
+			void			_ApplyResourceBatch(const BMessage* message);
 			void			_FoundResource(NodeType type, const BString& dirURL,
-								const BString& name, const BString& comment);
+								const BString& name, const BString& comment,
+								EntryNotificationList& notifications);
 			void			_LostResource(const BString& dirURL,
-								const BString& name);
+								const BString& name,
+								EntryNotificationList& notifications);
+			void			_SendNotifications(
+								const EntryNotificationList& notifications);
 
 private:
-	typedef HashMap<HashKey64<ino_t>, Node*> NodeByID;
 	typedef HashMap<HashString, Node*> NodeByURL;
+	typedef DoublyLinkedList<Node> NodeList;
+
+	struct EvictedNode {
+		EntryKey Entry() const
+		{
+			return EntryKey(directoryID, name.String());
+		}
+
+		ino_t		id;
+		ino_t		directoryID;
+		BString		name;
+		NodeType	type;
+	};
+
+	typedef HashMap<EntryKey, Node*> NodeByEntry;
+		// keys refer to the names of the nodes
+
+	// Part of the entry map. Lookup() only read locks the shard of the
+	// entry instead of the volume. Writers hold both: an entry changes
+	// together with the node table, the parent's child count and the list
+	// of unused nodes, which the volume lock keeps consistent, and
+	// RecallNode() reads the map with only that lock held. The shard lock
+	// just keeps Lookup() from seeing a map in the middle of a change.
+	struct EntryShard {
+		EntryShard()
+		{
+			pthread_rwlock_init(&lock, NULL);
+		}
+
+		~EntryShard()
+		{
+			pthread_rwlock_destroy(&lock);
+		}
+
+		bool ReadLock()    { return pthread_rwlock_rdlock(&lock) == 0; }
+		void ReadUnlock()  { pthread_rwlock_unlock(&lock); }
+		bool WriteLock()   { return pthread_rwlock_wrlock(&lock) == 0; }
+		void WriteUnlock() { pthread_rwlock_unlock(&lock); }
+
+		pthread_rwlock_t	lock;
+		NodeByEntry			nodes;
+	};
+
+	typedef AutoLocker<EntryShard, AutoLockerReadLocking<EntryShard> >
+		EntryShardReadLocker;
+	typedef AutoLocker<EntryShard, AutoLockerWriteLocking<EntryShard> >
+		EntryShardWriteLocker;
+	typedef HashMap<HashKey64<ino_t>, EvictedNode*> EvictedNodeByID;
+	typedef HashMap<EntryKey, EvictedNode*> EvictedNodeByEntry;
+		// keys refer to the names of the evicted nodes
+
+	enum {
+		kMsgRemoveExpiredEntries = 0x3001
+			// sent to ourselves by fExpiryRunner
+	};
 
 	enum {
-		kMinScanInterval = 5 * 1000 * 1000 // µsec
+		kMinScanInterval   = 5 * 1000 * 1000, // µsec
+		kExpiryInterval    = 1000 * 1000, // µsec
+			// between removing expired missing entries
+		kBufferMemoryLimit = 64 * 1024 * 1024,
+			// bytes the read-ahead and write-behind buffers of O_NOCACHE
+			// cookies may use together, the file cache has its own limits
+		kMaxUnusedNodes    = 4096,
+			// nodes the VFS doesn't hold, kept before evicting the oldest
+		kMaxEvictedNodes   = 256 * 1024,
+			// evicted nodes whose ID we can bring back by themselves,
+			// older ones only with a node ID store
+		kEntryShardBits    = 4
 	};
 
+private:
+			EntryShard&		_EntryShardFor(const EntryKey& key);
+			status_t		_PutEntryNode(const EntryKey& key, Node* node);
+			void			_RemoveEntryNode(const EntryKey& key);
+
+			void			_AddChildNode(Node* parent);
+			void			_RemoveChildNode(Node* parent);
+			void			_UpdateUnusedNode(Node* node);
+			void			_EvictUnusedNodes();
+			void			_EvictNode(Node* node);
+			void			_RetireNode(Node* node);
+			void			_AddEvictedNode(EvictedNode* evicted);
+			Node*			_ResurrectNode(ino_t id);
+			Node*			_ResurrectStoredNode(ino_t id);
+			void			_ForgetEvictedNode(ino_t id);
+			void			_TrimEvictedNodes();
+
 private:
 			status_t		fStatus;
 			BLocker			fLock;
 
-			SambaContext*	fSambaContext;
+			CountingBackend* fCallCounts;
+				// NULL unless the calls are counted
+			BString			fCallReportPath;
+			Backend*		fBackend;
+			SambaContextPool* fSambaContextPool;
 			fs_volume*		fVFSVolume;
 			bool			fReadOnly;
 			struct fs_info	fFsInfo;
 			bigtime_t		fLastScanTime;
+			int64			fBufferMemoryUsed;
+			StatCache		fStatCache;
+			URLCache		fURLCache;
+			IOSizeTuner		fIOSizes;
+			MissingEntryCache fMissingEntries;
+			AsyncIO			fAsyncIO;
 
 			Node*			fNetworkNode;	// root node
-			ino_t			fNextNodeID;
-			NodeByID		fNodeIDMemory;
-			NodeByURL		fNodeURLMemory;
+			int64			fNextNodeID;
+			NodeIDStore*	fNodeIDStore;
+				// only if the IDs are to survive remounts
+			NodeTable		fNodeTable;
+				// GetVNode() reads it without locking
+			EntryShard		fNodeEntryMemory[1 << kEntryShardBits];
+			NodeByURL		fDiscoveryNodes;
+				// the assistant refers to discovery directories by URL
+			NodeList		fUnusedNodes;	// LRU first
+			int32			fUnusedNodeCount;
+			EvictedNodeByID	fEvictedNodes;
+			EvictedNodeByEntry fEvictedNodeEntries;
+			std::deque<ino_t> fEvictionOrder;
+			int64			fDroppedEvictions;
+				// beyond kMaxEvictedNodes
 
+			bool			fBackendListsShares;
+				// else the assistant scans the network
 			BMessenger*		fAssistantMessenger;
+			BMessageRunner*	fExpiryRunner;
 };
 
 
@@ -6,9 +6,11 @@
 #include <fs_interface.h>
 
 #include <private/shared/AutoDeleter.h>
+#include <private/shared/AutoLocker.h>
 
 #include <stdio.h>
 
+#include "CountingBackend.h"
 #include "nodes/Node.h"
 #include "Volume.h"
 
@@ -21,6 +23,11 @@
 #	define TRACE(text, ...)
 #endif
 
+// Accounts the backend calls the hook makes to the file system operation
+#define COUNT_CALLS(volume, operation) \
+	Smb::CountingBackend::Scope _callScope(to_smb(volume)->CallCounts(), \
+		Smb::operation)
+
 
 extern fs_volume_ops gSmbVolumeOps;
 extern fs_vnode_ops gSmbVnodeOps;
@@ -114,6 +121,8 @@ smb_unmount(fs_volume* volume)
 static status_t
 smb_read_fs_info(fs_volume* volume, struct fs_info* info)
 {
+	COUNT_CALLS(volume, kVFSReadFsInfo);
+
 	TRACE("");
 	return to_smb(volume)->FsInfo(info);
 }
@@ -134,6 +143,8 @@ static status_t
 smb_lookup(fs_volume* volume, fs_vnode* directory, const char* name,
 	ino_t* id)
 {
+	COUNT_CALLS(volume, kVFSLookup);
+
 	TRACE("dir=%s name=%s", to_smb(directory)->URL().String(), name);
 
 	status_t status = to_smb(volume)->Lookup(to_smb(directory), name, id);
@@ -148,11 +159,12 @@ smb_lookup(fs_volume* volume, fs_vnode* directory, const char* name,
 /*!	fs_volume_ops::get_vnode_name
 */
 static status_t
-smb_get_vnode_name(fs_volume*, fs_vnode* vnode, char* buffer,
+smb_get_vnode_name(fs_volume* volume, fs_vnode* vnode, char* buffer,
 	size_t bufferSize)
 {
-	const BString& name = to_smb(vnode)->Name();
-	strlcpy(buffer, name.String(), bufferSize);
+	// Renames change the name
+	AutoLocker<Smb::Volume> locker(to_smb(volume));
+	strlcpy(buffer, to_smb(vnode)->Name(), bufferSize);
 	return B_OK;
 }
 
@@ -170,6 +182,8 @@ static status_t
 smb_get_vnode(fs_volume* volume, ino_t id, fs_vnode* vnode, int* type,
 	uint32* flags, bool)
 {
+	COUNT_CALLS(volume, kVFSGetVNode);
+
 	TRACE("ID=0x%" B_PRIx64, id);
 	status_t status = to_smb(volume)->GetVNode(id, &vnode->private_node);
 	if (status != B_OK)
@@ -215,8 +229,10 @@ smb_remove_vnode(fs_volume*, fs_vnode* vnode, bool reenter)
 	Must fill in all stat values except st_dev, st_ino, st_rdev and st_type
 */
 static status_t
-smb_read_stat(fs_volume*, fs_vnode* vnode, struct stat* fileStat)
+smb_read_stat(fs_volume* volume, fs_vnode* vnode, struct stat* fileStat)
 {
+	COUNT_CALLS(volume, kVFSReadStat);
+
 	TRACE("URL=%s", to_smb(vnode)->URL().String());
 	return to_smb(vnode)->ReadStat(fileStat);
 }
@@ -227,9 +243,11 @@ smb_read_stat(fs_volume*, fs_vnode* vnode, struct stat* fileStat)
 	Update file stat
 */
 static status_t
-smb_write_stat(fs_volume*, fs_vnode* vnode, const struct stat* stat,
+smb_write_stat(fs_volume* volume, fs_vnode* vnode, const struct stat* stat,
 	uint32 statMask)
 {
+	COUNT_CALLS(volume, kVFSWriteStat);
+
 	return to_smb(vnode)->WriteStat(stat, statMask);
 }
 
@@ -258,8 +276,10 @@ smb_access(fs_volume*, fs_vnode*, int)
 	Relevant additional flags O_TRUNC, O_NONBLOCK
 */
 static status_t
-smb_open(fs_volume*, fs_vnode* vnode, int openMode, void** cookie)
+smb_open(fs_volume* volume, fs_vnode* vnode, int openMode, void** cookie)
 {
+	COUNT_CALLS(volume, kVFSOpen);
+
 	TRACE("URL=%s mode=0x%x", to_smb(vnode)->URL().String(), openMode);
 	return to_smb(vnode)->Open(openMode, cookie);
 }
@@ -273,8 +293,10 @@ smb_open(fs_volume*, fs_vnode* vnode, int openMode, void** cookie)
 	Mark the cookie so that no further operations can be done with it.
 */
 static status_t
-smb_close(fs_volume*, fs_vnode* vnode, void* cookie)
+smb_close(fs_volume* volume, fs_vnode* vnode, void* cookie)
 {
+	COUNT_CALLS(volume, kVFSClose);
+
 	TRACE("");
 	return to_smb(vnode)->Close(cookie);
 }
@@ -292,14 +314,30 @@ smb_free_cookie(fs_volume*, fs_vnode* vnode, void* cookie)
 }
 
 
+/*!	fs_vnode_ops::fsync
+
+	Write out all data of the node which is still buffered
+*/
+static status_t
+smb_fsync(fs_volume* volume, fs_vnode* vnode)
+{
+	COUNT_CALLS(volume, kVFSFsync);
+
+	TRACE("URL=%s", to_smb(vnode)->URL().String());
+	return to_smb(vnode)->Sync();
+}
+
+
 /*!	fs_vnode_ops::rename
 
 	Rename/move entry
 */
 static status_t
-smb_rename(fs_volume*, fs_vnode* fromDir, const char* fromName,
+smb_rename(fs_volume* volume, fs_vnode* fromDir, const char* fromName,
 	fs_vnode* toDir, const char* toName)
 {
+	COUNT_CALLS(volume, kVFSRename);
+
 	return to_smb(fromDir)->Rename(fromName, to_smb(toDir), toName);
 }
 
@@ -312,6 +350,8 @@ smb_rename(fs_volume*, fs_vnode* fromDir, const char* fromName,
 static status_t
 smb_unlink(fs_volume* volume, fs_vnode* dir, const char* name)
 {
+	COUNT_CALLS(volume, kVFSUnlink);
+
 	ino_t removedNodeId = 0;
 	status_t status = to_smb(volume)->Lookup(to_smb(dir), name,
 		&removedNodeId);
@@ -335,9 +375,11 @@ smb_unlink(fs_volume* volume, fs_vnode* dir, const char* name)
 	Store number bytes read in 'length'
 */
 static status_t
-smb_read(fs_volume*, fs_vnode* vnode, void* cookie, off_t pos,
+smb_read(fs_volume* volume, fs_vnode* vnode, void* cookie, off_t pos,
 	void* buffer, size_t* length)
 {
+	COUNT_CALLS(volume, kVFSRead);
+
 	return to_smb(vnode)->Read(cookie, pos, buffer, length);
 }
 
@@ -350,14 +392,43 @@ smb_read(fs_volume*, fs_vnode* vnode, void* cookie, off_t pos,
 	Store number bytes written in 'length'
 */
 static status_t
-smb_write(fs_volume*, fs_vnode* vnode, void* cookie, off_t pos,
+smb_write(fs_volume* volume, fs_vnode* vnode, void* cookie, off_t pos,
 	const void* buffer, size_t* length)
 {
+	COUNT_CALLS(volume, kVFSWrite);
+
 	TRACE("URL=%s", to_smb(vnode)->URL().String());
 	return to_smb(vnode)->Write(cookie, pos, buffer, length);
 }
 
 
+/*!	fs_vnode_ops::io
+
+	Start reading or writing the data of an io_request, and return
+	Call notify_io_request() once the request is done
+	Fails if node is not a file
+*/
+static status_t
+smb_io(fs_volume* volume, fs_vnode* vnode, void* cookie, io_request* request)
+{
+	COUNT_CALLS(volume, kVFSIO);
+
+	return to_smb(vnode)->IO(cookie, request);
+}
+
+
+/*!	fs_vnode_ops::cancel_io
+
+	Abort an io_request which was started with fs_vnode_ops::io
+	It still has to be completed with notify_io_request()
+*/
+static status_t
+smb_cancel_io(fs_volume*, fs_vnode* vnode, void* cookie, io_request* request)
+{
+	return to_smb(vnode)->CancelIO(cookie, request);
+}
+
+
 /*!	fs_vnode_ops::create
 
 	Like fs_vnode_ops::open, but file is created if it doesn't exist yet
@@ -368,6 +439,8 @@ static status_t
 smb_create(fs_volume* volume, fs_vnode* dir, const char* name, int openMode,
 	int permissions, void** cookie, ino_t* newVnodeId)
 {
+	COUNT_CALLS(volume, kVFSCreate);
+
 	TRACE("dirURL=%s name=%s mode=0x%x", to_smb(dir)->URL().String(), name,
 		openMode);
 
@@ -392,8 +465,10 @@ smb_create(fs_volume* volume, fs_vnode* dir, const char* name, int openMode,
 	Next call to read_dir should return first dir entry
 */
 static status_t
-smb_open_dir(fs_volume*, fs_vnode* dir, void** cookie)
+smb_open_dir(fs_volume* volume, fs_vnode* dir, void** cookie)
 {
+	COUNT_CALLS(volume, kVFSOpenDir);
+
 	TRACE("URL=%s", to_smb(dir)->URL().String());
 	return to_smb(dir)->OpenDir(cookie);
 }
@@ -404,8 +479,10 @@ smb_open_dir(fs_volume*, fs_vnode* dir, void** cookie)
 	Close directory
 */
 static status_t
-smb_close_dir(fs_volume*, fs_vnode* dir, void* cookie)
+smb_close_dir(fs_volume* volume, fs_vnode* dir, void* cookie)
 {
+	COUNT_CALLS(volume, kVFSCloseDir);
+
 	TRACE("URL=%s", to_smb(dir)->URL().String());
 	return to_smb(dir)->CloseDir(cookie);
 }
@@ -421,9 +498,11 @@ smb_close_dir(fs_volume*, fs_vnode* dir, void* cookie)
 	Should contain ".", ".."
 */
 static status_t
-smb_read_dir(fs_volume*, fs_vnode* vnode, void* cookie, struct dirent* buffer,
-	size_t bufferSize, uint32* num)
+smb_read_dir(fs_volume* volume, fs_vnode* vnode, void* cookie,
+	struct dirent* buffer, size_t bufferSize, uint32* num)
 {
+	COUNT_CALLS(volume, kVFSReadDir);
+
 	TRACE("URL=%s", to_smb(vnode)->URL().String());
 	return to_smb(vnode)->ReadDir(cookie, buffer, bufferSize, num);
 }
@@ -446,8 +525,10 @@ smb_free_dir_cookie(fs_volume*, fs_vnode* vnode, void* cookie)
 	Reset directory cookie to first dir entry
 */
 static status_t
-smb_rewind_dir(fs_volume*, fs_vnode* vnode, void* cookie)
+smb_rewind_dir(fs_volume* volume, fs_vnode* vnode, void* cookie)
 {
+	COUNT_CALLS(volume, kVFSRewindDir);
+
 	TRACE("URL=%s", to_smb(vnode)->URL().String());
 	return to_smb(vnode)->RewindDirCookie(cookie);
 }
@@ -458,9 +539,11 @@ smb_rewind_dir(fs_volume*, fs_vnode* vnode, void* cookie)
 	Create directory
 */
 static status_t
-smb_create_dir(fs_volume*, fs_vnode* parent, const char* name,
+smb_create_dir(fs_volume* volume, fs_vnode* parent, const char* name,
 	int permissions)
 {
+	COUNT_CALLS(volume, kVFSCreateDir);
+
 	return to_smb(parent)->CreateDir(name, permissions);
 }
 
@@ -471,8 +554,10 @@ smb_create_dir(fs_volume*, fs_vnode* parent, const char* name,
 	Fails if directory not empty
 */
 static status_t
-smb_remove_dir(fs_volume*, fs_vnode* parent, const char* name)
+smb_remove_dir(fs_volume* volume, fs_vnode* parent, const char* name)
 {
+	COUNT_CALLS(volume, kVFSRemoveDir);
+
 	return to_smb(parent)->RemoveDir(name);
 }
 
@@ -525,9 +610,9 @@ fs_vnode_ops gSmbVnodeOps = {
 	NULL, // read_pages
 	NULL, // write_pages
 
-	// asynchronous I/O (not implemented)
-	NULL, // io
-	NULL, // cancel_io
+	// asynchronous I/O
+	&smb_io,
+	&smb_cancel_io,
 
 	// cache file access (not implemented)
 	NULL, // get_file_map
@@ -537,7 +622,7 @@ fs_vnode_ops gSmbVnodeOps = {
 	NULL, // set_flags
 	NULL, // select
 	NULL, // deselect
-	NULL, // fsync
+	&smb_fsync,
 
 	NULL, // read_symlink
 	NULL, // create_symlink
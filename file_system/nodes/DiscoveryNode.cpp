@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <dirent.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -35,10 +36,10 @@ using namespace Smb;
 
 
 struct DiscoveryNode::Cookie {
-	Cookie(Entries::iterator it)
+	Cookie()
 		:
 		fOpen(true),
-		fIterator(it)
+		fIndex(0)
 	{
 	}
 
@@ -48,7 +49,8 @@ struct DiscoveryNode::Cookie {
 	}
 
 	bool 				fOpen;
-	Entries::iterator	fIterator;
+	uint32				fIndex;
+		// entries only move while the directory isn't open
 };
 
 
@@ -63,35 +65,26 @@ DiscoveryNode::Entry::Entry(Node* node)
 }
 
 
-DiscoveryNode::Entry::~Entry()
-{
-	if (fWasRemoved)
-		fNode->Delete(true, false);
-}
-
-
 // #pragma mark - DiscoveryNode
 
 
-DiscoveryNode::DiscoveryNode(Volume* volume, SambaContext* context)
+DiscoveryNode::DiscoveryNode(Volume* volume, SambaContextPool* contextPool)
 	:
-	Node(kNetworkNodeID, "smb://", "", volume, context),
+	Node(kNetworkNodeID, "", volume, contextPool),
 	fType(kNetwork),
-	fDirOpenCount(0),
-	fParent(this)
+	fDirOpenCount(0)
 {
 	_FillStat();
 	_AddDotDirEntries();
 }
 
 
-DiscoveryNode::DiscoveryNode(const BString& url, size_t nameLength,
-	const BString& comment, NodeType type, DiscoveryNode* parent)
+DiscoveryNode::DiscoveryNode(const BString& name, const BString& comment,
+	NodeType type, DiscoveryNode* parent)
 	:
-	Node(url, nameLength, parent->fVolume, parent->fSambaContext),
+	Node(parent, name.String()),
 	fType(type),
 	fDirOpenCount(0),
-	fParent(parent),
 	fComment(comment)
 {
 	_FillStat();
@@ -101,11 +94,10 @@ DiscoveryNode::DiscoveryNode(const BString& url, size_t nameLength,
 
 DiscoveryNode::DiscoveryNode(const char* name, DiscoveryNode* prototype)
 	:
-	Node(prototype->ID(), prototype->URL(), name, prototype->fVolume,
-		prototype->fSambaContext),
+	Node(prototype->ID(), name, prototype->fVolume,
+		prototype->fSambaContextPool),
 	fType(prototype->fType),
-	fDirOpenCount(0),
-	fParent(prototype->fParent)
+	fDirOpenCount(0)
 {
 	fStat = prototype->fStat;
 }
@@ -113,6 +105,11 @@ DiscoveryNode::DiscoveryNode(const char* name, DiscoveryNode* prototype)
 
 DiscoveryNode::~DiscoveryNode()
 {
+	for (uint32 i = 0; i < fEntries.size(); i++) {
+		if (fEntries[i].fWasRemoved)
+			fEntries[i].fNode->Delete(true, false);
+	}
+
 	delete fStat;
 }
 
@@ -124,29 +121,36 @@ DiscoveryNode::Type() const
 }
 
 
+void
+DiscoveryNode::Delete(bool removed, bool reenter)
+{
+	// The node belongs to the entry list of its parent, and other nodes need
+	// it for their URLs. Only when its entry is removed can it go.
+	if (removed)
+		Node::Delete(removed, reenter);
+}
+
+
 Node*
 DiscoveryNode::AddEntry(NodeType type, const BString& name,
 	const BString& comment)
 {
 	AutoLocker<BLocker> locker(fLock);
 
-	BString url(_EntryURL(name));
-
 	Node* entryNode = NULL;
 	if (type == kShare) {
-		entryNode = new(std::nothrow) ShareDirectoryNode(url, name.Length(),
-			fVolume, fSambaContext);
+		entryNode = new(std::nothrow) ShareDirectoryNode(this, name.String());
 			// TODO: comment gets ignored here
 
 		// TODO: handle authentication
 		struct stat st;
-		if (entryNode->ReadStat(&st) != B_OK) {
+		if (entryNode != NULL && entryNode->ReadStat(&st) != B_OK) {
 			delete entryNode;
 			entryNode = NULL;
 		}
 	} else {
-		entryNode = new(std::nothrow) DiscoveryNode(url, name.Length(),
-			comment, type, this);
+		entryNode = new(std::nothrow) DiscoveryNode(name, comment, type,
+			this);
 	}
 	if (entryNode == NULL)
 		return NULL;
@@ -155,11 +159,10 @@ DiscoveryNode::AddEntry(NodeType type, const BString& name,
 	fVolume->MemorizeNode(entryNode);
 	volumeLocker.Unlock();
 
-	Entry entry(entryNode);
-	fEntries.push_back(entry);
+	_AddEntry(entryNode);
 
-	TRACE("added new entry name=%s URL=%s ID=0x%" B_PRIx64, name.String(),
-		url.String(), entryNode->ID());
+	TRACE("added new entry name=%s ID=0x%" B_PRIx64, name.String(),
+		entryNode->ID());
 
 	return entryNode;
 }
@@ -170,27 +173,46 @@ DiscoveryNode::RemoveEntry(const BString& name)
 {
 	AutoLocker<BLocker> locker(fLock);
 
-	// TODO: should be more efficient
-	for (Entries::iterator it = fEntries.begin(); it != fEntries.end(); it++) {
-		Entry& entry = *it;
-		if (!entry.fWasRemoved && name == entry.fNode->Name()) {
-			if (fDirOpenCount > 0) {
-				// Mark entry for deletion later when everyone closed the
-				// directory
-				entry.fWasRemoved = true;
-				return entry.fNode->ID();
-			} else {
-				// Noone has this directory open, delete right away
-				ino_t id = entry.fNode->ID();
-				entry.fNode->Delete(true, false);
-
-				fEntries.erase(it);
-				return id;
-			}
-		}
+	uint32* indexPointer;
+	if (!fEntryIndex.Get(name.String(), indexPointer))
+		return kInvalidNodeID;
+
+	const uint32 index = *indexPointer;
+	fEntryIndex.Remove(name.String());
+
+	Entry& entry = fEntries[index];
+	const ino_t id = entry.fNode->ID();
+	if (fDirOpenCount > 0) {
+		// Mark entry for deletion later when everyone closed the
+		// directory
+		entry.fWasRemoved = true;
+	} else {
+		// Noone has this directory open, delete right away
+		Node* const node = entry.fNode;
+		_RemoveEntryAt(index);
+		_RemoveEntryNode(node);
 	}
+	return id;
+}
 
-	return kInvalidNodeID;
+
+/*! Adds the names of the entries, without "." and "..", and those removed
+    already.
+*/
+void
+DiscoveryNode::GetEntryNames(std::vector<BString>& names)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	for (uint32 i = 0; i < fEntries.size(); i++) {
+		const Entry& entry = fEntries[i];
+		const char* const name = entry.fNode->Name();
+		if (entry.fWasRemoved || strcmp(name, ".") == 0
+			|| strcmp(name, "..") == 0) {
+			continue;
+		}
+		names.push_back(name);
+	}
 }
 
 
@@ -228,33 +250,27 @@ DiscoveryNode::FreeCookie(void*)
 }
 
 
+status_t
+DiscoveryNode::Sync()
+{
+	return B_OK;
+}
+
+
 status_t
 DiscoveryNode::Lookup(const char* name, ino_t* outNodeID)
 {
-	TRACE("%s : lookup %s", fURL.String(), name);
+	TRACE("%s : lookup %s", fName.String(), name);
 
-	if (!_HasEntry(name)) {
+	// "." and ".." are in the entry list as well
+	AutoLocker<BLocker> locker(fLock);
+	uint32* indexPointer;
+	if (!fEntryIndex.Get(name, indexPointer)) {
 		TRACE("entry not found");
 		return B_ENTRY_NOT_FOUND;
 	}
 
-	if (strcmp(name, ".") == 0) {
-		*outNodeID = fID;
-		return B_OK;
-	} else if (strcmp(name, "..") == 0) {
-		*outNodeID = fParent->ID();
-		return B_OK;
-	}
-
-	BString url(_EntryURL(name));
-
-	AutoLocker<Volume> volumeLocker(fVolume);
-	Node* const node = fVolume->RecallNode(url);
-	volumeLocker.Unlock();
-	if (node == NULL)
-		debugger("node in entry list, but not in volume memory");
-
-	*outNodeID = node->ID();
+	*outNodeID = fEntries[*indexPointer].fNode->ID();
 
 	TRACE("lookup successful, ID=0x%" B_PRIx64, *outNodeID);
 
@@ -272,7 +288,7 @@ DiscoveryNode::OpenDir(void** outCookie)
 
 	fDirOpenCount++;
 
-	Cookie* cookie = new(std::nothrow) Cookie(fEntries.begin());
+	Cookie* cookie = new(std::nothrow) Cookie;
 	*outCookie = (void*)cookie;
 	return B_OK;
 }
@@ -285,13 +301,14 @@ DiscoveryNode::CloseDir(void* cookie)
 
 	fDirOpenCount--;
 	if (fDirOpenCount == 0) {
-		// Now we can safely delete all entries which were removed
-		Entries::iterator it = fEntries.begin();
-		while (it != fEntries.end()) {
-			if (it->fWasRemoved)
-				it = fEntries.erase(it);
-			else
-				it++;
+		// Now we can safely delete all entries which were removed. Going
+		// backwards, the entries moved into the gaps are already checked.
+		for (int32 i = (int32)fEntries.size() - 1; i >= 0; i--) {
+			if (fEntries[i].fWasRemoved) {
+				Node* const node = fEntries[i].fNode;
+				_RemoveEntryAt(i);
+				_RemoveEntryNode(node);
+			}
 		}
 
 		// Noone else has it open anymore, so a good time to do another scan
@@ -318,13 +335,20 @@ DiscoveryNode::ReadDir(void* cookie, struct dirent* buffer, size_t bufferSize,
 	struct dirent* currentEntry = buffer;
 
 	while (entriesRead < *num) {
-		status_t status = _GetDirEntry(dirCookie->fIterator, &currentEntry,
-			&bufferBytesLeft);
+		// Skip entries which were removed while the directory is open
+		while (dirCookie->fIndex < fEntries.size()
+			&& fEntries[dirCookie->fIndex].fWasRemoved) {
+			dirCookie->fIndex++;
+		}
 
-		if (status == B_ENTRY_NOT_FOUND) {
+		if (dirCookie->fIndex >= fEntries.size()) {
 			// End of directory
 			break;
 		}
+
+		status_t status = _GetDirEntry(fEntries[dirCookie->fIndex],
+			&currentEntry, &bufferBytesLeft);
+
 		if (status == B_BUFFER_OVERFLOW) {
 			// Out of room for next entry
 			if (entriesRead == 0) {
@@ -340,7 +364,7 @@ DiscoveryNode::ReadDir(void* cookie, struct dirent* buffer, size_t bufferSize,
 			return status;
 		}
 
-		dirCookie->fIterator++;
+		dirCookie->fIndex++;
 		entriesRead++;
 	}
 
@@ -360,7 +384,7 @@ DiscoveryNode::FreeDirCookie(void* cookie)
 status_t
 DiscoveryNode::RewindDirCookie(void* cookie)
 {
-	static_cast<Cookie*>(cookie)->fIterator = fEntries.begin();
+	static_cast<Cookie*>(cookie)->fIndex = 0;
 	return B_OK;
 }
 
@@ -379,6 +403,20 @@ DiscoveryNode::Write(void*, off_t, const void*, size_t*)
 }
 
 
+status_t
+DiscoveryNode::IO(void*, io_request*)
+{
+	return B_IS_A_DIRECTORY;
+}
+
+
+status_t
+DiscoveryNode::CancelIO(void*, io_request*)
+{
+	return B_IS_A_DIRECTORY;
+}
+
+
 status_t
 DiscoveryNode::WriteStat(const struct stat*, uint32)
 {
@@ -422,13 +460,10 @@ DiscoveryNode::RemoveDir(const char*)
 
 
 status_t
-DiscoveryNode::_GetDirEntry(Entries::iterator it, struct dirent** destination,
+DiscoveryNode::_GetDirEntry(const Entry& entry, struct dirent** destination,
 	size_t* bufferBytesLeft)
 {
-	if (it == fEntries.end() || it->fWasRemoved)
-		return B_ENTRY_NOT_FOUND;
-
-	const Node* entryNode = it->fNode;
+	const Node* entryNode = entry.fNode;
 
 	size_t recordLength = sizeof(struct dirent) + strlen(entryNode->Name());
 	recordLength = (recordLength + 7) & -8;
@@ -436,7 +471,6 @@ DiscoveryNode::_GetDirEntry(Entries::iterator it, struct dirent** destination,
 	if (*bufferBytesLeft < recordLength)
 		return B_BUFFER_OVERFLOW;
 
-	BString url = _EntryURL(entryNode->Name());
 	(*destination)->d_dev = fVolume->ID();
 	(*destination)->d_pdev = 0;
 	(*destination)->d_ino = entryNode->ID();
@@ -453,15 +487,39 @@ DiscoveryNode::_GetDirEntry(Entries::iterator it, struct dirent** destination,
 }
 
 
-bool
-DiscoveryNode::_HasEntry(const char* name)
+/*! Must hold fLock
+*/
+void
+DiscoveryNode::_AddEntry(Node* node)
+{
+	fEntries.push_back(Entry(node));
+	fEntryIndex.Put(node->Name(), fEntries.size() - 1);
+}
+
+
+/*! Fills the gap with the last entry, so entries must not be removed while
+    anyone has the directory open. Must hold fLock.
+*/
+void
+DiscoveryNode::_RemoveEntryAt(uint32 index)
 {
-	// TODO: should be more efficient
-	for (Entries::iterator it = fEntries.begin(); it != fEntries.end(); it++) {
-		if (!it->fWasRemoved && strcmp(it->fNode->Name(), name) == 0)
-			return true;
+	const uint32 lastIndex = fEntries.size() - 1;
+	if (index != lastIndex) {
+		fEntries[index] = fEntries[lastIndex];
+		if (!fEntries[index].fWasRemoved)
+			fEntryIndex.Put(fEntries[index].fNode->Name(), index);
 	}
-	return false;
+	fEntries.pop_back();
+}
+
+
+/*! The node is deleted once the VFS doesn't hold it anymore.
+*/
+void
+DiscoveryNode::_RemoveEntryNode(Node* node)
+{
+	AutoLocker<Volume> locker(fVolume);
+	fVolume->RemoveNode(node);
 }
 
 
@@ -504,44 +562,22 @@ DiscoveryNode::_SetStatTimeToNow()
 void
 DiscoveryNode::_AddDotDirEntries()
 {
-	if (fName != NULL
-		&& (strcmp(fName, ".") == 0 || strcmp(fName, "..") == 0)) {
+	if (fName == "." || fName == "..") {
 		// "." and ".." dirs themselves don't get further dot dirs as children
 		return;
 	}
 
-	DiscoveryNode* entryNode = new(std::nothrow) DiscoveryNode(".", this);
-	Entry entry(entryNode);
-	fEntries.push_back(entry);
-
-	entryNode = new(std::nothrow) DiscoveryNode("..", fParent);
-	entry.fNode = entryNode;
-	fEntries.push_back(entry);
+	_AddEntry(new(std::nothrow) DiscoveryNode(".", this));
+	_AddEntry(new(std::nothrow) DiscoveryNode("..",
+		fParent != NULL ? static_cast<DiscoveryNode*>(fParent) : this));
 }
 
 
-BString
-DiscoveryNode::_EntryURL(const char* entryName)
+/*! Workgroups have servers as children, libsmbclient expects URLs to servers
+    and shares to exclude the workgroup in the path.
+*/
+bool
+DiscoveryNode::_IsInEntryURLs() const
 {
-	BString url;
-	switch (fType) {
-		case kNetwork:
-			// Root network node has "smb://" as URL, don't add another '/'
-			url = fURL;
-			url << entryName;
-			break;
-
-		case kWorkgroup:
-			// Workgroups have servers as children, libsmbclient expects URLs
-			// to servers and shares to exclude the workgroup in the path
-			url = fParent->URL();
-			url << entryName;
-			break;
-
-		default:
-			url = fURL;
-			url << "/" << entryName;
-			break;
-	}
-	return url;
+	return fType != kWorkgroup;
 }
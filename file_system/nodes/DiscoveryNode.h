@@ -10,6 +10,8 @@
 #include <ObjectList.h>
 #include <SupportDefs.h>
 
+#include <private/shared/HashMap.h>
+#include <private/shared/HashString.h>
 #include <sys/stat.h>
 
 #include <vector>
@@ -27,12 +29,12 @@ namespace Smb {
 class DiscoveryNode : public Node {
 public:
 								DiscoveryNode(Volume* volume,
-									SambaContext* context);
+									SambaContextPool* contextPool);
 									// for creating the network (FS root) node
 
-								DiscoveryNode(const BString& url,
-									size_t nameLength, const BString& comment,
-									NodeType type, DiscoveryNode* parent);
+								DiscoveryNode(const BString& name,
+									const BString& comment, NodeType type,
+									DiscoveryNode* parent);
 
 								DiscoveryNode(const char* name,
 									DiscoveryNode* prototype);
@@ -41,9 +43,12 @@ public:
 
 	virtual	NodeType			Type() const;
 
+	virtual	void				Delete(bool removed, bool reenter);
+
 	Node*						AddEntry(NodeType type, const BString& name,
 									const BString& comment);
 			ino_t				RemoveEntry(const BString& name);
+			void				GetEntryNames(std::vector<BString>& names);
 
 // --- FS hooks ---------------------------------------------------------------
 	virtual	status_t			ReadStat(struct stat* destination);
@@ -52,6 +57,8 @@ public:
 	virtual	status_t			Close(void* cookie);
 	virtual	status_t			FreeCookie(void* cookie);
 
+	virtual	status_t			Sync();
+
 	virtual	status_t			Lookup(const char* name, ino_t* outNodeID);
 
 	virtual	status_t			OpenDir(void** outCookie);
@@ -66,6 +73,8 @@ public:
 									size_t* length);
 	virtual	status_t			Write(void* cookie, off_t offset,
 									const void* buffer, size_t* length);
+	virtual	status_t			IO(void* cookie, io_request* request);
+	virtual	status_t			CancelIO(void* cookie, io_request* request);
 
 // --- write operations, all disallowed on discovery nodes --------------------
 	virtual	status_t			WriteStat(const struct stat* source,
@@ -80,39 +89,43 @@ public:
 									int permissions);
 	virtual	status_t			RemoveDir(const char* name);
 
+protected:
+	virtual	bool				_IsInEntryURLs() const;
+
 private:
 	struct Cookie;
 
 	struct Entry {
 								Entry(Node* node);
-								~Entry();
 
 			Node*				fNode;
 			bool				fWasRemoved;
 	};
 	typedef std::vector<Entry> Entries;
+	typedef HashMap<HashString, uint32> EntryIndex;
+		// name -> position in fEntries, for entries not removed
 
 private:
-			status_t			_GetDirEntry(Entries::iterator it,
+			status_t			_GetDirEntry(const Entry& entry,
 									struct dirent** destination,
 									size_t* bufferBytesLeft);
-			bool				_HasEntry(const char* name);
+			void				_AddEntry(Node* node);
+			void				_RemoveEntryAt(uint32 index);
+			void				_RemoveEntryNode(Node* node);
 
 			void				_FillStat();
 			void				_SetStatTimeToNow();
 			void				_AddDotDirEntries();
 
-			BString				_EntryURL(const char* entryName);
-
 private:
 			NodeType			fType;
 			struct stat*		fStat;
 			BLocker				fLock;
 			uint32				fDirOpenCount;
-			DiscoveryNode*		fParent;
 			BString				fComment;
 
 			Entries				fEntries;
+			EntryIndex			fEntryIndex;
 };
 
 
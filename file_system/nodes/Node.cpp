@@ -9,6 +9,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include "Volume.h"
@@ -27,61 +28,99 @@
 using namespace Smb;
 
 
-Node::Node(const BString& url, size_t nameLength, Volume* volume,
-	SambaContext* context)
+/*! Unless an ID is given (e.g. the one of an evicted node which is brought
+    back), the volume makes one for the entry.
+*/
+Node::Node(Node* parent, const char* name, ino_t id)
 	:
-	fVolume(volume),
-	fSambaContext(context),
-	fURL(url),
-	fName(fURL.String() + fURL.Length() - nameLength),
-	fID(fVolume->Lock() ? fVolume->MakeFreshNodeID() : (ino_t)kInvalidNodeID)
+	fVolume(parent->fVolume),
+	fSambaContextPool(parent->fSambaContextPool),
+	fParent(parent),
+	fName(name),
+	fID(id),
+	fChildCount(0),
+	fEvictable(false),
+	fReferenceState(kUnreferenced),
+	fUnused(false)
 {
-	assert(nameLength > 0);
-	assert((size_t)fURL.Length() > nameLength);
+	assert(name != NULL && name[0] != '\0');
 
-	fVolume->Unlock();
+	AutoLocker<Volume> locker(fVolume);
+	if (fID == kInvalidNodeID)
+		fID = fVolume->MakeNodeID(parent, name);
+	fVolume->AttachNode(this);
 }
 
 
-Node::Node(ino_t id, const BString& url, const char* name, Volume* volume,
-	SambaContext* context)
+Node::Node(ino_t id, const char* name, Volume* volume,
+	SambaContextPool* contextPool)
 	:
 	fVolume(volume),
-	fSambaContext(context),
-	fURL(url),
+	fSambaContextPool(contextPool),
+	fParent(NULL),
 	fName(name),
-	fID(id)
-{
-}
-
-
-Node::Node(const Node& prototype, const BString& newURL, size_t nameLength)
-	:
-	fVolume(prototype.fVolume),
-	fSambaContext(prototype.fSambaContext),
-	fURL(newURL),
-	fName(fURL.String() + fURL.Length() - nameLength),
-	fID(prototype.fID)
+	fID(id),
+	fChildCount(0),
+	fEvictable(false),
+	fReferenceState(kUnreferenced),
+	fUnused(false)
 {
 }
 
 
 Node::~Node()
 {
+	if (fParent != NULL) {
+		AutoLocker<Volume> locker(fVolume);
+		fVolume->DetachNode(this);
+	}
 }
 
 
+/*! Name of the node's entry in its directory. Volume must be locked if the
+    node can be renamed.
+*/
 const char*
 Node::Name() const
 {
-	return fName;
+	return fName.String();
 }
 
 
-const BString&
+/*! The URL isn't stored in the node, but built from the names along the
+    parent links. The volume keeps the ones used last, only the others take
+    the volume lock to be built.
+*/
+BString
 Node::URL() const
 {
-	return fURL;
+	BString url;
+	if (fVolume->URLs()->Get(fID, url))
+		return url;
+
+	AutoLocker<Volume> locker(fVolume);
+	url = _BuildURL(NULL);
+	fVolume->URLs()->Put(fID, url);
+	return url;
+}
+
+
+/*! URL of an entry of this (directory) node.
+*/
+BString
+Node::EntryURL(const char* entryName) const
+{
+	if (!_IsInEntryURLs()) {
+		AutoLocker<Volume> locker(fVolume);
+		return _BuildURL(entryName);
+	}
+
+	BString url(URL());
+	if (url.String()[url.Length() - 1] != '/')
+		url << '/';
+			// the root's URL ends with one
+	url << entryName;
+	return url;
 }
 
 
@@ -103,23 +142,88 @@ Node::StatType() const
 
 
 void
-Node::Delete(bool, bool reenter)
+Node::Delete(bool removed, bool reenter)
 {
-	TRACE("ID=0x%" B_PRIx64 " URL=%s reenter=%d", fID, fURL.String(),
-		reenter);
+	TRACE("ID=0x%" B_PRIx64 " name=%s removed=%d reenter=%d", fID,
+		fName.String(), removed, reenter);
 
 	AutoLocker<Volume> locker(fVolume, reenter);
-	fVolume->ForgetNode(fURL);
-	locker.Unlock();
 
-	delete this;
+	if (!removed && fEvictable) {
+		// The VFS is done with it, but the volume keeps it around (and its
+		// ID) until the memory is needed for other nodes
+		fVolume->ReleaseNode(this);
+		return;
+	}
+
+	fVolume->ForgetNode(this);
+	fVolume->DeleteNode(this);
 }
 
 
+/*! Whether the node's name is part of the URLs of its entries. It doesn't
+    change over the node's life.
+*/
+bool
+Node::_IsInEntryURLs() const
+{
+	return true;
+}
+
+
+/*! Builds "smb://" followed by the names along the parent links (and the
+    entry name, if given), in a buffer of exactly the right size. The parent
+    links are walked twice instead of appending piece by piece, deep paths
+    would otherwise reallocate the string once per component. Volume must be
+    locked.
+*/
 BString
-Node::_EntryURL(const char* entryName)
+Node::_BuildURL(const char* entryName) const
 {
-	BString url(fURL);
-	url << "/" << entryName;
+	static const char kPrefix[] = "smb://";
+	const int32 prefixLength = sizeof(kPrefix) - 1;
+
+	int32 length = prefixLength;
+	int32 components = 0;
+	if (entryName != NULL) {
+		length += strlen(entryName);
+		components++;
+	}
+	for (const Node* node = this; node->fParent != NULL;
+			node = node->fParent) {
+		if ((node == this && entryName == NULL) || node->_IsInEntryURLs()) {
+			length += node->fName.Length();
+			components++;
+		}
+	}
+	if (components > 1)
+		length += components - 1;
+			// separating slashes
+
+	BString url;
+	char* const buffer = url.LockBuffer(length);
+	if (buffer == NULL)
+		return url;
+
+	char* end = buffer + length;
+	if (entryName != NULL) {
+		const int32 entryLength = strlen(entryName);
+		end -= entryLength;
+		memcpy(end, entryName, entryLength);
+	}
+	for (const Node* node = this; node->fParent != NULL;
+			node = node->fParent) {
+		if ((node == this && entryName == NULL) || node->_IsInEntryURLs()) {
+			if (end != buffer + length)
+				*--end = '/';
+			end -= node->fName.Length();
+			memcpy(end, node->fName.String(), node->fName.Length());
+		}
+	}
+	assert(end == buffer + prefixLength);
+	memcpy(buffer, kPrefix, prefixLength);
+
+	url.UnlockBuffer(length);
 	return url;
 }
+
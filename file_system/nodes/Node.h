@@ -9,6 +9,9 @@
 #include <String.h>
 #include <SupportDefs.h>
 
+#include <fs_interface.h>
+#include <private/shared/DoublyLinkedList.h>
+
 #include "NodeDefs.h"
 
 
@@ -19,28 +22,27 @@ struct stat;
 namespace Smb {
 
 
-class SambaContext;
+class SambaContextPool;
 class Volume;
 
 
 /*! Interface for all node types. Defines methods for all node-specific
     operations.
 */
-class Node {
+class Node : public DoublyLinkedListLinkImpl<Node> {
 public:
-								Node(const BString& url, size_t nameLength,
-									Volume* volume, SambaContext* context);
-
-								Node(ino_t id, const BString& url,
-									const char* name, Volume* volume,
-									SambaContext* context);
+								Node(Node* parent, const char* name,
+									ino_t id = kInvalidNodeID);
 
-								Node(const Node& prototype,
-									const BString& newURL, size_t nameLength);
+								Node(ino_t id, const char* name,
+									Volume* volume,
+									SambaContextPool* contextPool);
+									// for nodes without a parent
 
 	virtual						~Node();
 
-			const BString&		URL() const;
+			BString				URL() const;
+			BString				EntryURL(const char* entryName) const;
 			const char*			Name() const;
 			ino_t				ID() const;
 
@@ -48,7 +50,6 @@ public:
 			mode_t				StatType() const;
 
 	virtual	void				Delete(bool removed, bool reenter);
-			void				MovedTo(const BString& newURL);
 
 // ----- FS hooks: all nodes --------------------------------------------------
 	virtual	status_t			ReadStat(struct stat* destination) = 0;
@@ -59,11 +60,16 @@ public:
 	virtual	status_t			Close(void* cookie) = 0;
 	virtual	status_t			FreeCookie(void* cookie) = 0;
 
+	virtual	status_t			Sync() = 0;
+
 // ----- FS hooks: file nodes -------------------------------------------------
 	virtual	status_t			Read(void* cookie, off_t offset, void* buffer,
 									size_t* length) = 0;
 	virtual	status_t			Write(void* cookie, off_t offset,
 									const void* buffer, size_t* length) = 0;
+	virtual	status_t			IO(void* cookie, io_request* request) = 0;
+	virtual	status_t			CancelIO(void* cookie,
+									io_request* request) = 0;
 
 // ----- FS hooks: directory nodes --------------------------------------------
 	virtual	status_t			Lookup(const char* name, ino_t* outNodeID) = 0;
@@ -87,16 +93,42 @@ public:
 	virtual	status_t			RemoveDir(const char* name) = 0;
 
 protected:
-			BString				_EntryURL(const char* entryName);
+	virtual	bool				_IsInEntryURLs() const;
+
+private:
+			BString				_BuildURL(const char* entryName) const;
 
 protected:
+	enum {
+		kUnreferenced = 0,
+		kReferenced   = 1,
+			// the VFS holds the node
+		kDead         = -1
+			// claimed for deletion, must not be referenced anymore
+	};
 
+protected:
 			Volume*	const		fVolume;
-			SambaContext* const	fSambaContext;
-
-			const BString		fURL;
-			const char*	const	fName;
-			const ino_t			fID;
+			SambaContextPool* const fSambaContextPool;
+
+			Node*				fParent;
+				// directory this node is an entry of, NULL for the root
+			BString				fName;
+			ino_t				fID;
+				// parent and name change on renames, volume must be locked
+
+			int32				fChildCount;
+				// nodes whose parent this is, it must stay around for them
+			bool				fEvictable;
+				// set by the volume for nodes it may evict when unused
+			int32				fReferenceState;
+				// the VFS may reference the node without locking the volume,
+				// so this is changed atomically
+			bool				fUnused;
+				// in the volume's list of nodes to evict
+
+private:
+	friend class Volume;
 };
 
 
@@ -0,0 +1,465 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "ReadAhead.h"
+
+#include <private/shared/AutoLocker.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SambaContext.h"
+#include "SambaContextPool.h"
+#include "Volume.h"
+
+
+//#define TRACE_READ_AHEAD
+#ifdef TRACE_READ_AHEAD
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [ReadAhead %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+// #pragma mark - ReadAhead::Block
+
+
+struct ReadAhead::Block {
+	enum State {
+		kQueued,
+		kLoading,
+		kReady
+	};
+
+	Block(off_t offset, size_t size, uint8* data)
+		:
+		fOffset(offset),
+		fSize(size),
+		fLength(0),
+		fData(data),
+		fState(kQueued),
+		fStatus(B_OK),
+		fCanceled(false)
+	{
+	}
+
+	~Block()
+	{
+		free(fData);
+	}
+
+	off_t End() const
+	{
+		return fOffset + fSize;
+	}
+
+	off_t			fOffset;
+	size_t			fSize;
+	size_t			fLength;
+		// bytes actually read, less than fSize at end of file
+	uint8*			fData;
+	State			fState;
+	status_t		fStatus;
+	bool			fCanceled;
+		// dropped while the worker was loading it, worker frees it
+};
+
+
+// #pragma mark - ReadAhead
+
+
+ReadAhead::ReadAhead(Volume* volume, SambaContext* context, SMBCFILE* file,
+	off_t* position, size_t blockSize)
+	:
+	fVolume(volume),
+	fContext(context),
+	fFile(file),
+	fPosition(position),
+	fBlockSize(blockSize),
+	fWorkSem(-1),
+	fReadySem(-1),
+	fWaiters(0),
+	fWorker(-1),
+	fStopped(false),
+	fNextOffset(-1),
+	fEndOfFile(-1),
+	fSequentialReads(0),
+	fWindow(kMinWindow),
+	fThroughput(0)
+{
+}
+
+
+ReadAhead::~ReadAhead()
+{
+	Stop();
+
+	if (fWorkSem >= 0)
+		delete_sem(fWorkSem);
+	if (fReadySem >= 0)
+		delete_sem(fReadySem);
+}
+
+
+/*! Serves as much of the read as possible from loaded blocks. On return,
+    *length is the number of bytes copied into buffer. If *outComplete is
+    false, the caller has to read the remaining bytes from the server itself.
+*/
+status_t
+ReadAhead::Read(off_t offset, void* buffer, size_t* length, bool* outComplete)
+{
+	const size_t requested = *length;
+	*length = 0;
+	*outComplete = false;
+
+	AutoLocker<BLocker> locker(fLock);
+
+	if (fStopped)
+		return B_OK;
+
+	const bool sequential = offset == fNextOffset;
+	fNextOffset = offset + requested;
+
+	if (!sequential) {
+		TRACE("random access at %" B_PRIdOFF ", drop read-ahead", offset);
+		fSequentialReads = 0;
+		_DropBlocks();
+		return B_OK;
+	}
+
+	if (fSequentialReads < kSequentialThreshold) {
+		if (++fSequentialReads == kSequentialThreshold
+			&& _StartWorker() == B_OK) {
+			TRACE("sequential access detected, start at %" B_PRIdOFF,
+				fNextOffset);
+			_Schedule(fNextOffset);
+		}
+		return B_OK;
+	}
+
+	uint8* destination = static_cast<uint8*>(buffer);
+	off_t current = offset;
+	size_t bytesLeft = requested;
+	status_t status = B_OK;
+
+	while (bytesLeft > 0 && !fStopped) {
+		// Forget blocks the stream has already moved past (the caller read
+		// that part directly because we weren't far enough yet)
+		while (!fBlocks.empty() && fBlocks.front()->End() <= current) {
+			_DropBlock(fBlocks.front());
+			fBlocks.pop_front();
+		}
+
+		if (fEndOfFile >= 0 && current >= fEndOfFile) {
+			*outComplete = true;
+			break;
+		}
+
+		if (fBlocks.empty() || fBlocks.front()->fOffset > current) {
+			// Nothing loaded for this part, caller has to read it directly
+			break;
+		}
+
+		Block* const block = fBlocks.front();
+		if (block->fState != Block::kReady) {
+			// Reader is faster than the server, wait for the worker
+			fWaiters++;
+			locker.Unlock();
+			acquire_sem(fReadySem);
+			locker.Lock();
+			continue;
+		}
+
+		if (block->fStatus != B_OK) {
+			if (*length == 0)
+				status = block->fStatus;
+			*outComplete = true;
+			_DropBlocks();
+			break;
+		}
+
+		const size_t blockOffset = current - block->fOffset;
+		if (blockOffset >= block->fLength) {
+			// Short block, end of file
+			*outComplete = true;
+			break;
+		}
+
+		const size_t bytesToCopy = min_c(bytesLeft,
+			block->fLength - blockOffset);
+		memcpy(destination, block->fData + blockOffset, bytesToCopy);
+
+		destination += bytesToCopy;
+		current += bytesToCopy;
+		bytesLeft -= bytesToCopy;
+		*length += bytesToCopy;
+
+		if (blockOffset + bytesToCopy == block->fSize) {
+			fBlocks.pop_front();
+			_DropBlock(block);
+		}
+	}
+
+	if (bytesLeft == 0)
+		*outComplete = true;
+
+	if (!fStopped && status == B_OK)
+		_Schedule(fNextOffset);
+
+	return status;
+}
+
+
+/*! Drops all loaded data, e.g. because the file was written to.
+*/
+void
+ReadAhead::Invalidate()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	fNextOffset = -1;
+	fEndOfFile = -1;
+	fSequentialReads = 0;
+	_DropBlocks();
+}
+
+
+/*! Stops the worker thread. Must be called before the file handle is closed.
+*/
+void
+ReadAhead::Stop()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	if (fStopped)
+		return;
+
+	fStopped = true;
+	_DropBlocks();
+
+	thread_id worker = fWorker;
+	fWorker = -1;
+	if (worker >= 0)
+		release_sem(fWorkSem);
+	locker.Unlock();
+
+	if (worker >= 0) {
+		status_t result;
+		wait_for_thread(worker, &result);
+	}
+}
+
+
+/*static*/ status_t
+ReadAhead::_WorkerEntry(void* data)
+{
+	static_cast<ReadAhead*>(data)->_Worker();
+	return B_OK;
+}
+
+
+void
+ReadAhead::_Worker()
+{
+	for (;;) {
+		if (acquire_sem(fWorkSem) != B_OK)
+			return;
+
+		AutoLocker<BLocker> locker(fLock);
+		if (fStopped)
+			return;
+
+		Block* block = NULL;
+		for (BlockList::iterator it = fBlocks.begin(); it != fBlocks.end();
+				it++) {
+			if ((*it)->fState == Block::kQueued) {
+				block = *it;
+				break;
+			}
+		}
+		if (block == NULL)
+			continue;
+
+		block->fState = Block::kLoading;
+		locker.Unlock();
+
+		const bigtime_t startTime = system_time();
+		size_t length = block->fSize;
+		SambaContextLease context(fContext);
+		status_t status = context->ReadAt(fFile, fPosition, block->fOffset,
+			block->fData, &length);
+		context.Release();
+		const bigtime_t duration = system_time() - startTime;
+
+		locker.Lock();
+
+		if (block->fCanceled) {
+			_FreeBlock(block);
+			continue;
+		}
+
+		block->fState = Block::kReady;
+		block->fStatus = status;
+		block->fLength = status == B_OK ? length : 0;
+
+		if (status == B_OK) {
+			_UpdateWindow(length, duration);
+
+			if (length < block->fSize) {
+				// Hit the end of the file, nothing to load behind this block
+				fEndOfFile = block->fOffset + length;
+				while (fBlocks.back() != block) {
+					_DropBlock(fBlocks.back());
+					fBlocks.pop_back();
+				}
+			}
+		}
+
+		_WakeWaiters();
+	}
+}
+
+
+status_t
+ReadAhead::_StartWorker()
+{
+	if (fWorker >= 0)
+		return B_OK;
+
+	if (fWorkSem < 0) {
+		fWorkSem = create_sem(0, "smb read-ahead work");
+		if (fWorkSem < 0)
+			return fWorkSem;
+	}
+	if (fReadySem < 0) {
+		fReadySem = create_sem(0, "smb read-ahead ready");
+		if (fReadySem < 0)
+			return fReadySem;
+	}
+
+	fWorker = spawn_thread(&_WorkerEntry, "smb read-ahead", B_NORMAL_PRIORITY,
+		this);
+	if (fWorker < 0) {
+		status_t status = fWorker;
+		fWorker = -1;
+		return status;
+	}
+	return resume_thread(fWorker);
+}
+
+
+/*! Queues blocks behind offset until the window is full.
+*/
+void
+ReadAhead::_Schedule(off_t offset)
+{
+	if (fWorker < 0)
+		return;
+
+	off_t next = fBlocks.empty() ? offset : fBlocks.back()->End();
+
+	while (fBlocks.size() < fWindow) {
+		if (fEndOfFile >= 0 && next >= fEndOfFile)
+			break;
+
+		if (!fVolume->ReserveBufferMemory(fBlockSize)) {
+			// Over the volume's budget, make do with what we have
+			fWindow = max_c(fBlocks.size(), 1);
+			break;
+		}
+
+		uint8* data = static_cast<uint8*>(malloc(fBlockSize));
+		Block* block = data != NULL
+			? new(std::nothrow) Block(next, fBlockSize, data) : NULL;
+		if (block == NULL) {
+			free(data);
+			fVolume->UnreserveBufferMemory(fBlockSize);
+			break;
+		}
+
+		fBlocks.push_back(block);
+		release_sem(fWorkSem);
+		next = block->End();
+	}
+}
+
+
+void
+ReadAhead::_WakeWaiters()
+{
+	if (fWaiters > 0) {
+		release_sem_etc(fReadySem, fWaiters, 0);
+		fWaiters = 0;
+	}
+}
+
+
+void
+ReadAhead::_DropBlocks()
+{
+	for (BlockList::iterator it = fBlocks.begin(); it != fBlocks.end(); it++)
+		_DropBlock(*it);
+	fBlocks.clear();
+
+	// Readers waiting for one of the blocks need to re-check
+	_WakeWaiters();
+}
+
+
+/*! Caller removes the block from fBlocks.
+*/
+void
+ReadAhead::_DropBlock(Block* block)
+{
+	if (block->fState == Block::kLoading)
+		block->fCanceled = true;
+	else
+		_FreeBlock(block);
+}
+
+
+void
+ReadAhead::_FreeBlock(Block* block)
+{
+	delete block;
+	fVolume->UnreserveBufferMemory(fBlockSize);
+}
+
+
+/*! Sizes the window so that it holds kTargetLeadTime worth of data at the
+    transfer rate we currently get from the server: fast links get a deep
+    window to ride out hiccups, slow links don't tie up memory.
+*/
+void
+ReadAhead::_UpdateWindow(size_t bytes, bigtime_t duration)
+{
+	if (duration <= 0)
+		duration = 1;
+
+	const int64 throughput = (int64)bytes * 1000000 / duration;
+	if (fThroughput == 0)
+		fThroughput = throughput;
+	else
+		fThroughput = (fThroughput * 3 + throughput) / 4;
+
+	int64 window = fThroughput * kTargetLeadTime / 1000000 / fBlockSize;
+	if (window < kMinWindow)
+		window = kMinWindow;
+	else if (window > kMaxWindow)
+		window = kMaxWindow;
+
+	if ((uint32)window != fWindow) {
+		TRACE("throughput %" B_PRId64 " bytes/s, window %" B_PRId64
+			" blocks", fThroughput, window);
+	}
+	fWindow = window;
+}
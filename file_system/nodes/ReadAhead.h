@@ -0,0 +1,100 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_READ_AHEAD_H
+#define SMBFS_READ_AHEAD_H
+
+#include <Locker.h>
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include <libsmbclient.h>
+
+#include <deque>
+
+
+namespace Smb {
+
+
+class SambaContext;
+class Volume;
+
+
+/*! Read-ahead stage of an open file. Once a sequential stream of reads is
+    detected, a worker thread keeps a window of the following blocks loaded,
+    so reads can be served from memory instead of waiting for the server.
+    The window size follows the measured transfer rate, and all buffers are
+    accounted against the volume's buffer memory budget.
+    Only cookies opened with O_NOCACHE have one, the others read through the
+    file cache.
+*/
+class ReadAhead {
+public:
+								ReadAhead(Volume* volume,
+									SambaContext* context, SMBCFILE* file,
+									off_t* position, size_t blockSize);
+								~ReadAhead();
+
+			status_t			Read(off_t offset, void* buffer,
+									size_t* length, bool* outComplete);
+			void				Invalidate();
+			void				Stop();
+
+private:
+	struct Block;
+	typedef std::deque<Block*> BlockList;
+
+	enum {
+		kSequentialThreshold = 2,
+			// sequential reads before read-ahead kicks in
+		kMinWindow           = 2,
+		kMaxWindow           = 32,
+			// in blocks
+		kTargetLeadTime      = 500 * 1000
+			// µsec, how much data (at the measured rate) to keep buffered
+	};
+
+private:
+	static	status_t			_WorkerEntry(void* data);
+			void				_Worker();
+
+			status_t			_StartWorker();
+			void				_Schedule(off_t offset);
+			void				_WakeWaiters();
+			void				_DropBlocks();
+			void				_DropBlock(Block* block);
+			void				_FreeBlock(Block* block);
+			void				_UpdateWindow(size_t bytes,
+									bigtime_t duration);
+
+private:
+			Volume*				fVolume;
+			SambaContext*		fContext;
+			SMBCFILE*			fFile;
+			off_t*				fPosition;
+				// handle position, protected by fContext's lock
+			size_t				fBlockSize;
+
+			BLocker				fLock;
+			sem_id				fWorkSem;
+			sem_id				fReadySem;
+			int32				fWaiters;
+			thread_id			fWorker;
+			bool				fStopped;
+
+			off_t				fNextOffset;
+			off_t				fEndOfFile;
+			uint32				fSequentialReads;
+			uint32				fWindow;
+			int64				fThroughput;
+				// bytes/sec, moving average
+			BlockList			fBlocks;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_READ_AHEAD_H
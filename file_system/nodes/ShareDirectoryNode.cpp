@@ -10,10 +10,13 @@
 
 #include <assert.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "SambaContext.h"
+#include "SambaContextPool.h"
 #include "ShareFileNode.h"
 #include "Volume.h"
 
@@ -31,35 +34,57 @@
 using namespace Smb;
 
 
+/*! Builds the stat which libsmbclient's stat() would return for a directory
+    entry, from the information readdirplus() gave us.
+*/
+static void
+file_info_to_stat(const struct libsmb_file_info* info, struct stat* st)
+{
+	memset(st, 0, sizeof(*st));
+
+	const bool isDirectory = (info->attrs & SMBC_DOS_MODE_DIRECTORY) != 0;
+	st->st_mode = isDirectory ? (S_IFDIR | 0555) : (S_IFREG | 0444);
+	if ((info->attrs & SMBC_DOS_MODE_READONLY) == 0)
+		st->st_mode |= S_IWUSR;
+	st->st_nlink = isDirectory ? 2 : 1;
+	st->st_uid = getuid();
+	st->st_gid = getgid();
+	st->st_size = info->size;
+	st->st_blocks = (info->size + 511) / 512;
+	st->st_atim = info->atime_ts;
+	st->st_mtim = info->mtime_ts;
+	st->st_ctim = info->ctime_ts;
+	st->st_crtim = info->btime_ts;
+}
+
+
 // #pragma mark - ShareDirectoryNode::Cookie
 
 
 struct ShareDirectoryNode::Cookie {
 	Cookie()
 		:
-		fDirectoryHandle(NULL)
+		fContext(NULL),
+		fDirectoryHandle(NULL),
+		fStatListing(0)
 	{
 	}
 
-	SMBCFILE* fDirectoryHandle;
+	SambaContext*	fContext;
+		// context the directory handle belongs to
+	SMBCFILE*		fDirectoryHandle;
+	uint32			fStatListing;
+		// keeps the stat data of the entries read so far in the stat cache
 };
 
 
 // #pragma mark - ShareDirectoryNode
 
 
-ShareDirectoryNode::ShareDirectoryNode(const BString& url, size_t nameLength,
-	Volume* volume, SambaContext* context)
-	:
-	ShareNode(url, nameLength, volume, context)
-{
-}
-
-
-ShareDirectoryNode::ShareDirectoryNode(const ShareDirectoryNode& prototype,
-	const BString& newURL, size_t nameLength)
+ShareDirectoryNode::ShareDirectoryNode(Node* parent, const char* name,
+	ino_t id)
 	:
-	ShareNode(prototype, newURL, nameLength)
+	ShareNode(parent, name, id)
 {
 }
 
@@ -79,16 +104,16 @@ ShareDirectoryNode::Type() const
 void
 ShareDirectoryNode::Delete(bool removed, bool reenter)
 {
-	TRACE("ID=0x%" B_PRIx64 " URL=%s removed=%d reenter=%d\n", fID,
-		fURL.String(), removed, reenter);
+	TRACE("ID=0x%" B_PRIx64 " name=%s removed=%d reenter=%d\n", fID,
+		fName.String(), removed, reenter);
 
 	// Unless the directory itself was removed (i.e. actually removed in the
-	// file share), do nothing here. If the VFS only removed the vnode from its
-	// cache (i.e. put_vnode()), but the directory still exists,  we need to
-	// keep the node instance around. Applications can still hold a node_ref
-	// and create a BDirectory from it at any time and we need to remember
-	// the ID->URL mapping then.
-	if (removed)
+	// file share) or the volume can bring it back by its ID, do nothing here.
+	// If the VFS only removed the vnode from its cache (i.e. put_vnode()), but
+	// the directory still exists,  we need to keep the node instance around.
+	// Applications can still hold a node_ref and create a BDirectory from it
+	// at any time and we need to remember the ID->URL mapping then.
+	if (removed || fEvictable)
 		Node::Delete(removed, reenter);
 }
 
@@ -97,10 +122,9 @@ status_t
 ShareDirectoryNode::Open(int, void**)
 {
 	// Samba won't allow us to open() a directory, so to just verify that
-	// the path exists, we do a stat() on it
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
+	// the path exists, we do a stat() on it. A recent one will do.
 	struct stat st;
-	return fSambaContext->Stat(fURL, &st);
+	return ReadStat(&st);
 }
 
 
@@ -112,6 +136,13 @@ ShareDirectoryNode::Close(void*)
 }
 
 
+status_t
+ShareDirectoryNode::FreeCookie(void*)
+{
+	return B_OK;
+}
+
+
 // #pragma mark - File-only, just fail
 
 
@@ -129,62 +160,69 @@ ShareDirectoryNode::Write(void*, off_t, const void*, size_t*)
 }
 
 
+status_t
+ShareDirectoryNode::IO(void*, io_request*)
+{
+	return B_IS_A_DIRECTORY;
+}
+
+
+status_t
+ShareDirectoryNode::CancelIO(void*, io_request*)
+{
+	return B_IS_A_DIRECTORY;
+}
+
+
 // #pragma mark - Directory-only
 
 
 status_t
 ShareDirectoryNode::Lookup(const char* name, ino_t* outNodeID)
 {
-	BString url(_EntryURL(name));
-	TRACE("URL=%s", url.String());
-
 	if (strcmp(name, ".") == 0) {
 		*outNodeID = fID;
 		return B_OK;
 	} else if (strcmp(name, "..") == 0) {
-		BString parentURL = fURL;
-		int32 lastSlashPosition = parentURL.FindLast('/');
-		parentURL.Remove(lastSlashPosition,
-			parentURL.Length() - lastSlashPosition);
 		AutoLocker<Volume> volumeLocker(fVolume);
-		*outNodeID = fVolume->RecallNode(parentURL)->ID();
+		*outNodeID = _ParentID();
 		return B_OK;
 	}
 
+	if (fVolume->MissingEntries()->Contains(fID, name))
+		return B_ENTRY_NOT_FOUND;
+
+	const uint32 generation = fVolume->Stats()->Generation();
+	const BString url(EntryURL(name));
+	TRACE("URL=%s", url.String());
+
+	SambaContextLease context(fSambaContextPool, url);
+	status_t status = context.InitCheck();
+	if (status != B_OK)
+		return status;
+
 	struct stat st;
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	status_t status = fSambaContext->Stat(url, &st);
-	sambaLocker.Unlock();
+	status = context->Stat(url, &st);
+	context.Release();
 
 	if (status != B_OK) {
 		TRACE("lookup error: %s (0x%lx)", strerror(status), status);
+		if (status == B_ENTRY_NOT_FOUND)
+			fVolume->MissingEntries()->Add(fID, name);
 		return status;
 	}
 
 	AutoLocker<Volume> volumeLocker(fVolume);
 
-	Node* node = fVolume->RecallNode(url);
-	if (node == NULL) {
-		if (S_ISDIR(st.st_mode)) {
-			TRACE("lookup %s -> is directory", url.String());
-
-			node = new(std::nothrow) ShareDirectoryNode(url, strlen(name),
-				fVolume, fSambaContext);
-		} else {
-			TRACE("lookup %s -> is file", url.String());
-
-			node = new(std::nothrow) ShareFileNode(url, strlen(name),
-				fVolume, fSambaContext);
-		}
-		if (node == NULL)
-			return B_NO_MEMORY;
-
-		fVolume->MemorizeNode(node);
-	} else {
-		TRACE("recalled node ID 0x%" B_PRIx64, node->ID());
-	}
+	Node* const node = _InternNode(name, S_ISDIR(st.st_mode));
+	if (node == NULL)
+		return B_NO_MEMORY;
 
 	*outNodeID = node->ID();
+	volumeLocker.Unlock();
+
+	// The VFS usually asks for the stat right after a lookup
+	_CacheStat(*outNodeID, &st, generation);
 
 	return B_OK;
 }
@@ -194,24 +232,55 @@ status_t
 ShareDirectoryNode::Create(const char* name, int openMode, int,
 	void** outCookie, ino_t* outNodeID)
 {
-	BString url(_EntryURL(name));
+	const BString url(EntryURL(name));
 
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	SMBCFILE* file = NULL;
-	status_t status = fSambaContext->Create(url, openMode, &file);
-	sambaLocker.Unlock();
+	const bool ownContext = ShareFileNode::NeedsOwnContext(openMode);
+	SambaContextLease context(fSambaContextPool, url, ownContext);
+	status_t status = context.InitCheck();
 	if (status != B_OK)
 		return status;
 
+	SambaContext* const fileContext = context.Get();
+	SMBCFILE* file = NULL;
+	status = context->Create(url, openMode, &file);
+	context.Release();
+	if (status != B_OK) {
+		if (ownContext)
+			delete fileContext;
+		return status;
+	}
+
+	// The file may have existed already (no O_EXCL), then we know its node
 	AutoLocker<Volume> volumeLocker(fVolume);
-	Node* const node = new(std::nothrow) ShareFileNode(url, strlen(name),
-		fVolume, fSambaContext);
-	fVolume->MemorizeNode(node);
+	ShareFileNode* const node = dynamic_cast<ShareFileNode*>(
+		_InternNode(name, false));
+	// Keep the volume from evicting it before the VFS gets it
+	const bool referenced = node != NULL && fVolume->ReferenceNode(node);
 	volumeLocker.Unlock();
 
-	*outCookie = (void*)file;
+	// Creating truncates a file that existed already
+	status = node != NULL
+		? node->AdoptFile(fileContext, file, openMode | O_TRUNC, outCookie)
+		: B_NO_MEMORY;
+	if (status != B_OK) {
+		if (referenced) {
+			volumeLocker.Lock();
+			fVolume->ReleaseNode(node);
+			volumeLocker.Unlock();
+		}
+		SambaContextLease fileContextLease(fileContext);
+		fileContextLease->Close(file);
+		fileContextLease.Release();
+		if (ownContext)
+			delete fileContext;
+		return status;
+	}
+
 	*outNodeID = node->ID();
 
+	fVolume->Stats()->Invalidate(fID);
+	fVolume->MissingEntries()->RemoveDirectory(fID);
+
 	notify_entry_created(fVolume->ID(), fID, name, node->ID());
 
 	return B_OK;
@@ -221,22 +290,31 @@ ShareDirectoryNode::Create(const char* name, int openMode, int,
 status_t
 ShareDirectoryNode::Remove(const char* name)
 {
-	BString url(_EntryURL(name));
+	const BString url(EntryURL(name));
 
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	status_t status = fSambaContext->Unlink(url);
-	sambaLocker.Unlock();
+	// The server won't delete a file the I/O workers still have open
+	fVolume->IO()->CloseFiles(url);
 
+	SambaContextLease context(fSambaContextPool, url);
+	status_t status = context.InitCheck();
 	if (status != B_OK)
 		return status;
 
-	AutoLocker<Volume> volumeLocker(fVolume);
-	Node* const removedNode = fVolume->RecallNode(url);
+	status = context->Unlink(url);
+	context.Release();
 
-	remove_vnode(fVolume->VFSVolume(), removedNode->ID());
+	if (status != B_OK)
+		return status;
+
+	AutoLocker<Volume> volumeLocker(fVolume);
+	const ino_t removedID = _RemoveEntryNode(this, name);
 	volumeLocker.Unlock();
 
-	notify_entry_removed(fVolume->ID(), fID, name, removedNode->ID());
+	fVolume->Stats()->Invalidate(fID);
+	if (removedID != kInvalidNodeID) {
+		fVolume->Stats()->Invalidate(removedID);
+		notify_entry_removed(fVolume->ID(), fID, name, removedID);
+	}
 
 	return B_OK;
 }
@@ -245,13 +323,19 @@ ShareDirectoryNode::Remove(const char* name)
 status_t
 ShareDirectoryNode::OpenDir(void** outCookie)
 {
-	*outCookie = new(std::nothrow) Cookie;
+	Cookie* const cookie = new(std::nothrow) Cookie;
+	if (cookie == NULL)
+		return B_NO_MEMORY;
 
 	status_t status = Open(0, NULL);
-	if (status != B_OK)
-		delete static_cast<Cookie*>(*outCookie);
+	if (status != B_OK) {
+		delete cookie;
+		return status;
+	}
 
-	return status;
+	cookie->fStatListing = fVolume->Stats()->StartListing();
+	*outCookie = cookie;
+	return B_OK;
 }
 
 
@@ -261,8 +345,8 @@ ShareDirectoryNode::CloseDir(void* cookie)
 	Cookie* const dirCookie = static_cast<Cookie*>(cookie);
 	if (dirCookie->fDirectoryHandle == NULL)
 		return B_OK;
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	return fSambaContext->CloseDir(dirCookie->fDirectoryHandle);
+	SambaContextLease context(dirCookie->fContext);
+	return context->CloseDir(dirCookie->fDirectoryHandle);
 }
 
 
@@ -270,59 +354,63 @@ status_t
 ShareDirectoryNode::Rename(const char* fromName, Node* toDir,
 	const char* toName)
 {
-	BString fromURL(_EntryURL(fromName));
-	BString toURL(toDir->URL());
-	toURL << "/" << toName;
+	const BString fromURL(EntryURL(fromName));
+	const BString toURL(toDir->EntryURL(toName));
 
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	status_t status = fSambaContext->Rename(fromURL, toURL);
-	sambaLocker.Unlock();
+	// Neither the entry, nor the one it replaces, nor any file below them
+	// may still be open by the I/O workers
+	fVolume->IO()->CloseFiles(fromURL);
+	fVolume->IO()->CloseFiles(toURL);
 
+	SambaContextLease context(fSambaContextPool, fromURL);
+	status_t status = context.InitCheck();
 	if (status != B_OK)
 		return status;
 
+	status = context->Rename(fromURL, toURL);
+	context.Release();
+
+	if (status != B_OK)
+		return status;
+
+	fVolume->Stats()->Invalidate(fID);
+	fVolume->Stats()->Invalidate(toDir->ID());
+	fVolume->MissingEntries()->RemoveDirectory(toDir->ID());
+
 	AutoLocker<Volume> volumeLocker(fVolume);
-	Node* overwritteNode = fVolume->RecallNode(toURL);
-	if (overwritteNode != NULL) {
+	const ino_t overwrittenID = _RemoveEntryNode(toDir, toName);
+	if (overwrittenID != kInvalidNodeID) {
 		// toURL already existed, node was overwritten
-		remove_vnode(fVolume->VFSVolume(), overwritteNode->ID());
-		notify_entry_removed(fVolume->ID(), fID, toName, overwritteNode->ID());
+		fVolume->Stats()->Invalidate(overwrittenID);
+		notify_entry_removed(fVolume->ID(), toDir->ID(), toName,
+			overwrittenID);
 	}
 
-	Node* oldNode = fVolume->RecallNode(fromURL);
-	if (oldNode == NULL)
+	Node* const node = fVolume->RecallNode(this, fromName);
+	if (node == NULL) {
+		// Node was evicted, its ID moves along with the entry. Node monitors
+		// may still watch it by that ID.
+		const ino_t id = fVolume->MoveEvictedNode(fID, fromName, toDir->ID(),
+			toName);
+		volumeLocker.Unlock();
+
+		if (id != kInvalidNodeID) {
+			fVolume->Stats()->Invalidate(id);
+			notify_entry_moved(fVolume->ID(), fID, fromName, toDir->ID(),
+				toName, id);
+		}
 		return B_OK;
-
-	Node* newNode = NULL;
-	switch (oldNode->Type()) {
-		case kShareDirectory:
-			newNode = new(std::nothrow) ShareDirectoryNode(
-				*static_cast<ShareDirectoryNode*>(oldNode),
-				toURL, strlen(toName));
-			break;
-
-		case kShareFile:
-			newNode = new(std::nothrow) ShareFileNode(
-				*static_cast<ShareFileNode*>(oldNode),
-				toURL, strlen(toName));
-			break;
-
-		default:
-			debugger("unexpected node type");
-			break;
 	}
-	if (newNode == NULL)
-		return B_NO_MEMORY;
-
-	fVolume->ForgetNode(oldNode->URL());
-	fVolume->MemorizeNode(newNode);
-
-	remove_vnode(fVolume->VFSVolume(), oldNode->ID());
 
+	// The node stays the same, only its parent link and name change. Nodes
+	// below a renamed directory follow along without further ado.
+	const ino_t id = node->ID();
+	fVolume->MoveNode(node, toDir, toName);
 	volumeLocker.Unlock();
 
-	notify_entry_moved(fVolume->ID(), fID, fromName, toDir->ID(), toName,
-		newNode->ID());
+	fVolume->Stats()->Invalidate(id);
+
+	notify_entry_moved(fVolume->ID(), fID, fromName, toDir->ID(), toName, id);
 
 	return B_OK;
 }
@@ -338,21 +426,35 @@ ShareDirectoryNode::ReadDir(void* cookie, struct dirent* buffer,
 	Cookie* const dirCookie = static_cast<Cookie*>(cookie);
 	status_t status;
 
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
 	if (dirCookie->fDirectoryHandle == NULL) {
-		status = fSambaContext->OpenDir(fURL, &dirCookie->fDirectoryHandle);
+		const BString url(URL());
+		SambaContextLease context(fSambaContextPool, url);
+		status = context.InitCheck();
 		if (status != B_OK)
 			return status;
+
+		status = context->OpenDir(url, &dirCookie->fDirectoryHandle);
+		if (status != B_OK)
+			return status;
+		dirCookie->fContext = context.Get();
 	}
 
+	// Tracker stats the entries only after reading them all, so the ones
+	// read before must not expire while the listing goes on
+	fVolume->Stats()->RefreshListing(dirCookie->fStatListing);
+
 	uint32 entriesRead = 0;
 	size_t bufferBytesLeft = bufferSize;
 	struct dirent* currentEntry = buffer;
 
 	while (entriesRead < *num) {
-		struct smbc_dirent* smbEntry = NULL;
-		status = fSambaContext->GetDirectoryEntry(dirCookie->fDirectoryHandle,
-			&smbEntry);
+		// readdirplus() gives us the stat data of each entry along with its
+		// name, so listing a folder doesn't need a stat round trip per entry
+		const uint32 generation = fVolume->Stats()->Generation();
+		SambaContextLease context(dirCookie->fContext);
+		const struct libsmb_file_info* info = NULL;
+		status = context->GetDirectoryEntryPlus(dirCookie->fDirectoryHandle,
+			&info);
 
 		if (status == B_ENTRY_NOT_FOUND) {
 			// End of directory
@@ -365,7 +467,13 @@ ShareDirectoryNode::ReadDir(void* cookie, struct dirent* buffer,
 			break;
 		}
 
-		size_t recordLength = sizeof(struct dirent) + smbEntry->namelen;
+		const BString name(info->name);
+		struct stat st;
+		file_info_to_stat(info, &st);
+		context.Release();
+			// Must not hold a context while locking the volume
+
+		size_t recordLength = sizeof(struct dirent) + name.Length();
 		recordLength = (recordLength + 7) & -8;
 			// Round up to next multiple of 8, as recommended by FS API docs
 
@@ -379,37 +487,39 @@ ShareDirectoryNode::ReadDir(void* cookie, struct dirent* buffer,
 			break;
 		}
 
-		BString url(_EntryURL(smbEntry->name));
-
-		TRACE("got dir entry: %s", url.String());
+		TRACE("got dir entry: %s", name.String());
 
-		Node* node = NULL;
-		switch (smbEntry->smbc_type) {
-			case SMBC_FILE:
-				node = new(std::nothrow) ShareFileNode(url,
-					strlen(smbEntry->name), fVolume, fSambaContext);
-				break;
+		const bool isDotEntry = name == "." || name == "..";
+		if (!isDotEntry) {
+			// Might have been created by someone else since we missed it
+			fVolume->MissingEntries()->Remove(fID, name.String());
+		}
 
-			case SMBC_DIR:
-				node = new(std::nothrow) ShareDirectoryNode(url,
-					strlen(smbEntry->name), fVolume, fSambaContext);
+		AutoLocker<Volume> volumeLocker(fVolume);
+		ino_t id;
+		if (name == ".")
+			id = fID;
+		else if (name == "..")
+			id = _ParentID();
+		else {
+			Node* const node = _InternNode(name.String(), S_ISDIR(st.st_mode));
+			if (node == NULL) {
+				status = B_NO_MEMORY;
 				break;
-
-			default:
-				// Skip this entry
-				continue;
-		}
-		if (node == NULL) {
-			status = B_NO_MEMORY;
-			break;
+			}
+			id = node->ID();
 		}
+		volumeLocker.Unlock();
+
+		if (!isDotEntry)
+			_CacheStat(id, &st, generation, dirCookie->fStatListing);
 
 		currentEntry->d_dev = fVolume->ID();
 		currentEntry->d_pdev = 0;
-		currentEntry->d_ino = node->ID();
+		currentEntry->d_ino = id;
 		currentEntry->d_pino = 0;
 		currentEntry->d_reclen = recordLength;
-		strlcpy(currentEntry->d_name, smbEntry->name,
+		strlcpy(currentEntry->d_name, name.String(),
 			bufferBytesLeft - sizeof(struct dirent));
 
 		currentEntry = reinterpret_cast<struct dirent*>(
@@ -438,30 +548,38 @@ ShareDirectoryNode::RewindDirCookie(void* cookie)
 	Cookie* const dirCookie = static_cast<Cookie*>(cookie);
 	if (dirCookie->fDirectoryHandle == NULL)
 		return B_OK;
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	return fSambaContext->SeekDir(dirCookie->fDirectoryHandle, 0);
+	SambaContextLease context(dirCookie->fContext);
+	return context->SeekDir(dirCookie->fDirectoryHandle, 0);
 }
 
 
 status_t
 ShareDirectoryNode::CreateDir(const char* name, int permissions)
 {
-	BString url(_EntryURL(name));
-
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	status_t status = fSambaContext->CreateDir(url, permissions);
+	const BString url(EntryURL(name));
 
+	SambaContextLease context(fSambaContextPool, url);
+	status_t status = context.InitCheck();
 	if (status != B_OK)
 		return status;
 
-	Node* newNode = new(std::nothrow) ShareDirectoryNode(url,
-		strlen(name), fVolume, fSambaContext);
+	status = context->CreateDir(url, permissions);
+	context.Release();
+
+	if (status != B_OK)
+		return status;
 
 	AutoLocker<Volume> volumeLocker(fVolume);
-	fVolume->MemorizeNode(newNode);
+	Node* const newNode = _InternNode(name, true);
+	if (newNode == NULL)
+		return B_NO_MEMORY;
+	const ino_t newID = newNode->ID();
 	volumeLocker.Unlock();
 
-	notify_entry_created(fVolume->ID(), fID, name, newNode->ID());
+	fVolume->Stats()->Invalidate(fID);
+	fVolume->MissingEntries()->RemoveDirectory(fID);
+
+	notify_entry_created(fVolume->ID(), fID, name, newID);
 
 	return B_OK;
 }
@@ -470,22 +588,89 @@ ShareDirectoryNode::CreateDir(const char* name, int permissions)
 status_t
 ShareDirectoryNode::RemoveDir(const char* name)
 {
-	BString url(_EntryURL(name));
+	const BString url(EntryURL(name));
 
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	status_t status = fSambaContext->RemoveDir(url);
-	sambaLocker.Unlock();
+	SambaContextLease context(fSambaContextPool, url);
+	status_t status = context.InitCheck();
+	if (status != B_OK)
+		return status;
+
+	status = context->RemoveDir(url);
+	context.Release();
 
 	if (status != B_OK)
 		return status;
 
 	AutoLocker<Volume> volumeLocker(fVolume);
-	Node* const removedNode = fVolume->RecallNode(url);
-
-	remove_vnode(fVolume->VFSVolume(), removedNode->ID());
+	const ino_t removedID = _RemoveEntryNode(this, name);
 	volumeLocker.Unlock();
 
-	notify_entry_removed(fVolume->ID(), fID, name, removedNode->ID());
+	fVolume->Stats()->Invalidate(fID);
+	if (removedID != kInvalidNodeID) {
+		fVolume->Stats()->Invalidate(removedID);
+		notify_entry_removed(fVolume->ID(), fID, name, removedID);
+	}
 
 	return B_OK;
 }
+
+
+// #pragma mark - Internal
+
+
+/*! Returns the node of an entry of this directory. Nodes the volume doesn't
+    know yet are created and memorized, so an entry keeps its ID however
+    often it is listed or looked up. Volume must be locked.
+*/
+Node*
+ShareDirectoryNode::_InternNode(const char* name, bool isDirectory)
+{
+	Node* node = fVolume->RecallNode(this, name);
+	if (node != NULL) {
+		TRACE("recalled node ID 0x%" B_PRIx64, node->ID());
+		return node;
+	}
+
+	// If the node was evicted, it comes back with its old ID
+	const ino_t id = fVolume->TakeEvictedNodeID(fID, name);
+
+	if (isDirectory) {
+		TRACE("%s -> is directory", name);
+		node = new(std::nothrow) ShareDirectoryNode(this, name, id);
+	} else {
+		TRACE("%s -> is file", name);
+		node = new(std::nothrow) ShareFileNode(this, name, id);
+	}
+	if (node == NULL)
+		return NULL;
+
+	fVolume->MemorizeNode(node, true);
+	return node;
+}
+
+
+/*! Drops the node of an entry which is gone from the share. Returns the
+    entry's node ID, or kInvalidNodeID if the volume didn't know it.
+    Volume must be locked.
+*/
+ino_t
+ShareDirectoryNode::_RemoveEntryNode(Node* directory, const char* name)
+{
+	Node* const node = fVolume->RecallNode(directory, name);
+	if (node == NULL)
+		return fVolume->TakeEvictedNodeID(directory->ID(), name);
+
+	const ino_t id = node->ID();
+	fVolume->RemoveNode(node);
+	return id;
+}
+
+
+/*! Volume must be locked
+*/
+ino_t
+ShareDirectoryNode::_ParentID()
+{
+	// Share roots have their server's discovery node as parent
+	return fParent->ID();
+}
@@ -18,12 +18,9 @@ namespace Smb {
 */
 class ShareDirectoryNode : public ShareNode {
 public:
-								ShareDirectoryNode(const BString& url,
-									size_t nameLength, Volume* volume,
-									SambaContext* context);
-								ShareDirectoryNode(
-									const ShareDirectoryNode& prototype,
-									const BString& newURL, size_t nameLength);
+								ShareDirectoryNode(Node* parent,
+									const char* name,
+									ino_t id = kInvalidNodeID);
 	virtual						~ShareDirectoryNode();
 
 	virtual	NodeType			Type() const;
@@ -32,12 +29,15 @@ public:
 
 	virtual	status_t			Open(int mode, void** outCookie);
 	virtual	status_t			Close(void* cookie);
+	virtual	status_t			FreeCookie(void* cookie);
 
 // --- only for files, all these fail on this node ----------------------------
 	virtual	status_t			Read(void* cookie, off_t offset, void* buffer,
 									size_t* length);
 	virtual	status_t			Write(void* cookie, off_t offset,
 									const void* buffer, size_t* length);
+	virtual	status_t			IO(void* cookie, io_request* request);
+	virtual	status_t			CancelIO(void* cookie, io_request* request);
 
 // --- only for directories ---------------------------------------------------
 	virtual	status_t			Lookup(const char* name, ino_t* outNodeID);
@@ -59,6 +59,13 @@ public:
 private:
 	struct Cookie;
 
+private:
+			Node*				_InternNode(const char* name,
+									bool isDirectory);
+			ino_t				_RemoveEntryNode(Node* directory,
+									const char* name);
+			ino_t				_ParentID();
+
 private:
 			bool				fWasRemoved;
 };
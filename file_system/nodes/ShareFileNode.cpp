@@ -5,30 +5,115 @@
 
 #include "ShareFileNode.h"
 
+#include <fs_cache.h>
+#include <fs_interface.h>
+#include <private/shared/AutoLocker.h>
+
+#include <algorithm>
+
+#include "ReadAhead.h"
 #include "SambaContext.h"
+#include "SambaContextPool.h"
+#include "Volume.h"
+#include "WriteBehind.h"
 
 
 using namespace Smb;
 
 
-ShareFileNode::ShareFileNode(const BString& url, size_t nameLength,
-	Volume* volume, SambaContext* context)
-	:
-	ShareNode(url, nameLength, volume, context)
+static inline bool
+operator==(const timespec& a, const timespec& b)
 {
+	return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
 }
 
 
-ShareFileNode::ShareFileNode(const ShareFileNode& prototype,
-	const BString& newURL, size_t nameLength)
+// #pragma mark - ShareFileNode::Cookie
+
+
+/*! Cookie of an open file. The handle can only be used with the context it
+    was opened with. fPosition mirrors the handle's file position, so that
+    sequential reads and writes don't need to seek.
+    Unless opened with O_NOCACHE, the data goes through the node's file
+    cache, which does its own read-ahead and write-back. Otherwise the
+    cookie owns its context, see NeedsOwnContext().
+*/
+struct ShareFileNode::Cookie {
+	Cookie(Volume* volume, SambaContext* context, SMBCFILE* file,
+		int openMode, size_t ioSize)
+		:
+		fContext(context),
+		fFile(file),
+		fPosition(0),
+		fOpenMode(openMode),
+		fCached((openMode & O_NOCACHE) == 0),
+		fReadAhead(NULL),
+		fWriteBehind(NULL)
+	{
+		if ((openMode & O_APPEND) != 0) {
+			// libsmbclient has already moved the handle to the end of the
+			// file
+			fPosition = SambaContext::kUnknownPosition;
+		}
+
+		if (fCached)
+			return;
+
+		// If we can't get these, we just do without
+		if ((openMode & O_ACCMODE) != O_WRONLY) {
+			fReadAhead = new(std::nothrow) ReadAhead(volume, context, file,
+				&fPosition, ioSize);
+		}
+		if ((openMode & O_ACCMODE) != O_RDONLY) {
+			fWriteBehind = new(std::nothrow) WriteBehind(volume, context, file,
+				&fPosition, ioSize);
+		}
+	}
+
+	~Cookie()
+	{
+		delete fReadAhead;
+		delete fWriteBehind;
+		if (!fCached)
+			delete fContext;
+	}
+
+	SambaContext*	fContext;
+		// owned by us if not fCached
+	SMBCFILE*		fFile;
+	off_t			fPosition;
+		// protected by fContext's lock
+	int				fOpenMode;
+	bool			fCached;
+	ReadAhead*		fReadAhead;
+		// NULL if not open for reading
+	WriteBehind*	fWriteBehind;
+		// NULL if not open for writing
+};
+
+
+// #pragma mark - ShareFileNode
+
+
+ShareFileNode::ShareFileNode(Node* parent, const char* name, ino_t id)
 	:
-	ShareNode(prototype, newURL, nameLength)
+	ShareNode(parent, name, id),
+	fOpenCount(0),
+	fFileCache(NULL),
+	fCacheSize(0),
+	fCacheDirty(false),
+	fWrittenSize(-1),
+	fCacheValidUntil(0)
 {
+	fCacheModified.tv_sec = 0;
+	fCacheModified.tv_nsec = 0;
 }
 
 
 ShareFileNode::~ShareFileNode()
 {
+	if (fFileCache != NULL)
+		file_cache_delete(fFileCache);
 }
 
 
@@ -39,26 +124,298 @@ ShareFileNode::Type() const
 }
 
 
-// #pragma mark - File-only
+/*! The file cache belongs to the vnode, so it goes away with it, even if
+    the volume keeps the node. The VFS has synced the node before.
+*/
+void
+ShareFileNode::Delete(bool removed, bool reenter)
+{
+	AutoLocker<BLocker> locker(fCacheLock);
+	if (fFileCache != NULL) {
+		file_cache_delete(fFileCache);
+		fFileCache = NULL;
+	}
+	locker.Unlock();
+
+	ShareNode::Delete(removed, reenter);
+}
 
 
+/*! Creates a cookie for a file handle opened elsewhere (by Create() of the
+    parent directory). If it was opened with O_TRUNC, the file is empty on
+    the server now, and so are its cache and its cached stat.
+    If NeedsOwnContext() for \a openMode, \a context must be a dedicated one,
+    which the cookie takes over on success.
+*/
 status_t
-ShareFileNode::Read(void* cookie, off_t offset, void* buffer, size_t* length)
+ShareFileNode::AdoptFile(SambaContext* context, SMBCFILE* file, int openMode,
+	void** outCookie)
 {
-	if (offset < 0)
-		return B_BAD_VALUE;
+	// Only the read-ahead and write-behind of uncached cookies need it
+	const size_t ioSize = (openMode & O_NOCACHE) != 0
+		? fVolume->IOSizes()->IOSize(URL()) : 0;
+
+	Cookie* const cookie = new(std::nothrow) Cookie(fVolume, context, file,
+		openMode, ioSize);
+	if (cookie == NULL)
+		return B_NO_MEMORY;
+
+	if (cookie->fWriteBehind != NULL) {
+		AutoLocker<BLocker> locker(fCookieLock);
+		fWriteCookies.push_back(cookie);
+	}
+	atomic_add(&fOpenCount, 1);
+
+	if (cookie->fCached) {
+		// What changed on the server while the file was closed must not be
+		// read from the cache, the first read checks
+		atomic_set64(&fCacheValidUntil, 0);
+	}
+
+	if ((openMode & O_TRUNC) != 0) {
+		// A stat from before shows the old size
+		fVolume->Stats()->Invalidate(fID);
+		_TruncateFileCache();
+	}
+
+	*outCookie = (void*)cookie;
+	return B_OK;
+}
+
+
+/*! Whether a handle opened with \a openMode must get a context of its own,
+    rather than one from the pool. The read-ahead and write-behind workers
+    of uncached cookies keep their handle's context busy with long
+    transfers, which would hold up every other operation waiting for it in
+    the pool.
+*/
+/*static*/ bool
+ShareFileNode::NeedsOwnContext(int openMode)
+{
+	return (openMode & O_NOCACHE) != 0;
+}
 
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
 
-	SMBCFILE* const file = static_cast<SMBCFILE*>(cookie);
-	status_t status = fSambaContext->Seek(file, offset);
+/*! A stat fresh from the server revalidates the file cache, which is then
+    valid as long as the stat stays in the volume's stat cache. The size
+    includes the writes still buffered by the write-behind of open cookies.
+*/
+status_t
+ShareFileNode::ReadStat(struct stat* destination)
+{
+	status_t status = ShareNode::ReadStat(destination);
 	if (status != B_OK)
 		return status;
 
-	status = fSambaContext->Read(file, buffer, length);
+	AutoLocker<BLocker> locker(fCacheLock);
+	if (fFileCache != NULL) {
+		_RevalidateFileCache(destination);
+		atomic_set64(&fCacheValidUntil,
+			fVolume->Stats()->ExpirationTime(fID));
+	}
+	locker.Unlock();
+
+	AutoLocker<BLocker> cookieLocker(fCookieLock);
+	for (CookieList::iterator it = fWriteCookies.begin();
+			it != fWriteCookies.end(); it++) {
+		destination->st_size = max_c(destination->st_size,
+			(*it)->fWriteBehind->BufferedEnd());
+	}
+	return B_OK;
+}
+
+
+status_t
+ShareFileNode::WriteStat(const struct stat* source, uint32 statMask)
+{
+	const bool sizeChanged = (statMask & B_STAT_SIZE) != 0
+		|| (statMask & B_STAT_SIZE_INSECURE) != 0;
+
+	if (sizeChanged) {
+		// Buffered writes must not land behind the truncation
+		status_t status = _FlushWrites();
+		if (status != B_OK)
+			return status;
+	}
+
+	// Cached pages beyond the new end must be gone before the server
+	// truncates, or writing them back would make the file grow again
+	AutoLocker<BLocker> locker(fCacheLock);
+	if (fFileCache != NULL && sizeChanged) {
+		status_t status = file_cache_set_size(fFileCache, source->st_size);
+		if (status != B_OK)
+			return status;
+		atomic_set64(&fCacheSize, source->st_size);
+	}
+
+	status_t status = ShareNode::WriteStat(source, statMask);
+	if (status == B_OK && fFileCache != NULL) {
+		// Not a reason to drop the cached pages, the change is our own
+		if ((statMask & B_STAT_MODIFICATION_TIME) != 0)
+			fCacheModified = source->st_mtim;
+		else if (sizeChanged)
+			atomic_set64(&fWrittenSize, source->st_size);
+	}
+	return status;
+}
+
+
+status_t
+ShareFileNode::Open(int flags, void** outCookie)
+{
+	const BString url(URL());
+	const bool ownContext = NeedsOwnContext(flags);
+	SambaContextLease context(fSambaContextPool, url, ownContext);
+	status_t status = context.InitCheck();
 	if (status != B_OK)
 		return status;
 
+	SambaContext* const fileContext = context.Get();
+	SMBCFILE* file = NULL;
+	status = context->Open(url, flags, &file);
+	context.Release();
+	if (status == B_OK) {
+		status = AdoptFile(fileContext, file, flags, outCookie);
+		if (status != B_OK) {
+			SambaContextLease fileContextLease(fileContext);
+			fileContextLease->Close(file);
+		}
+	}
+
+	if (status != B_OK && ownContext)
+		delete fileContext;
+	return status;
+}
+
+
+status_t
+ShareFileNode::Close(void* cookie)
+{
+	Cookie* const fileCookie = static_cast<Cookie*>(cookie);
+
+	// The read-ahead and write-behind workers use the handle, they must be
+	// done before we close it
+	if (fileCookie->fReadAhead != NULL)
+		fileCookie->fReadAhead->Stop();
+
+	status_t writeStatus = B_OK;
+	if (fileCookie->fWriteBehind != NULL) {
+		AutoLocker<BLocker> locker(fCookieLock);
+		fWriteCookies.erase(std::find(fWriteCookies.begin(),
+			fWriteCookies.end(), fileCookie));
+		locker.Unlock();
+
+		writeStatus = fileCookie->fWriteBehind->Flush();
+		fileCookie->fWriteBehind->Stop();
+
+		// A stat taken while writes were still buffered is outdated now
+		fVolume->Stats()->Invalidate(fID);
+	} else if (fileCookie->fCached
+		&& (fileCookie->fOpenMode & O_ACCMODE) != O_RDONLY) {
+		// Whoever opens the file next, maybe elsewhere, sees what was
+		// written
+		writeStatus = _SyncFileCache();
+	}
+
+	SambaContextLease context(fileCookie->fContext);
+	status_t status = context->Close(fileCookie->fFile);
+	context.Release();
+
+	if (atomic_add(&fOpenCount, -1) == 1) {
+		// The I/O workers' handles would keep others from deleting or
+		// renaming the file
+		fVolume->IO()->CloseFiles(URL());
+	}
+
+	// A deferred write error is more interesting than how closing went
+	return writeStatus != B_OK ? writeStatus : status;
+}
+
+
+status_t
+ShareFileNode::FreeCookie(void* cookie)
+{
+	delete static_cast<Cookie*>(cookie);
+	return B_OK;
+}
+
+
+status_t
+ShareFileNode::Sync()
+{
+	status_t status = _FlushWrites();
+	status_t cacheStatus = _SyncFileCache();
+	return status != B_OK ? status : cacheStatus;
+}
+
+
+// #pragma mark - File-only
+
+
+status_t
+ShareFileNode::Read(void* cookie, off_t offset, void* buffer, size_t* length)
+{
+	if (offset < 0)
+		return B_BAD_VALUE;
+
+	Cookie* const fileCookie = static_cast<Cookie*>(cookie);
+
+	void* const fileCache = fileCookie->fCached ? _FileCache() : NULL;
+	if (fileCache != NULL) {
+		// Reads must see what was written by uncached cookies
+		if (_HasBufferedWrites()) {
+			status_t status = _FlushWrites();
+			if (status != B_OK)
+				return status;
+		}
+
+		// Drops the cached pages if the file changed on the server. Only
+		// needed once the stat they were checked against has expired.
+		if (system_time() >= atomic_get64(&fCacheValidUntil)) {
+			struct stat st;
+			status_t status = ReadStat(&st);
+			if (status != B_OK)
+				return status;
+		}
+
+		return file_cache_read(fileCache, cookie, offset, buffer, length);
+	}
+
+	if (fileCookie->fWriteBehind != NULL) {
+		// Reads must see what was written before
+		status_t status = fileCookie->fWriteBehind->Flush();
+		if (status != B_OK)
+			return status;
+	}
+
+	if (fVolume->IO()->ShouldStripe(URL(), *length)) {
+		// Faster on several connections than through the cookie's handle
+		return fVolume->IO()->Transfer(fID, URL(), false, offset, buffer,
+			length);
+	}
+
+	size_t bytesBuffered = 0;
+	if (fileCookie->fReadAhead != NULL) {
+		bytesBuffered = *length;
+		bool complete;
+		status_t status = fileCookie->fReadAhead->Read(offset, buffer,
+			&bytesBuffered, &complete);
+		if (status != B_OK || complete) {
+			*length = bytesBuffered;
+			return status;
+		}
+	}
+
+	// Read whatever the read-ahead couldn't serve from the server directly
+	size_t bytesRead = *length - bytesBuffered;
+	SambaContextLease context(fileCookie->fContext);
+	status_t status = context->ReadAt(fileCookie->fFile,
+		&fileCookie->fPosition, offset + bytesBuffered,
+		static_cast<uint8*>(buffer) + bytesBuffered, &bytesRead);
+	if (status != B_OK && bytesBuffered == 0)
+		return status;
+
+	*length = bytesBuffered + (status == B_OK ? bytesRead : 0);
 	return B_OK;
 }
 
@@ -70,18 +427,93 @@ ShareFileNode::Write(void* cookie, off_t offset, const void* buffer,
 	if (offset < 0)
 		return B_BAD_VALUE;
 
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
+	Cookie* const fileCookie = static_cast<Cookie*>(cookie);
+
+	void* const fileCache = fileCookie->fCached ? _FileCache() : NULL;
+	if (fileCache != NULL) {
+		AutoLocker<BLocker> locker(fCacheLock);
+		if ((fileCookie->fOpenMode & O_APPEND) != 0)
+			offset = atomic_get64(&fCacheSize);
+
+		const off_t end = offset + (off_t)*length;
+		if (end > atomic_get64(&fCacheSize)) {
+			status_t status = file_cache_set_size(fileCache, end);
+			if (status != B_OK)
+				return status;
+			atomic_set64(&fCacheSize, end);
+		}
+
+		// Until synced, the size on the server lags behind
+		fCacheDirty = true;
+		return file_cache_write(fileCache, cookie, offset, buffer, length);
+	}
+
+	if (fileCookie->fReadAhead != NULL)
+		fileCookie->fReadAhead->Invalidate();
+
+	// Size and modification time change, and the file cache doesn't have
+	// what's written
+	fVolume->Stats()->Invalidate(fID);
+	atomic_set64(&fCacheValidUntil, 0);
+
+	if ((fileCookie->fOpenMode & O_APPEND) == 0
+		&& fVolume->IO()->ShouldStripe(URL(), *length)) {
+		// Faster on several connections, buffered writes go first
+		if (fileCookie->fWriteBehind != NULL) {
+			status_t status = fileCookie->fWriteBehind->Flush();
+			if (status != B_OK)
+				return status;
+		}
+		return fVolume->IO()->Transfer(fID, URL(), true, offset,
+			const_cast<void*>(buffer), length);
+	}
+
+	if (fileCookie->fWriteBehind != NULL) {
+		// Everything gets written, or the error is reported
+		return fileCookie->fWriteBehind->Write(offset, buffer, *length);
+	}
+
+	SambaContextLease context(fileCookie->fContext);
+	return context->WriteAt(fileCookie->fFile, &fileCookie->fPosition, offset,
+		buffer, length);
+}
 
-	SMBCFILE* const file = static_cast<SMBCFILE*>(cookie);
-	status_t status = fSambaContext->Seek(file, offset);
-	if (status != B_OK)
-		return status;
 
-	status = fSambaContext->Write(file, buffer, length);
+/*! Queues the request with the volume's asynchronous I/O, which completes
+    it with notify_io_request(). This is how the file cache and mapped views
+    fill and write back their pages. The workers use handles of their own,
+    so the cookie's buffered writes must be on the server first, and its
+    read-ahead must not keep data from before a write.
+*/
+status_t
+ShareFileNode::IO(void* cookie, io_request* request)
+{
+	Cookie* const fileCookie = static_cast<Cookie*>(cookie);
+
+	if (io_request_is_write(request)) {
+		if (fileCookie != NULL && fileCookie->fReadAhead != NULL)
+			fileCookie->fReadAhead->Invalidate();
+		fVolume->Stats()->Invalidate(fID);
+
+		// Not a reason to drop the cached pages, they are what's written.
+		// The file cache doesn't write beyond its size, which is what the
+		// file has on the server then. fCacheLock may be held by whoever
+		// waits for this request, so it isn't taken, the size is atomic.
+		atomic_set64(&fWrittenSize, atomic_get64(&fCacheSize));
+	}
+
+	status_t status = _FlushWrites();
 	if (status != B_OK)
 		return status;
 
-	return B_OK;
+	return fVolume->IO()->Queue(fID, URL(), request);
+}
+
+
+status_t
+ShareFileNode::CancelIO(void*, io_request* request)
+{
+	return fVolume->IO()->Cancel(request);
 }
 
 
@@ -163,3 +595,132 @@ ShareFileNode::RemoveDir(const char*)
 {
 	return B_NOT_A_DIRECTORY;
 }
+
+
+/*! Whether any open cookie has writes which aren't on the server yet.
+*/
+bool
+ShareFileNode::_HasBufferedWrites()
+{
+	AutoLocker<BLocker> locker(fCookieLock);
+
+	for (CookieList::iterator it = fWriteCookies.begin();
+			it != fWriteCookies.end(); it++) {
+		if ((*it)->fWriteBehind->BufferedEnd() > 0)
+			return true;
+	}
+	return false;
+}
+
+
+status_t
+ShareFileNode::_FlushWrites()
+{
+	AutoLocker<BLocker> locker(fCookieLock);
+
+	status_t result = B_OK;
+	for (CookieList::iterator it = fWriteCookies.begin();
+			it != fWriteCookies.end(); it++) {
+		status_t status = (*it)->fWriteBehind->Flush();
+		if (result == B_OK)
+			result = status;
+	}
+	return result;
+}
+
+
+/*! Returns the node's file cache, creating it with the size on the server
+    if there is none yet. NULL if the cache couldn't be created, the data
+    then goes to the server directly.
+*/
+void*
+ShareFileNode::_FileCache()
+{
+	AutoLocker<BLocker> locker(fCacheLock);
+	if (fFileCache != NULL)
+		return fFileCache;
+
+	struct stat st;
+	if (ShareNode::ReadStat(&st) != B_OK)
+		return NULL;
+
+	fFileCache = file_cache_create(fVolume->ID(), fID, st.st_size);
+	if (fFileCache == NULL)
+		return NULL;
+
+	atomic_set64(&fCacheSize, st.st_size);
+	fCacheModified = st.st_mtim;
+	fCacheDirty = false;
+	atomic_set64(&fWrittenSize, -1);
+	return fFileCache;
+}
+
+
+/*! The file was truncated on the server by opening it, its cached pages are
+    outdated. The modification time it got is only known with the next stat.
+*/
+void
+ShareFileNode::_TruncateFileCache()
+{
+	AutoLocker<BLocker> locker(fCacheLock);
+	if (fFileCache == NULL)
+		return;
+
+	file_cache_set_size(fFileCache, 0);
+	atomic_set64(&fCacheSize, 0);
+	fCacheDirty = false;
+	atomic_set64(&fWrittenSize, 0);
+}
+
+
+/*! Compares a stat of the file with what is in the cache. If the size or
+    modification time differ, and it isn't the size our own writes left, the
+    file changed on the server and the cached pages are thrown away. While
+    there are writes not yet synced, the cache is what's current, and its
+    size is reported.
+    fCacheLock must be held.
+*/
+void
+ShareFileNode::_RevalidateFileCache(struct stat* st)
+{
+	if (fCacheDirty) {
+		st->st_size = atomic_get64(&fCacheSize);
+		return;
+	}
+
+	if (st->st_size == atomic_get64(&fCacheSize)
+		&& st->st_mtim == fCacheModified) {
+		return;
+	}
+
+	if (atomic_test_and_set64(&fWrittenSize, -1, st->st_size)
+			!= st->st_size) {
+		// Pages modified through a mapping must not get lost
+		file_cache_sync(fFileCache);
+		file_cache_set_size(fFileCache, 0);
+	}
+
+	file_cache_set_size(fFileCache, st->st_size);
+	atomic_set64(&fCacheSize, st->st_size);
+	fCacheModified = st->st_mtim;
+}
+
+
+/*! Writes back the modified pages of the file cache, if there is one.
+*/
+status_t
+ShareFileNode::_SyncFileCache()
+{
+	AutoLocker<BLocker> locker(fCacheLock);
+	if (fFileCache == NULL)
+		return B_OK;
+
+	status_t status = file_cache_sync(fFileCache);
+	if (status != B_OK)
+		return status;
+
+	// The writes have invalidated the stat, the next one is from the
+	// server again
+	fCacheDirty = false;
+	return B_OK;
+}
@@ -6,33 +6,61 @@
 #ifndef SMBFS_SHARE_FILE_NODE_H
 #define SMBFS_SHARE_FILE_NODE_H
 
+#include <Locker.h>
 #include <SupportDefs.h>
 
+#include <libsmbclient.h>
+
+#include <vector>
+
 #include "ShareNode.h"
 
 
 namespace Smb {
 
 
-/*! File node inside an SMB share.
+class SambaContext;
+
+
+/*! File node inside an SMB share. Its data goes through the VFS file cache,
+    which fills and writes back pages with the io hook, and which is shared
+    with mapped views of the file. A stat showing that the file changed on
+    the server throws away the cached pages.
+    The file cache does its own read-ahead and write-back, so ReadAhead and
+    WriteBehind only run for cookies opened with O_NOCACHE, which bypass it.
 */
 class ShareFileNode : public ShareNode  {
 public:
-								ShareFileNode(const BString& url,
-									size_t nameLength, Volume* volume,
-									SambaContext* context);
-								ShareFileNode(
-									const ShareFileNode& prototype,
-									const BString& newURL, size_t nameLength);
+								ShareFileNode(Node* parent, const char* name,
+									ino_t id = kInvalidNodeID);
 	virtual						~ShareFileNode();
 
 	virtual	NodeType			Type() const;
 
+	virtual	void				Delete(bool removed, bool reenter);
+
+			status_t			AdoptFile(SambaContext* context,
+									SMBCFILE* file, int openMode,
+									void** outCookie);
+	static	bool				NeedsOwnContext(int openMode);
+
+	virtual	status_t			ReadStat(struct stat* destination);
+	virtual	status_t			WriteStat(const struct stat* source,
+									uint32 statMask);
+
+	virtual	status_t			Open(int mode, void** outCookie);
+	virtual	status_t			Close(void* cookie);
+	virtual	status_t			FreeCookie(void* cookie);
+
+	virtual	status_t			Sync();
+
 // --- only for files ---------------------------------------------------------
 	virtual	status_t			Read(void* cookie, off_t offset, void* buffer,
 									size_t* length);
 	virtual	status_t			Write(void* cookie, off_t offset,
 									const void* buffer, size_t* length);
+	virtual	status_t			IO(void* cookie, io_request* request);
+	virtual	status_t			CancelIO(void* cookie, io_request* request);
 
 // --- only for directories, all these fail on this node ----------------------
 	virtual	status_t			Lookup(const char* name, ino_t* outNodeID);
@@ -50,6 +78,41 @@ public:
 	virtual	status_t			RewindDirCookie(void* cookie);
 	virtual	status_t			CreateDir(const char* name, int permissions);
 	virtual	status_t			RemoveDir(const char* name);
+
+private:
+	struct Cookie;
+	typedef std::vector<Cookie*> CookieList;
+
+private:
+			bool				_HasBufferedWrites();
+			status_t			_FlushWrites();
+
+			void*				_FileCache();
+			void				_TruncateFileCache();
+			void				_RevalidateFileCache(struct stat* st);
+			status_t			_SyncFileCache();
+
+private:
+			BLocker				fCookieLock;
+			CookieList			fWriteCookies;
+				// open cookies which may have buffered writes
+			int32				fOpenCount;
+				// cookies not closed yet
+
+			BLocker				fCacheLock;
+			void*				fFileCache;
+				// created on first use, NULL if that failed
+			int64				fCacheSize;
+				// atomic, IO() reads it without fCacheLock
+			timespec			fCacheModified;
+				// of the file contents in the cache
+			bool				fCacheDirty;
+				// written to since the last sync
+			int64				fWrittenSize;
+				// size our writes leave the file at on the server, -1 if
+				// we didn't change it since the last stat
+			int64				fCacheValidUntil;
+				// when the stat it was checked against expires, atomic
 };
 
 
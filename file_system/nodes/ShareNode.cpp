@@ -12,24 +12,16 @@
 #include <sys/stat.h>
 
 #include "SambaContext.h"
+#include "SambaContextPool.h"
 #include "Volume.h"
 
 
 using namespace Smb;
 
 
-ShareNode::ShareNode(const BString& url, size_t nameLength, Volume* volume,
-	SambaContext* context)
+ShareNode::ShareNode(Node* parent, const char* name, ino_t id)
 	:
-	Node(url, nameLength, volume, context)
-{
-}
-
-
-ShareNode::ShareNode(const ShareNode& prototype, const BString& newURL,
-	size_t nameLength)
-	:
-	Node(prototype, newURL, nameLength)
+	Node(parent, name, id)
 {
 }
 
@@ -42,21 +34,21 @@ ShareNode::~ShareNode()
 status_t
 ShareNode::ReadStat(struct stat* destination)
 {
-	// Prefill some values not filled in by Samba
-	destination->st_dev = fVolume->ID();
-	destination->st_ino = fID;
-		// Samba only fills in when 0
-	destination->st_blksize = 4096;
-	destination->st_type = 0;
-
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	status_t status= fSambaContext->Stat(fURL, destination);
+	if (fVolume->Stats()->Get(fID, destination))
+		return B_OK;
+
+	const uint32 generation = fVolume->Stats()->Generation();
+	const BString url(URL());
+	SambaContextLease context(fSambaContextPool, url);
+	status_t status = context.InitCheck();
 	if (status != B_OK)
 		return status;
 
-	// Mask out the executable bits, libsmbclient maps these
-	// to the DOS bits for system/hidden/etc
-	destination->st_mode &= ~(S_IXUSR | S_IXGRP | S_IXOTH);
+	status = context->Stat(url, destination);
+	if (status != B_OK)
+		return status;
+
+	_CacheStat(fID, destination, generation);
 	return B_OK;
 }
 
@@ -64,31 +56,73 @@ ShareNode::ReadStat(struct stat* destination)
 status_t
 ShareNode::WriteStat(const struct stat* source, uint32 statMask)
 {
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	status_t status;
+	status_t status = _WriteStat(source, statMask);
+
+	// Even a failed call may have changed some of the values
+	fVolume->Stats()->Invalidate(fID);
+	return status;
+}
+
+
+status_t
+ShareNode::Sync()
+{
+	return B_OK;
+}
+
+
+/*! Fills in the values libsmbclient leaves out of the stat of the node with
+    the given ID, and puts the result into the volume's stat cache, unless
+    the node was invalidated since \a generation was taken.
+*/
+void
+ShareNode::_CacheStat(ino_t id, struct stat* st, uint32 generation,
+	uint32 listing)
+{
+	st->st_dev = fVolume->ID();
+	st->st_ino = id;
+	st->st_blksize = 4096;
+	st->st_type = 0;
+
+	// Mask out the executable bits, libsmbclient maps these
+	// to the DOS bits for system/hidden/etc
+	st->st_mode &= ~(S_IXUSR | S_IXGRP | S_IXOTH);
+
+	fVolume->Stats()->Put(id, *st, generation, listing);
+}
+
+
+status_t
+ShareNode::_WriteStat(const struct stat* source, uint32 statMask)
+{
+	const BString url(URL());
+	SambaContextLease context(fSambaContextPool, url);
+	status_t status = context.InitCheck();
+	if (status != B_OK)
+		return status;
 
 	if (   (statMask & B_STAT_SIZE) != 0
 		|| (statMask & B_STAT_SIZE_INSECURE) != 0) {
 		// Samba only gives us ftruncate(), so we need to open the
 		// file first
 		SMBCFILE* file = NULL;
-		status = fSambaContext->Open(fURL, O_WRONLY, &file);
+		status = context->Open(url, O_WRONLY, &file);
 		if (status != B_OK)
 			return status;
 
-		status = fSambaContext->FileTruncate(file, source->st_size);
+		status = context->FileTruncate(file, source->st_size);
 		if (status != B_OK) {
-			fSambaContext->Close(file);
+			context->Close(file);
 			return status;
 		}
 
-		status = fSambaContext->Close(file);
+		status = context->Close(file);
 		if (status != B_OK)
 			return status;
 	}
 
 	if ((statMask & B_STAT_MODIFICATION_TIME) != 0) {
-		status = fSambaContext->UpdateTime(fURL, source->st_mtim);
+		status = context->UpdateTime(url, source->st_mtim);
 		if (status != B_OK)
 			return status;
 	}
@@ -100,31 +134,3 @@ ShareNode::WriteStat(const struct stat* source, uint32 statMask)
 	return B_OK;
 }
 
-
-status_t
-ShareNode::Open(int flags, void** outCookie)
-{
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	SMBCFILE* file = NULL;
-	status_t status = fSambaContext->Open(fURL, flags, &file);
-	if (status != B_OK)
-		return status;
-
-	*outCookie = (void*)file;
-	return B_OK;
-}
-
-
-status_t
-ShareNode::Close(void* cookie)
-{
-	GlobalSambaLocker sambaLocker(gGlobalSambaLock);
-	return fSambaContext->Close(static_cast<SMBCFILE*>(cookie));
-}
-
-
-status_t
-ShareNode::FreeCookie(void*)
-{
-	return B_OK;
-}
@@ -18,11 +18,8 @@ namespace Smb {
 */
 class ShareNode : public Node {
 public:
-								ShareNode(const BString& url,
-									size_t nameLength, Volume* volume,
-									SambaContext* context);
-								ShareNode(const ShareNode& prototype,
-									const BString& newURL, size_t nameLength);
+								ShareNode(Node* parent, const char* name,
+									ino_t id = kInvalidNodeID);
 
 	virtual						~ShareNode();
 
@@ -30,9 +27,15 @@ public:
 	virtual	status_t			WriteStat(const struct stat* source,
 									uint32 statMask);
 
-	virtual	status_t			Open(int mode, void** outCookie);
-	virtual	status_t			Close(void* cookie);
-	virtual	status_t			FreeCookie(void* cookie);
+	virtual	status_t			Sync();
+
+protected:
+			void				_CacheStat(ino_t id, struct stat* st,
+									uint32 generation, uint32 listing = 0);
+
+private:
+			status_t			_WriteStat(const struct stat* source,
+									uint32 statMask);
 };
 
 
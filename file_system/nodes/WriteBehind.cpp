@@ -0,0 +1,399 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "WriteBehind.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SambaContext.h"
+#include "SambaContextPool.h"
+#include "Volume.h"
+
+
+//#define TRACE_WRITE_BEHIND
+#ifdef TRACE_WRITE_BEHIND
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [WriteBehind %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+// #pragma mark - WriteBehind::Buffer
+
+
+struct WriteBehind::Buffer {
+	Buffer(off_t offset, size_t capacity, uint8* data)
+		:
+		fOffset(offset),
+		fCapacity(capacity),
+		fLength(0),
+		fData(data),
+		fCreated(system_time())
+	{
+	}
+
+	~Buffer()
+	{
+		free(fData);
+	}
+
+	off_t End() const
+	{
+		return fOffset + fLength;
+	}
+
+	off_t			fOffset;
+	size_t			fCapacity;
+		// up to the next io_size boundary
+	size_t			fLength;
+	uint8*			fData;
+	bigtime_t		fCreated;
+		// only created right before data goes in
+};
+
+
+// #pragma mark - WriteBehind
+
+
+WriteBehind::WriteBehind(Volume* volume, SambaContext* context,
+	SMBCFILE* file, off_t* position, size_t bufferSize)
+	:
+	fVolume(volume),
+	fContext(context),
+	fFile(file),
+	fPosition(position),
+	fBufferSize(bufferSize),
+	fWorkSem(-1),
+	fDoneSem(-1),
+	fWaiters(0),
+	fWorker(-1),
+	fStopped(false),
+	fCurrent(NULL),
+	fError(B_OK)
+{
+}
+
+
+WriteBehind::~WriteBehind()
+{
+	Stop();
+
+	if (fWorkSem >= 0)
+		delete_sem(fWorkSem);
+	if (fDoneSem >= 0)
+		delete_sem(fDoneSem);
+}
+
+
+status_t
+WriteBehind::Write(off_t offset, const void* buffer, size_t length)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	status_t status = _TakeError();
+	if (status != B_OK)
+		return status;
+
+	if (fStopped) {
+		locker.Unlock();
+		return _WriteDirectly(offset, buffer, length);
+	}
+
+	if (fCurrent != NULL && offset != fCurrent->End()) {
+		// Doesn't continue the previous write, send off what we have
+		_Submit(locker);
+	}
+
+	const uint8* source = static_cast<const uint8*>(buffer);
+	while (length > 0) {
+		if (fCurrent == NULL && _NewBuffer(offset) != B_OK) {
+			// Out of buffer memory: get everything buffered to the server
+			// first, then write the rest ourselves
+			TRACE("no buffer, write %" B_PRIuSIZE " bytes directly", length);
+			_Drain(locker);
+			status = _TakeError();
+			if (status != B_OK)
+				return status;
+			locker.Unlock();
+			return _WriteDirectly(offset, source, length);
+		}
+
+		const size_t bytesToCopy = min_c(length,
+			fCurrent->fCapacity - fCurrent->fLength);
+		memcpy(fCurrent->fData + fCurrent->fLength, source, bytesToCopy);
+		fCurrent->fLength += bytesToCopy;
+
+		source += bytesToCopy;
+		offset += bytesToCopy;
+		length -= bytesToCopy;
+
+		if (fCurrent->fLength == fCurrent->fCapacity)
+			_Submit(locker);
+	}
+
+	return B_OK;
+}
+
+
+/*! Writes out everything buffered and waits until it's on the server.
+    Returns the error of any deferred write which failed since the last call.
+*/
+status_t
+WriteBehind::Flush()
+{
+	AutoLocker<BLocker> locker(fLock);
+	_Drain(locker);
+	return _TakeError();
+}
+
+
+/*! Flushes and stops the worker thread. Must be called before the file handle
+    is closed. Errors are left for Flush() to report.
+*/
+void
+WriteBehind::Stop()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	if (fStopped)
+		return;
+
+	_Drain(locker);
+	fStopped = true;
+
+	thread_id worker = fWorker;
+	fWorker = -1;
+	if (worker >= 0)
+		release_sem(fWorkSem);
+	locker.Unlock();
+
+	if (worker >= 0) {
+		status_t result;
+		wait_for_thread(worker, &result);
+	}
+}
+
+
+/*! The end of the data that is still buffered, 0 if there is none. The
+    size the server reports doesn't include it yet.
+*/
+off_t
+WriteBehind::BufferedEnd()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	off_t end = fCurrent != NULL ? fCurrent->End() : 0;
+	for (BufferQueue::iterator it = fQueue.begin(); it != fQueue.end(); it++)
+		end = max_c(end, (*it)->End());
+	return end;
+}
+
+
+/*static*/ status_t
+WriteBehind::_WorkerEntry(void* data)
+{
+	static_cast<WriteBehind*>(data)->_Worker();
+	return B_OK;
+}
+
+
+void
+WriteBehind::_Worker()
+{
+	for (;;) {
+		// A buffer being filled doesn't wait for more writes forever
+		AutoLocker<BLocker> locker(fLock);
+		const bigtime_t timeout = fCurrent != NULL
+			? fCurrent->fCreated + kMaxBufferAge : B_INFINITE_TIMEOUT;
+		locker.Unlock();
+
+		status_t status = acquire_sem_etc(fWorkSem, 1, B_ABSOLUTE_TIMEOUT,
+			timeout);
+		if (status != B_OK && status != B_TIMED_OUT)
+			return;
+
+		locker.Lock();
+		if (status == B_TIMED_OUT && fCurrent != NULL
+			&& system_time() >= fCurrent->fCreated + kMaxBufferAge) {
+			TRACE("write buffer at %" B_PRIdOFF " after waiting",
+				fCurrent->fOffset);
+			// Not through _Submit(), which may wait for us
+			fQueue.push_back(fCurrent);
+			fCurrent = NULL;
+		}
+
+		if (fQueue.empty()) {
+			if (fStopped)
+				return;
+			continue;
+		}
+
+		// The buffer stays in the queue until it's written, so that
+		// _Drain() waits for it
+		Buffer* const buffer = fQueue.front();
+		locker.Unlock();
+
+		status = _WriteDirectly(buffer->fOffset, buffer->fData,
+			buffer->fLength);
+
+		locker.Lock();
+		fQueue.pop_front();
+		_FreeBuffer(buffer);
+
+		if (status != B_OK && fError == B_OK) {
+			TRACE("deferred write failed: %s", strerror(status));
+			fError = status;
+		}
+
+		if (fWaiters > 0) {
+			release_sem_etc(fDoneSem, fWaiters, 0);
+			fWaiters = 0;
+		}
+	}
+}
+
+
+status_t
+WriteBehind::_StartWorker()
+{
+	if (fWorker >= 0)
+		return B_OK;
+
+	if (fWorkSem < 0) {
+		fWorkSem = create_sem(0, "smb write-behind work");
+		if (fWorkSem < 0)
+			return fWorkSem;
+	}
+	if (fDoneSem < 0) {
+		fDoneSem = create_sem(0, "smb write-behind done");
+		if (fDoneSem < 0)
+			return fDoneSem;
+	}
+
+	fWorker = spawn_thread(&_WorkerEntry, "smb write-behind",
+		B_NORMAL_PRIORITY, this);
+	if (fWorker < 0) {
+		status_t status = fWorker;
+		fWorker = -1;
+		return status;
+	}
+	return resume_thread(fWorker);
+}
+
+
+status_t
+WriteBehind::_NewBuffer(off_t offset)
+{
+	status_t status = _StartWorker();
+	if (status != B_OK)
+		return status;
+
+	if (!fVolume->ReserveBufferMemory(fBufferSize))
+		return B_NO_MEMORY;
+
+	uint8* data = static_cast<uint8*>(malloc(fBufferSize));
+	fCurrent = data != NULL ? new(std::nothrow) Buffer(offset,
+		fBufferSize - offset % fBufferSize, data) : NULL;
+	if (fCurrent == NULL) {
+		free(data);
+		fVolume->UnreserveBufferMemory(fBufferSize);
+		return B_NO_MEMORY;
+	}
+
+	// Lets the worker time the buffer's age
+	release_sem(fWorkSem);
+	return B_OK;
+}
+
+
+void
+WriteBehind::_FreeBuffer(Buffer* buffer)
+{
+	delete buffer;
+	fVolume->UnreserveBufferMemory(fBufferSize);
+}
+
+
+/*! Hands the current buffer to the worker. Blocks while too many buffers are
+    already waiting, so a fast writer can't run far ahead of the server.
+*/
+void
+WriteBehind::_Submit(AutoLocker<BLocker>& locker)
+{
+	if (fCurrent == NULL)
+		return;
+
+	if (fCurrent->fLength == 0) {
+		_FreeBuffer(fCurrent);
+		fCurrent = NULL;
+		return;
+	}
+
+	fQueue.push_back(fCurrent);
+	fCurrent = NULL;
+	release_sem(fWorkSem);
+
+	while (fQueue.size() > kMaxQueuedBuffers)
+		_WaitForProgress(locker);
+}
+
+
+void
+WriteBehind::_Drain(AutoLocker<BLocker>& locker)
+{
+	_Submit(locker);
+
+	while (!fQueue.empty())
+		_WaitForProgress(locker);
+}
+
+
+void
+WriteBehind::_WaitForProgress(AutoLocker<BLocker>& locker)
+{
+	fWaiters++;
+	locker.Unlock();
+	acquire_sem(fDoneSem);
+	locker.Lock();
+}
+
+
+status_t
+WriteBehind::_WriteDirectly(off_t offset, const void* buffer, size_t length)
+{
+	const uint8* source = static_cast<const uint8*>(buffer);
+
+	SambaContextLease context(fContext);
+	while (length > 0) {
+		size_t bytesWritten = length;
+		status_t status = context->WriteAt(fFile, fPosition, offset, source,
+			&bytesWritten);
+		if (status != B_OK)
+			return status;
+		if (bytesWritten == 0)
+			return B_IO_ERROR;
+
+		source += bytesWritten;
+		offset += bytesWritten;
+		length -= bytesWritten;
+	}
+	return B_OK;
+}
+
+
+status_t
+WriteBehind::_TakeError()
+{
+	status_t status = fError;
+	fError = B_OK;
+	return status;
+}
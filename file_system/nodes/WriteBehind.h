@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_WRITE_BEHIND_H
+#define SMBFS_WRITE_BEHIND_H
+
+#include <Locker.h>
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include <libsmbclient.h>
+#include <private/shared/AutoLocker.h>
+
+#include <deque>
+
+
+namespace Smb {
+
+
+class SambaContext;
+class Volume;
+
+
+/*! Write-behind stage of an open file. Adjacent writes are collected into
+    io_size aligned buffers, which a worker thread writes to the server while
+    the application carries on. Anything buffered is written out on Flush(),
+    before a write that doesn't continue the previous one, and when the
+    volume's buffer memory budget runs out. A buffer that isn't filled up
+    is written once it has waited kMaxBufferAge. Errors of deferred writes
+    are returned by the next Write() or Flush().
+    Only cookies opened with O_NOCACHE have one, the others write through
+    the file cache.
+*/
+class WriteBehind {
+public:
+								WriteBehind(Volume* volume,
+									SambaContext* context, SMBCFILE* file,
+									off_t* position, size_t bufferSize);
+								~WriteBehind();
+
+			status_t			Write(off_t offset, const void* buffer,
+									size_t length);
+			status_t			Flush();
+			void				Stop();
+
+			off_t				BufferedEnd();
+
+private:
+	struct Buffer;
+	typedef std::deque<Buffer*> BufferQueue;
+
+	enum {
+		kMaxQueuedBuffers = 4,
+			// writers block when this many buffers wait for the server
+		kMaxBufferAge     = 1000 * 1000
+			// µsec a partly filled buffer waits for more writes
+	};
+
+private:
+	static	status_t			_WorkerEntry(void* data);
+			void				_Worker();
+
+			status_t			_StartWorker();
+			status_t			_NewBuffer(off_t offset);
+			void				_FreeBuffer(Buffer* buffer);
+			void				_Submit(AutoLocker<BLocker>& locker);
+			void				_Drain(AutoLocker<BLocker>& locker);
+			void				_WaitForProgress(
+									AutoLocker<BLocker>& locker);
+			status_t			_WriteDirectly(off_t offset,
+									const void* buffer, size_t length);
+			status_t			_TakeError();
+
+private:
+			Volume*				fVolume;
+			SambaContext*		fContext;
+			SMBCFILE*			fFile;
+			off_t*				fPosition;
+				// handle position, protected by fContext's lock
+			size_t				fBufferSize;
+
+			BLocker				fLock;
+			sem_id				fWorkSem;
+			sem_id				fDoneSem;
+			int32				fWaiters;
+			thread_id			fWorker;
+			bool				fStopped;
+
+			Buffer*				fCurrent;
+				// buffer being filled
+			BufferQueue			fQueue;
+				// full buffers, front one is being written by the worker
+			status_t			fError;
+				// first error of a deferred write, not yet reported
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_WRITE_BEHIND_H
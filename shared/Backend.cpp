@@ -0,0 +1,60 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "Backend.h"
+
+#include <string.h>
+
+#include "LocalBackend.h"
+#include "MemoryBackend.h"
+#include "SmbClientContext.h"
+
+
+using namespace Smb;
+
+
+Backend::~Backend()
+{
+}
+
+
+/*! Adds the names of all servers. B_NOT_SUPPORTED if they have to be
+    discovered on the network.
+*/
+status_t
+Backend::GetServers(NameList&)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
+/*! Adds the names of the server's shares. B_NOT_SUPPORTED if they have to
+    be discovered on the network.
+*/
+status_t
+Backend::GetShares(const char*, NameList&)
+{
+	return B_NOT_SUPPORTED;
+}
+
+
+/*! Creates the backend of the given type: "smb" (also if NULL), "memory",
+    or "local", which needs the directory to keep the shares in as root.
+    Returns NULL for an unknown type, or if out of memory.
+*/
+/*static*/ Backend*
+Backend::Create(const char* type, const char* root)
+{
+	if (type == NULL || strcmp(type, "smb") == 0)
+		return new(std::nothrow) SmbClientBackend;
+
+	if (strcmp(type, "memory") == 0)
+		return new(std::nothrow) MemoryBackend;
+
+	if (strcmp(type, "local") == 0 && root != NULL)
+		return new(std::nothrow) LocalBackend(root);
+
+	return NULL;
+}
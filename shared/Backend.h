@@ -0,0 +1,48 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_BACKEND_H
+#define SMBFS_BACKEND_H
+
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <vector>
+
+
+namespace Smb {
+
+
+class SambaContext;
+
+
+/*! Where the data of the shares lives: the SMB network through libsmbclient,
+    a tree in memory, or a local directory. Share URLs look the same for all
+    of them. A backend creates the contexts the operations go through, and
+    all contexts of one backend see the same data.
+    Backends which aren't the network list their servers and shares
+    themselves, there is nothing for the assistant to discover.
+*/
+class Backend {
+public:
+	typedef std::vector<BString> NameList;
+
+public:
+	virtual						~Backend();
+
+	virtual	SambaContext*		CreateContext() = 0;
+
+	virtual	status_t			GetServers(NameList& servers);
+	virtual	status_t			GetShares(const char* server,
+									NameList& shares);
+
+	static	Backend*			Create(const char* type, const char* root);
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_BACKEND_H
@@ -0,0 +1,413 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "CountingBackend.h"
+
+#include <String.h>
+#include <driver_settings.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "SambaContext.h"
+
+
+using namespace Smb;
+
+
+static pthread_once_t sCurrentScopeOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t sCurrentScope;
+	// innermost CountingBackend::Scope of the thread
+
+
+static const char* const kOperationNames[] = {
+	"stat",
+	"file_truncate",
+	"update_time",
+	"open",
+	"close",
+	"create",
+	"seek",
+	"read",
+	"write",
+	"unlink",
+	"rename",
+	"create_dir",
+	"remove_dir",
+	"open_dir",
+	"close_dir",
+	"seek_dir",
+	"get_directory_entry",
+	"get_directory_entry_plus"
+};
+
+
+// #pragma mark - CountingBackend::Context
+
+
+class CountingBackend::Context : public SambaContext {
+public:
+	Context(CountingBackend* backend, SambaContext* context)
+		:
+		fBackend(backend),
+		fContext(context)
+	{
+	}
+
+	virtual ~Context()
+	{
+		delete fContext;
+	}
+
+	virtual status_t Stat(const BString& url, struct stat* destination)
+	{
+		fBackend->_Count(kStat);
+		SambaContextLocker locker(fContext);
+		return fContext->Stat(url, destination);
+	}
+
+	virtual status_t FileTruncate(SMBCFILE* file, off_t newSize)
+	{
+		fBackend->_Count(kFileTruncate);
+		SambaContextLocker locker(fContext);
+		return fContext->FileTruncate(file, newSize);
+	}
+
+	virtual status_t UpdateTime(const BString& url,
+		const struct timespec& modificationTime)
+	{
+		fBackend->_Count(kUpdateTime);
+		SambaContextLocker locker(fContext);
+		return fContext->UpdateTime(url, modificationTime);
+	}
+
+	virtual status_t Open(const BString& url, int flags, SMBCFILE** outFile)
+	{
+		fBackend->_Count(kOpen);
+		SambaContextLocker locker(fContext);
+		return fContext->Open(url, flags, outFile);
+	}
+
+	virtual status_t Close(SMBCFILE* file)
+	{
+		fBackend->_Count(kClose);
+		SambaContextLocker locker(fContext);
+		return fContext->Close(file);
+	}
+
+	virtual status_t Create(const BString& url, mode_t mode,
+		SMBCFILE** outFile)
+	{
+		fBackend->_Count(kCreate);
+		SambaContextLocker locker(fContext);
+		return fContext->Create(url, mode, outFile);
+	}
+
+	virtual status_t Seek(SMBCFILE* file, off_t offset)
+	{
+		fBackend->_Count(kSeek);
+		SambaContextLocker locker(fContext);
+		return fContext->Seek(file, offset);
+	}
+
+	virtual status_t Read(SMBCFILE* file, void* buffer, size_t* count)
+	{
+		fBackend->_Count(kRead);
+		SambaContextLocker locker(fContext);
+		return fContext->Read(file, buffer, count);
+	}
+
+	virtual status_t Write(SMBCFILE* file, const void* buffer, size_t* count)
+	{
+		fBackend->_Count(kWrite);
+		SambaContextLocker locker(fContext);
+		return fContext->Write(file, buffer, count);
+	}
+
+	virtual status_t Unlink(const BString& url)
+	{
+		fBackend->_Count(kUnlink);
+		SambaContextLocker locker(fContext);
+		return fContext->Unlink(url);
+	}
+
+	virtual status_t Rename(const BString& fromURL, const BString& toURL)
+	{
+		fBackend->_Count(kRename);
+		SambaContextLocker locker(fContext);
+		return fContext->Rename(fromURL, toURL);
+	}
+
+	virtual status_t CreateDir(const BString& url, mode_t mode)
+	{
+		fBackend->_Count(kCreateDir);
+		SambaContextLocker locker(fContext);
+		return fContext->CreateDir(url, mode);
+	}
+
+	virtual status_t RemoveDir(const BString& url)
+	{
+		fBackend->_Count(kRemoveDir);
+		SambaContextLocker locker(fContext);
+		return fContext->RemoveDir(url);
+	}
+
+	virtual status_t OpenDir(const BString& url, SMBCFILE** outDir)
+	{
+		fBackend->_Count(kOpenDir);
+		SambaContextLocker locker(fContext);
+		return fContext->OpenDir(url, outDir);
+	}
+
+	virtual status_t CloseDir(SMBCFILE* dir)
+	{
+		fBackend->_Count(kCloseDir);
+		SambaContextLocker locker(fContext);
+		return fContext->CloseDir(dir);
+	}
+
+	virtual status_t SeekDir(SMBCFILE* dir, off_t offset)
+	{
+		fBackend->_Count(kSeekDir);
+		SambaContextLocker locker(fContext);
+		return fContext->SeekDir(dir, offset);
+	}
+
+	virtual status_t GetDirectoryEntry(SMBCFILE* dir, smbc_dirent** outEntry)
+	{
+		fBackend->_Count(kGetDirectoryEntry);
+		SambaContextLocker locker(fContext);
+		return fContext->GetDirectoryEntry(dir, outEntry);
+	}
+
+	virtual status_t GetDirectoryEntryPlus(SMBCFILE* dir,
+		const libsmb_file_info** outInfo)
+	{
+		fBackend->_Count(kGetDirectoryEntryPlus);
+		SambaContextLocker locker(fContext);
+		return fContext->GetDirectoryEntryPlus(dir, outInfo);
+	}
+
+private:
+	CountingBackend*	fBackend;
+	SambaContext*		fContext;
+};
+
+
+// #pragma mark - CountingBackend::Scope
+
+
+CountingBackend::Scope::Scope(CountingBackend* backend, int32 scope)
+	:
+	fBackend(backend),
+	fScope(scope),
+	fCalls(0),
+	fPrevious(NULL)
+{
+	if (fBackend == NULL)
+		return;
+
+	fPrevious = static_cast<Scope*>(pthread_getspecific(sCurrentScope));
+	pthread_setspecific(sCurrentScope, this);
+}
+
+
+CountingBackend::Scope::~Scope()
+{
+	if (fBackend == NULL)
+		return;
+
+	pthread_setspecific(sCurrentScope, fPrevious);
+	fBackend->_EndScope(this);
+}
+
+
+// #pragma mark - CountingBackend
+
+
+/*! Takes over the given backend. The scope names must stay valid, scope 0
+    is for the calls made outside of any scope.
+*/
+CountingBackend::CountingBackend(Backend* backend,
+	const char* const* scopeNames, int32 scopeCount)
+	:
+	fBackend(backend),
+	fScopeNames(scopeNames),
+	fScopeCount(scopeCount),
+	fCounts(new(std::nothrow) Counts[scopeCount])
+{
+	pthread_once(&sCurrentScopeOnce, &_InitCurrentScope);
+
+	if (fCounts == NULL)
+		return;
+
+	for (int32 i = 0; i < fScopeCount; i++) {
+		Counts& counts = fCounts[i];
+		for (int32 j = 0; j < kOperationCount; j++)
+			counts.calls[j] = 0;
+		counts.runs = 0;
+		counts.maxCallsPerRun = 0;
+		counts.runsOverBudget = 0;
+		counts.budget = kNoBudget;
+	}
+}
+
+
+CountingBackend::~CountingBackend()
+{
+	delete[] fCounts;
+	delete fBackend;
+}
+
+
+status_t
+CountingBackend::InitCheck() const
+{
+	return fCounts != NULL ? B_OK : B_NO_MEMORY;
+}
+
+
+SambaContext*
+CountingBackend::CreateContext()
+{
+	SambaContext* const context = fBackend->CreateContext();
+	if (context == NULL)
+		return NULL;
+
+	Context* const countingContext = new(std::nothrow) Context(this, context);
+	if (countingContext == NULL)
+		delete context;
+	return countingContext;
+}
+
+
+/*! Discovery isn't a context operation, it's not counted.
+*/
+status_t
+CountingBackend::GetServers(NameList& servers)
+{
+	return fBackend->GetServers(servers);
+}
+
+
+status_t
+CountingBackend::GetShares(const char* server, NameList& shares)
+{
+	return fBackend->GetShares(server, shares);
+}
+
+
+/*! Takes the budgets from the driver settings, as "call_budget_<scope>
+    <calls per run>", e.g. "call_budget_read_dir 1". Must be called before
+    the backend is used.
+*/
+void
+CountingBackend::SetBudgets(void* settings)
+{
+	for (int32 i = 0; i < fScopeCount; i++) {
+		BString name("call_budget_");
+		name << fScopeNames[i];
+
+		const char* value = get_driver_parameter(settings, name.String(),
+			NULL, NULL);
+		if (value != NULL)
+			fCounts[i].budget = strtoll(value, NULL, 10);
+	}
+}
+
+
+int64
+CountingBackend::Count(int32 scope, Operation operation)
+{
+	return atomic_get64(&fCounts[scope].calls[operation]);
+}
+
+
+/*! Prints the runs of each scope, the calls they made per operation, and
+    the budgets they exceeded. The last line says whether all runs were
+    within budget, which is also returned.
+*/
+bool
+CountingBackend::Report(FILE* output)
+{
+	bool withinBudget = true;
+
+	for (int32 i = 0; i < fScopeCount; i++) {
+		Counts& counts = fCounts[i];
+		int64 calls = 0;
+		for (int32 j = 0; j < kOperationCount; j++)
+			calls += Count(i, (Operation)j);
+		if (calls == 0 && counts.runsOverBudget == 0)
+			continue;
+
+		fprintf(output, "%s: %" B_PRId64 " calls", fScopeNames[i], calls);
+		if (i != 0) {
+			fprintf(output, " in %" B_PRId64 " runs, at most %" B_PRId64
+				" per run", counts.runs, counts.maxCallsPerRun);
+		}
+		if (counts.runsOverBudget > 0) {
+			fprintf(output, ", %" B_PRId64 " runs over budget of %" B_PRId64,
+				counts.runsOverBudget, counts.budget);
+			withinBudget = false;
+		}
+		fputc('\n', output);
+
+		for (int32 j = 0; j < kOperationCount; j++) {
+			const int64 count = Count(i, (Operation)j);
+			if (count > 0) {
+				fprintf(output, "    %-26s %10" B_PRId64 "\n",
+					kOperationNames[j], count);
+			}
+		}
+	}
+
+	fprintf(output, "%s\n", withinBudget ? "within budget" : "over budget");
+	return withinBudget;
+}
+
+
+void
+CountingBackend::_Count(Operation operation)
+{
+	Scope* const scope = static_cast<Scope*>(
+		pthread_getspecific(sCurrentScope));
+	if (scope != NULL && scope->fBackend == this) {
+		scope->fCalls++;
+		atomic_add64(&fCounts[scope->fScope].calls[operation], 1);
+	} else
+		atomic_add64(&fCounts[0].calls[operation], 1);
+}
+
+
+void
+CountingBackend::_EndScope(Scope* scope)
+{
+	Counts& counts = fCounts[scope->fScope];
+	atomic_add64(&counts.runs, 1);
+
+	int64 maxCalls = atomic_get64(&counts.maxCallsPerRun);
+	while (scope->fCalls > maxCalls) {
+		const int64 previous = atomic_test_and_set64(&counts.maxCallsPerRun,
+			scope->fCalls, maxCalls);
+		if (previous == maxCalls)
+			break;
+		maxCalls = previous;
+	}
+
+	if (counts.budget != kNoBudget && scope->fCalls > counts.budget) {
+		if (atomic_add64(&counts.runsOverBudget, 1) == 0) {
+			fprintf(stderr, "SMB-FS: %s made %" B_PRId64 " calls, over budget "
+				"of %" B_PRId64 "\n", fScopeNames[scope->fScope],
+				scope->fCalls, counts.budget);
+		}
+	}
+}
+
+
+/*static*/ void
+CountingBackend::_InitCurrentScope()
+{
+	pthread_key_create(&sCurrentScope, NULL);
+}
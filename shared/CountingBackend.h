@@ -0,0 +1,122 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_COUNTING_BACKEND_H
+#define SMBFS_COUNTING_BACKEND_H
+
+#include <SupportDefs.h>
+
+#include <stdio.h>
+
+#include "Backend.h"
+
+
+namespace Smb {
+
+
+/*! Counts the calls to the contexts of another backend, per operation, and
+    per scope they are made in. A scope is what the calling thread is doing
+    for its caller, e.g. the file system operation it runs; calls outside
+    of any scope go to scope 0.
+    Each scope can be given a budget of calls per run. A run over budget is
+    reported right away, and makes the report fail, so a scripted workload
+    shows which change made an operation more expensive.
+*/
+class CountingBackend : public Backend {
+public:
+	enum Operation {
+		kStat = 0,
+		kFileTruncate,
+		kUpdateTime,
+		kOpen,
+		kClose,
+		kCreate,
+		kSeek,
+		kRead,
+		kWrite,
+		kUnlink,
+		kRename,
+		kCreateDir,
+		kRemoveDir,
+		kOpenDir,
+		kCloseDir,
+		kSeekDir,
+		kGetDirectoryEntry,
+		kGetDirectoryEntryPlus,
+
+		kOperationCount
+	};
+
+	/*! Accounts the calls the thread makes to the scope while it exists.
+	    Scopes nest, calls go to the innermost one. Does nothing without a
+	    backend, so it can be used whether calls are counted or not.
+	*/
+	class Scope {
+	public:
+								Scope(CountingBackend* backend, int32 scope);
+								~Scope();
+
+	private:
+		friend class CountingBackend;
+
+			CountingBackend*	fBackend;
+			int32				fScope;
+			int64				fCalls;
+			Scope*				fPrevious;
+	};
+
+								CountingBackend(Backend* backend,
+									const char* const* scopeNames,
+									int32 scopeCount);
+	virtual						~CountingBackend();
+
+			status_t			InitCheck() const;
+
+	virtual	SambaContext*		CreateContext();
+
+	virtual	status_t			GetServers(NameList& servers);
+	virtual	status_t			GetShares(const char* server,
+									NameList& shares);
+
+			void				SetBudgets(void* settings);
+
+			int64				Count(int32 scope, Operation operation);
+			bool				Report(FILE* output);
+
+private:
+	class Context;
+
+	// Per scope
+	struct Counts {
+			int64				calls[kOperationCount];
+			int64				runs;
+			int64				maxCallsPerRun;
+			int64				runsOverBudget;
+			int64				budget;
+				// calls per run
+	};
+
+	enum {
+		kNoBudget = -1
+	};
+
+private:
+			void				_Count(Operation operation);
+			void				_EndScope(Scope* scope);
+
+	static	void				_InitCurrentScope();
+
+private:
+			Backend*			fBackend;
+			const char* const*	fScopeNames;
+			int32				fScopeCount;
+			Counts*				fCounts;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_COUNTING_BACKEND_H
@@ -0,0 +1,426 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "LocalBackend.h"
+
+#include <private/shared/AutoLocker.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "SambaContext.h"
+
+
+using namespace Smb;
+
+
+// #pragma mark - LocalBackend::Handle
+
+
+struct LocalBackend::Handle {
+	Handle()
+		:
+		fFD(-1),
+		fDir(NULL)
+	{
+	}
+
+	int				fFD;
+	DIR*			fDir;
+	BString			fPath;
+		// of the directory, to stat its entries
+	BString			fName;
+	libsmb_file_info fInfo;
+	union {
+		smbc_dirent	fEntry;
+		char		fEntryBuffer[sizeof(smbc_dirent) + B_FILE_NAME_LENGTH];
+	};
+};
+
+
+// #pragma mark - LocalBackend::Context
+
+
+class LocalBackend::Context : public SambaContext {
+public:
+	Context(LocalBackend* backend)
+		:
+		fBackend(backend)
+	{
+	}
+
+	virtual status_t Stat(const BString& url, struct stat* destination)
+	{
+		BString path;
+		status_t status = fBackend->_Path(url, path);
+		if (status != B_OK)
+			return status;
+		return _GetStatus(stat(path.String(), destination));
+	}
+
+	virtual status_t FileTruncate(SMBCFILE* file, off_t newSize)
+	{
+		return _GetStatus(ftruncate(_HandleFor(file)->fFD, newSize));
+	}
+
+	virtual status_t UpdateTime(const BString& url,
+		const struct timespec& modificationTime)
+	{
+		BString path;
+		status_t status = fBackend->_Path(url, path);
+		if (status != B_OK)
+			return status;
+
+		// Like libsmbclient, both times are set
+		timeval times[2];
+		times[0].tv_sec = modificationTime.tv_sec;
+		times[0].tv_usec = modificationTime.tv_nsec / 1000;
+		times[1] = times[0];
+		return _GetStatus(utimes(path.String(), times));
+	}
+
+	virtual status_t Open(const BString& url, int flags, SMBCFILE** outFile)
+	{
+		BString path;
+		status_t status = fBackend->_Path(url, path);
+		if (status != B_OK)
+			return status;
+
+		Handle* const handle = new(std::nothrow) Handle;
+		if (handle == NULL)
+			return B_NO_MEMORY;
+
+		handle->fFD = open(path.String(), flags, 0644);
+		if (handle->fFD < 0) {
+			status = errno;
+			delete handle;
+			return status;
+		}
+
+		// SMB doesn't open directories as files
+		struct stat st;
+		if (fstat(handle->fFD, &st) == 0 && S_ISDIR(st.st_mode)) {
+			close(handle->fFD);
+			delete handle;
+			return B_IS_A_DIRECTORY;
+		}
+
+		*outFile = reinterpret_cast<SMBCFILE*>(handle);
+		return B_OK;
+	}
+
+	virtual status_t Close(SMBCFILE* file)
+	{
+		Handle* const handle = _HandleFor(file);
+		status_t status = _GetStatus(close(handle->fFD));
+		delete handle;
+		return status;
+	}
+
+	virtual status_t Create(const BString& url, mode_t, SMBCFILE** outFile)
+	{
+		return Open(url, O_CREAT | O_WRONLY | O_TRUNC, outFile);
+	}
+
+	virtual status_t Seek(SMBCFILE* file, off_t offset)
+	{
+		return lseek(_HandleFor(file)->fFD, offset, SEEK_SET) != -1
+			? B_OK : errno;
+	}
+
+	virtual status_t Read(SMBCFILE* file, void* buffer, size_t* count)
+	{
+		ssize_t bytesRead = read(_HandleFor(file)->fFD, buffer, *count);
+		if (bytesRead < 0)
+			return errno;
+		*count = bytesRead;
+		return B_OK;
+	}
+
+	virtual status_t Write(SMBCFILE* file, const void* buffer, size_t* count)
+	{
+		ssize_t bytesWritten = write(_HandleFor(file)->fFD, buffer, *count);
+		if (bytesWritten < 0)
+			return errno;
+		*count = bytesWritten;
+		return B_OK;
+	}
+
+	virtual status_t Unlink(const BString& url)
+	{
+		BString path;
+		status_t status = fBackend->_Path(url, path);
+		if (status != B_OK)
+			return status;
+		return _GetStatus(unlink(path.String()));
+	}
+
+	virtual status_t Rename(const BString& fromURL, const BString& toURL)
+	{
+		BString fromPath;
+		BString toPath;
+		status_t status = fBackend->_Path(fromURL, fromPath);
+		if (status == B_OK)
+			status = fBackend->_Path(toURL, toPath);
+		if (status != B_OK)
+			return status;
+		return _GetStatus(rename(fromPath.String(), toPath.String()));
+	}
+
+	virtual status_t CreateDir(const BString& url, mode_t mode)
+	{
+		BString path;
+		status_t status = fBackend->_Path(url, path);
+		if (status != B_OK)
+			return status;
+		return _GetStatus(mkdir(path.String(), mode));
+	}
+
+	virtual status_t RemoveDir(const BString& url)
+	{
+		BString path;
+		status_t status = fBackend->_Path(url, path);
+		if (status != B_OK)
+			return status;
+		return _GetStatus(rmdir(path.String()));
+	}
+
+	virtual status_t OpenDir(const BString& url, SMBCFILE** outDir)
+	{
+		Handle* const handle = new(std::nothrow) Handle;
+		if (handle == NULL)
+			return B_NO_MEMORY;
+
+		status_t status = fBackend->_Path(url, handle->fPath);
+		if (status != B_OK) {
+			delete handle;
+			return status;
+		}
+
+		handle->fDir = opendir(handle->fPath.String());
+		if (handle->fDir == NULL) {
+			status = errno;
+			delete handle;
+			return status;
+		}
+
+		*outDir = reinterpret_cast<SMBCFILE*>(handle);
+		return B_OK;
+	}
+
+	virtual status_t CloseDir(SMBCFILE* dir)
+	{
+		Handle* const handle = _HandleFor(dir);
+		status_t status = _GetStatus(closedir(handle->fDir));
+		delete handle;
+		return status;
+	}
+
+	virtual status_t SeekDir(SMBCFILE* dir, off_t offset)
+	{
+		Handle* const handle = _HandleFor(dir);
+		if (offset == 0)
+			rewinddir(handle->fDir);
+		else
+			seekdir(handle->fDir, offset);
+		return B_OK;
+	}
+
+	virtual status_t GetDirectoryEntry(SMBCFILE* dir, smbc_dirent** outEntry)
+	{
+		Handle* const handle = _HandleFor(dir);
+		struct stat st;
+		status_t status = _NextEntry(handle, &st);
+		if (status != B_OK)
+			return status;
+
+		smbc_dirent& entry = handle->fEntry;
+		entry.smbc_type = S_ISDIR(st.st_mode) ? SMBC_DIR : SMBC_FILE;
+		entry.comment = NULL;
+		entry.commentlen = 0;
+		entry.namelen = strlcpy(entry.name, handle->fName.String(),
+			B_FILE_NAME_LENGTH);
+		entry.dirlen = sizeof(smbc_dirent) + entry.namelen;
+
+		*outEntry = &entry;
+		return B_OK;
+	}
+
+	virtual status_t GetDirectoryEntryPlus(SMBCFILE* dir,
+		const libsmb_file_info** outInfo)
+	{
+		Handle* const handle = _HandleFor(dir);
+		struct stat st;
+		status_t status = _NextEntry(handle, &st);
+		if (status != B_OK)
+			return status;
+
+		libsmb_file_info& info = handle->fInfo;
+		memset(&info, 0, sizeof(info));
+		info.size = st.st_size;
+		if (S_ISDIR(st.st_mode))
+			info.attrs |= SMBC_DOS_MODE_DIRECTORY;
+		if ((st.st_mode & S_IWUSR) == 0)
+			info.attrs |= SMBC_DOS_MODE_READONLY;
+		info.uid = st.st_uid;
+		info.gid = st.st_gid;
+		info.btime_ts = st.st_crtim;
+		info.mtime_ts = st.st_mtim;
+		info.atime_ts = st.st_atim;
+		info.ctime_ts = st.st_ctim;
+		info.name = const_cast<char*>(handle->fName.String());
+			// stays valid until the next entry is read
+
+		*outInfo = &info;
+		return B_OK;
+	}
+
+private:
+	static Handle* _HandleFor(SMBCFILE* file)
+	{
+		return reinterpret_cast<Handle*>(file);
+	}
+
+	static status_t _GetStatus(int result)
+	{
+		return result == 0 ? B_OK : errno;
+	}
+
+	/*! Reads the next entry which can still be stat()ed into the handle's
+	    fName.
+	*/
+	static status_t _NextEntry(Handle* handle, struct stat* st)
+	{
+		for (;;) {
+			errno = 0;
+			struct dirent* const entry = readdir(handle->fDir);
+			if (entry == NULL)
+				return errno == 0 ? B_ENTRY_NOT_FOUND : errno;
+
+			BString path(handle->fPath);
+			path << '/' << entry->d_name;
+			if (stat(path.String(), st) != 0) {
+				// Removed since it was listed
+				continue;
+			}
+
+			handle->fName = entry->d_name;
+			return B_OK;
+		}
+	}
+
+private:
+	LocalBackend*	fBackend;
+};
+
+
+// #pragma mark - LocalBackend
+
+
+LocalBackend::LocalBackend(const char* root)
+	:
+	fRoot(root)
+{
+}
+
+
+LocalBackend::~LocalBackend()
+{
+}
+
+
+SambaContext*
+LocalBackend::CreateContext()
+{
+	return new(std::nothrow) Context(this);
+}
+
+
+/*! The servers are the directories in the root.
+*/
+status_t
+LocalBackend::GetServers(NameList& servers)
+{
+	return _GetDirectories(fRoot, servers);
+}
+
+
+status_t
+LocalBackend::GetShares(const char* server, NameList& shares)
+{
+	BString path(fRoot);
+	path << '/' << server;
+	return _GetDirectories(path, shares);
+}
+
+
+/*! Maps the URL to the local path, and creates the server and share
+    directories on the way, if they don't exist yet.
+*/
+status_t
+LocalBackend::_Path(const BString& url, BString& path)
+{
+	static const char kPrefix[] = "smb://";
+	const int32 prefixLength = sizeof(kPrefix) - 1;
+
+	const int32 start = url.FindFirst(kPrefix) == 0 ? prefixLength : 0;
+	path = fRoot;
+
+	int32 end = start;
+	for (int32 level = 0; level < 2 && end < url.Length(); level++) {
+		end = url.FindFirst('/', end + 1);
+		if (end < 0)
+			end = url.Length();
+
+		BString directory(fRoot);
+		BString name;
+		url.CopyInto(name, start, end - start);
+		directory << '/' << name;
+
+		AutoLocker<BLocker> locker(fLock);
+		if (fCreatedDirectories.find(directory) != fCreatedDirectories.end())
+			continue;
+		if (mkdir(directory.String(), 0755) != 0 && errno != EEXIST)
+			return errno;
+		fCreatedDirectories.insert(directory);
+	}
+
+	BString rest;
+	url.CopyInto(rest, start, url.Length() - start);
+	if (rest.Length() > 0)
+		path << '/' << rest;
+	return B_OK;
+}
+
+
+/*static*/ status_t
+LocalBackend::_GetDirectories(const BString& path, NameList& names)
+{
+	DIR* const dir = opendir(path.String());
+	if (dir == NULL)
+		return errno;
+
+	while (struct dirent* entry = readdir(dir)) {
+		if (strcmp(entry->d_name, ".") == 0
+			|| strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		BString entryPath(path);
+		entryPath << '/' << entry->d_name;
+		struct stat st;
+		if (stat(entryPath.String(), &st) == 0 && S_ISDIR(st.st_mode))
+			names.push_back(entry->d_name);
+	}
+
+	closedir(dir);
+	return B_OK;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_LOCAL_BACKEND_H
+#define SMBFS_LOCAL_BACKEND_H
+
+#include <Locker.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <set>
+
+#include "Backend.h"
+
+
+namespace Smb {
+
+
+/*! Keeps the shares in a local directory: "smb://server/share/path" is
+    "<root>/server/share/path" there. Server and share directories are
+    created when first used. Every operation is passed through to the
+    local file system.
+*/
+class LocalBackend : public Backend {
+public:
+								LocalBackend(const char* root);
+	virtual						~LocalBackend();
+
+	virtual	SambaContext*		CreateContext();
+
+	virtual	status_t			GetServers(NameList& servers);
+	virtual	status_t			GetShares(const char* server,
+									NameList& shares);
+
+private:
+	class Context;
+	struct Handle;
+
+private:
+			status_t			_Path(const BString& url, BString& path);
+	static	status_t			_GetDirectories(const BString& path,
+									NameList& names);
+
+private:
+			BString				fRoot;
+			BLocker				fLock;
+			std::set<BString>	fCreatedDirectories;
+				// server and share directories known to exist
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_LOCAL_BACKEND_H
@@ -0,0 +1,711 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "MemoryBackend.h"
+
+#include <private/shared/AutoLocker.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+
+#include "SambaContext.h"
+
+
+using namespace Smb;
+
+
+static timespec
+current_time()
+{
+	timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	return now;
+}
+
+
+// #pragma mark - MemoryBackend::Node
+
+
+/*! A file or directory. Referenced by its directory entry and by the
+    handles open on it, so it outlives being unlinked while still open.
+*/
+struct MemoryBackend::Node {
+	typedef std::map<BString, Node*> EntryMap;
+
+	Node(bool isDirectory, mode_t mode)
+		:
+		fIsDirectory(isDirectory),
+		fMode(mode & 0777),
+		fData(NULL),
+		fSize(0),
+		fCapacity(0),
+		fReferences(1)
+	{
+		fCreated = fModified = fAccessed = fChanged = current_time();
+	}
+
+	~Node()
+	{
+		for (EntryMap::iterator it = fEntries.begin(); it != fEntries.end();
+				it++) {
+			it->second->Release();
+		}
+		free(fData);
+	}
+
+	void Acquire()
+	{
+		fReferences++;
+	}
+
+	void Release()
+	{
+		if (--fReferences == 0)
+			delete this;
+	}
+
+	Node* Find(const BString& name)
+	{
+		EntryMap::iterator it = fEntries.find(name);
+		return it != fEntries.end() ? it->second : NULL;
+	}
+
+	void Touch()
+	{
+		fModified = fChanged = current_time();
+	}
+
+	status_t SetSize(off_t size)
+	{
+		if (size < 0)
+			return B_BAD_VALUE;
+
+		if ((size_t)size > fCapacity) {
+			size_t capacity = max_c(fCapacity * 2, (size_t)4096);
+			while (capacity < (size_t)size)
+				capacity *= 2;
+
+			uint8* const data = static_cast<uint8*>(realloc(fData, capacity));
+			if (data == NULL)
+				return B_NO_MEMORY;
+			fData = data;
+			fCapacity = capacity;
+		}
+
+		if ((size_t)size > fSize)
+			memset(fData + fSize, 0, size - fSize);
+		fSize = size;
+		Touch();
+		return B_OK;
+	}
+
+	void GetStat(struct stat* st) const
+	{
+		memset(st, 0, sizeof(*st));
+		st->st_mode = (fIsDirectory ? S_IFDIR : S_IFREG) | fMode;
+		st->st_nlink = fIsDirectory ? 2 : 1;
+		st->st_uid = getuid();
+		st->st_gid = getgid();
+		st->st_size = fSize;
+		st->st_blksize = 4096;
+		st->st_blocks = (fSize + 511) / 512;
+		st->st_atim = fAccessed;
+		st->st_mtim = fModified;
+		st->st_ctim = fChanged;
+		st->st_crtim = fCreated;
+	}
+
+	bool			fIsDirectory;
+	mode_t			fMode;
+	uint8*			fData;
+	size_t			fSize;
+	size_t			fCapacity;
+	timespec		fCreated;
+	timespec		fModified;
+	timespec		fAccessed;
+	timespec		fChanged;
+	EntryMap		fEntries;
+		// directories only
+	int32			fReferences;
+};
+
+
+// #pragma mark - MemoryBackend::Handle
+
+
+/*! An open file or directory. A directory handle lists the names the
+    directory had when it was opened, and skips those removed since.
+*/
+struct MemoryBackend::Handle {
+	Handle(Node* node, int openMode)
+		:
+		fNode(node),
+		fOpenMode(openMode),
+		fPosition(0),
+		fIndex(0)
+	{
+		fNode->Acquire();
+		if (fNode->fIsDirectory) {
+			fNames.push_back(".");
+			fNames.push_back("..");
+			for (Node::EntryMap::iterator it = fNode->fEntries.begin();
+					it != fNode->fEntries.end(); it++) {
+				fNames.push_back(it->first);
+			}
+		}
+	}
+
+	~Handle()
+	{
+		fNode->Release();
+	}
+
+	/*! Returns the next entry still there, the dot entries refer to the
+	    directory itself.
+	*/
+	Node* NextEntry(const BString** outName)
+	{
+		while (fIndex < fNames.size()) {
+			const BString& name = fNames[fIndex++];
+			Node* const node = name == "." || name == ".."
+				? fNode : fNode->Find(name);
+			if (node != NULL) {
+				*outName = &name;
+				return node;
+			}
+		}
+		return NULL;
+	}
+
+	Node*			fNode;
+	int				fOpenMode;
+	off_t			fPosition;
+
+	PathList		fNames;
+	size_t			fIndex;
+	libsmb_file_info fInfo;
+	union {
+		smbc_dirent	fEntry;
+		char		fEntryBuffer[sizeof(smbc_dirent) + B_FILE_NAME_LENGTH];
+	};
+};
+
+
+// #pragma mark - MemoryBackend::Context
+
+
+class MemoryBackend::Context : public SambaContext {
+public:
+	Context(MemoryBackend* backend)
+		:
+		fBackend(backend)
+	{
+	}
+
+	virtual status_t Stat(const BString& url, struct stat* destination)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Node* node;
+		status_t status = fBackend->_Resolve(url, &node);
+		if (status != B_OK)
+			return status;
+
+		node->GetStat(destination);
+		return B_OK;
+	}
+
+	virtual status_t FileTruncate(SMBCFILE* file, off_t newSize)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Handle* const handle = _HandleFor(file);
+		if ((handle->fOpenMode & O_ACCMODE) == O_RDONLY)
+			return B_NOT_ALLOWED;
+		return handle->fNode->SetSize(newSize);
+	}
+
+	virtual status_t UpdateTime(const BString& url,
+		const struct timespec& modificationTime)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Node* node;
+		status_t status = fBackend->_Resolve(url, &node);
+		if (status != B_OK)
+			return status;
+
+		node->fModified = node->fAccessed = modificationTime;
+		node->fChanged = current_time();
+		return B_OK;
+	}
+
+	virtual status_t Open(const BString& url, int flags, SMBCFILE** outFile)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Node* directory;
+		BString name;
+		status_t status = fBackend->_ResolveParent(url, &directory, &name);
+		if (status != B_OK)
+			return status;
+
+		Node* node = directory->Find(name);
+		if (node == NULL) {
+			if ((flags & O_CREAT) == 0)
+				return B_ENTRY_NOT_FOUND;
+
+			node = new(std::nothrow) Node(false, 0644);
+			if (node == NULL)
+				return B_NO_MEMORY;
+			directory->fEntries[name] = node;
+			directory->Touch();
+		} else if ((flags & O_CREAT) != 0 && (flags & O_EXCL) != 0)
+			return B_FILE_EXISTS;
+
+		if (node->fIsDirectory)
+			return B_IS_A_DIRECTORY;
+
+		Handle* const handle = new(std::nothrow) Handle(node, flags);
+		if (handle == NULL)
+			return B_NO_MEMORY;
+
+		if ((flags & O_TRUNC) != 0 && (flags & O_ACCMODE) != O_RDONLY)
+			node->SetSize(0);
+		if ((flags & O_APPEND) != 0)
+			handle->fPosition = node->fSize;
+
+		*outFile = reinterpret_cast<SMBCFILE*>(handle);
+		return B_OK;
+	}
+
+	virtual status_t Close(SMBCFILE* file)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		delete _HandleFor(file);
+		return B_OK;
+	}
+
+	virtual status_t Create(const BString& url, mode_t, SMBCFILE** outFile)
+	{
+		return Open(url, O_CREAT | O_WRONLY | O_TRUNC, outFile);
+	}
+
+	virtual status_t Seek(SMBCFILE* file, off_t offset)
+	{
+		if (offset < 0)
+			return B_BAD_VALUE;
+
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		_HandleFor(file)->fPosition = offset;
+		return B_OK;
+	}
+
+	virtual status_t Read(SMBCFILE* file, void* buffer, size_t* count)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Handle* const handle = _HandleFor(file);
+		if ((handle->fOpenMode & O_ACCMODE) == O_WRONLY)
+			return B_NOT_ALLOWED;
+
+		Node* const node = handle->fNode;
+		size_t length = 0;
+		if (handle->fPosition < (off_t)node->fSize) {
+			length = min_c(*count, node->fSize - (size_t)handle->fPosition);
+			memcpy(buffer, node->fData + handle->fPosition, length);
+		}
+
+		handle->fPosition += length;
+		node->fAccessed = current_time();
+		*count = length;
+		return B_OK;
+	}
+
+	virtual status_t Write(SMBCFILE* file, const void* buffer, size_t* count)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Handle* const handle = _HandleFor(file);
+		if ((handle->fOpenMode & O_ACCMODE) == O_RDONLY)
+			return B_NOT_ALLOWED;
+
+		Node* const node = handle->fNode;
+		if ((handle->fOpenMode & O_APPEND) != 0)
+			handle->fPosition = node->fSize;
+
+		const off_t end = handle->fPosition + *count;
+		if (end > (off_t)node->fSize) {
+			status_t status = node->SetSize(end);
+			if (status != B_OK)
+				return status;
+		}
+
+		memcpy(node->fData + handle->fPosition, buffer, *count);
+		handle->fPosition = end;
+		node->Touch();
+		return B_OK;
+	}
+
+	virtual status_t Unlink(const BString& url)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Node* directory;
+		BString name;
+		status_t status = fBackend->_ResolveParent(url, &directory, &name);
+		if (status != B_OK)
+			return status;
+
+		Node* const node = directory->Find(name);
+		if (node == NULL)
+			return B_ENTRY_NOT_FOUND;
+		if (node->fIsDirectory)
+			return B_IS_A_DIRECTORY;
+
+		directory->fEntries.erase(name);
+		directory->Touch();
+		node->Release();
+		return B_OK;
+	}
+
+	virtual status_t Rename(const BString& fromURL, const BString& toURL)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Node* fromDirectory;
+		BString fromName;
+		status_t status = fBackend->_ResolveParent(fromURL, &fromDirectory,
+			&fromName);
+		if (status != B_OK)
+			return status;
+
+		Node* toDirectory;
+		BString toName;
+		status = fBackend->_ResolveParent(toURL, &toDirectory, &toName);
+		if (status != B_OK)
+			return status;
+
+		Node* const node = fromDirectory->Find(fromName);
+		if (node == NULL)
+			return B_ENTRY_NOT_FOUND;
+		if (fromDirectory == toDirectory && fromName == toName)
+			return B_OK;
+
+		// A directory can't go below itself
+		BString fromPrefix(fromURL);
+		fromPrefix << '/';
+		if (node->fIsDirectory && toURL.StartsWith(fromPrefix.String()))
+			return B_BAD_VALUE;
+
+		Node* const replaced = toDirectory->Find(toName);
+		if (replaced != NULL) {
+			if (replaced->fIsDirectory != node->fIsDirectory) {
+				return replaced->fIsDirectory
+					? B_IS_A_DIRECTORY : B_NOT_A_DIRECTORY;
+			}
+			if (!replaced->fEntries.empty())
+				return B_DIRECTORY_NOT_EMPTY;
+			replaced->Release();
+		}
+
+		toDirectory->fEntries[toName] = node;
+		fromDirectory->fEntries.erase(fromName);
+		fromDirectory->Touch();
+		toDirectory->Touch();
+		node->fChanged = current_time();
+		return B_OK;
+	}
+
+	virtual status_t CreateDir(const BString& url, mode_t mode)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Node* directory;
+		BString name;
+		status_t status = fBackend->_ResolveParent(url, &directory, &name);
+		if (status != B_OK)
+			return status;
+
+		if (directory->Find(name) != NULL)
+			return B_FILE_EXISTS;
+
+		Node* const node = new(std::nothrow) Node(true, mode);
+		if (node == NULL)
+			return B_NO_MEMORY;
+
+		directory->fEntries[name] = node;
+		directory->Touch();
+		return B_OK;
+	}
+
+	virtual status_t RemoveDir(const BString& url)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Node* directory;
+		BString name;
+		status_t status = fBackend->_ResolveParent(url, &directory, &name);
+		if (status != B_OK)
+			return status;
+
+		Node* const node = directory->Find(name);
+		if (node == NULL)
+			return B_ENTRY_NOT_FOUND;
+		if (!node->fIsDirectory)
+			return B_NOT_A_DIRECTORY;
+		if (!node->fEntries.empty())
+			return B_DIRECTORY_NOT_EMPTY;
+
+		directory->fEntries.erase(name);
+		directory->Touch();
+		node->Release();
+		return B_OK;
+	}
+
+	virtual status_t OpenDir(const BString& url, SMBCFILE** outDir)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Node* node;
+		status_t status = fBackend->_Resolve(url, &node);
+		if (status != B_OK)
+			return status;
+		if (!node->fIsDirectory)
+			return B_NOT_A_DIRECTORY;
+
+		Handle* const handle = new(std::nothrow) Handle(node, O_RDONLY);
+		if (handle == NULL)
+			return B_NO_MEMORY;
+
+		*outDir = reinterpret_cast<SMBCFILE*>(handle);
+		return B_OK;
+	}
+
+	virtual status_t CloseDir(SMBCFILE* dir)
+	{
+		return Close(dir);
+	}
+
+	virtual status_t SeekDir(SMBCFILE* dir, off_t offset)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Handle* const handle = _HandleFor(dir);
+		if (offset < 0 || (size_t)offset > handle->fNames.size())
+			return B_BAD_VALUE;
+
+		handle->fIndex = offset;
+		return B_OK;
+	}
+
+	virtual status_t GetDirectoryEntry(SMBCFILE* dir, smbc_dirent** outEntry)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Handle* const handle = _HandleFor(dir);
+		const BString* name;
+		Node* const node = handle->NextEntry(&name);
+		if (node == NULL)
+			return B_ENTRY_NOT_FOUND;
+
+		smbc_dirent& entry = handle->fEntry;
+		entry.smbc_type = node->fIsDirectory ? SMBC_DIR : SMBC_FILE;
+		entry.comment = NULL;
+		entry.commentlen = 0;
+		entry.namelen = strlcpy(entry.name, name->String(),
+			B_FILE_NAME_LENGTH);
+		entry.dirlen = sizeof(smbc_dirent) + entry.namelen;
+
+		*outEntry = &entry;
+		return B_OK;
+	}
+
+	virtual status_t GetDirectoryEntryPlus(SMBCFILE* dir,
+		const libsmb_file_info** outInfo)
+	{
+		AutoLocker<BLocker> locker(fBackend->fLock);
+		Handle* const handle = _HandleFor(dir);
+		const BString* name;
+		Node* const node = handle->NextEntry(&name);
+		if (node == NULL)
+			return B_ENTRY_NOT_FOUND;
+
+		libsmb_file_info& info = handle->fInfo;
+		memset(&info, 0, sizeof(info));
+		info.size = node->fSize;
+		if (node->fIsDirectory)
+			info.attrs |= SMBC_DOS_MODE_DIRECTORY;
+		if ((node->fMode & S_IWUSR) == 0)
+			info.attrs |= SMBC_DOS_MODE_READONLY;
+		info.uid = getuid();
+		info.gid = getgid();
+		info.btime_ts = node->fCreated;
+		info.mtime_ts = node->fModified;
+		info.atime_ts = node->fAccessed;
+		info.ctime_ts = node->fChanged;
+		info.name = const_cast<char*>(name->String());
+			// stays valid until the handle is closed
+
+		*outInfo = &info;
+		return B_OK;
+	}
+
+private:
+	static Handle* _HandleFor(SMBCFILE* file)
+	{
+		return reinterpret_cast<Handle*>(file);
+	}
+
+private:
+	MemoryBackend*	fBackend;
+};
+
+
+// #pragma mark - MemoryBackend
+
+
+MemoryBackend::MemoryBackend()
+	:
+	fRoot(new(std::nothrow) Node(true, 0755))
+{
+}
+
+
+MemoryBackend::~MemoryBackend()
+{
+	if (fRoot != NULL)
+		fRoot->Release();
+}
+
+
+SambaContext*
+MemoryBackend::CreateContext()
+{
+	if (fRoot == NULL)
+		return NULL;
+	return new(std::nothrow) Context(this);
+}
+
+
+/*! The servers are those made up so far.
+*/
+status_t
+MemoryBackend::GetServers(NameList& servers)
+{
+	AutoLocker<BLocker> locker(fLock);
+	if (fRoot == NULL)
+		return B_NO_MEMORY;
+
+	_GetDirectories(fRoot, servers);
+	return B_OK;
+}
+
+
+status_t
+MemoryBackend::GetShares(const char* server, NameList& shares)
+{
+	AutoLocker<BLocker> locker(fLock);
+	Node* const serverNode = fRoot != NULL ? fRoot->Find(server) : NULL;
+	if (serverNode == NULL)
+		return B_ENTRY_NOT_FOUND;
+
+	_GetDirectories(serverNode, shares);
+	return B_OK;
+}
+
+
+/*! Splits "smb://server/share/path" into its names.
+*/
+/*static*/ void
+MemoryBackend::_Split(const BString& url, PathList& components)
+{
+	static const char kPrefix[] = "smb://";
+	const int32 prefixLength = sizeof(kPrefix) - 1;
+
+	int32 start = url.FindFirst(kPrefix) == 0 ? prefixLength : 0;
+	while (start < url.Length()) {
+		int32 end = url.FindFirst('/', start);
+		if (end < 0)
+			end = url.Length();
+
+		if (end > start) {
+			BString component;
+			url.CopyInto(component, start, end - start);
+			components.push_back(component);
+		}
+		start = end + 1;
+	}
+}
+
+
+/*! Backend must be locked.
+*/
+status_t
+MemoryBackend::_Resolve(const BString& url, Node** outNode)
+{
+	PathList components;
+	_Split(url, components);
+	return _Walk(components, components.size(), outNode);
+}
+
+
+/*! Finds the directory an URL refers to an entry of. Backend must be
+    locked.
+*/
+status_t
+MemoryBackend::_ResolveParent(const BString& url, Node** outDirectory,
+	BString* outName)
+{
+	PathList components;
+	_Split(url, components);
+	if (components.size() <= kMadeUpLevels)
+		return B_NOT_ALLOWED;
+
+	status_t status = _Walk(components, components.size() - 1, outDirectory);
+	if (status != B_OK)
+		return status;
+	if (!(*outDirectory)->fIsDirectory)
+		return B_NOT_A_DIRECTORY;
+
+	*outName = components.back();
+	return B_OK;
+}
+
+
+/*! Follows the first count names from the root, making up the server and
+    share directories as needed. Backend must be locked.
+*/
+status_t
+MemoryBackend::_Walk(const PathList& components, size_t count,
+	Node** outNode)
+{
+	Node* node = fRoot;
+	for (size_t i = 0; i < count; i++) {
+		if (!node->fIsDirectory)
+			return B_NOT_A_DIRECTORY;
+
+		Node* child = node->Find(components[i]);
+		if (child == NULL) {
+			if (i >= kMadeUpLevels)
+				return B_ENTRY_NOT_FOUND;
+
+			child = new(std::nothrow) Node(true, 0755);
+			if (child == NULL)
+				return B_NO_MEMORY;
+			node->fEntries[components[i]] = child;
+		}
+		node = child;
+	}
+
+	*outNode = node;
+	return B_OK;
+}
+
+
+/*! Backend must be locked.
+*/
+/*static*/ void
+MemoryBackend::_GetDirectories(Node* directory, NameList& names)
+{
+	for (Node::EntryMap::iterator it = directory->fEntries.begin();
+			it != directory->fEntries.end(); it++) {
+		if (it->second->fIsDirectory)
+			names.push_back(it->first);
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_MEMORY_BACKEND_H
+#define SMBFS_MEMORY_BACKEND_H
+
+#include <Locker.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <vector>
+
+#include "Backend.h"
+
+
+namespace Smb {
+
+
+/*! Keeps the shares as a tree in memory, which is gone with the backend.
+    Servers and shares are made up as empty directories when first used.
+    There is no network involved, so this measures what the file system
+    itself costs. All contexts work on the same tree, one at a time.
+*/
+class MemoryBackend : public Backend {
+public:
+								MemoryBackend();
+	virtual						~MemoryBackend();
+
+	virtual	SambaContext*		CreateContext();
+
+	virtual	status_t			GetServers(NameList& servers);
+	virtual	status_t			GetShares(const char* server,
+									NameList& shares);
+
+private:
+	class Context;
+	struct Handle;
+	struct Node;
+	typedef std::vector<BString> PathList;
+
+	enum {
+		kMadeUpLevels = 2
+			// server and share
+	};
+
+private:
+	static	void				_Split(const BString& url,
+									PathList& components);
+			status_t			_Resolve(const BString& url,
+									Node** outNode);
+			status_t			_ResolveParent(const BString& url,
+									Node** outDirectory, BString* outName);
+			status_t			_Walk(const PathList& components,
+									size_t count, Node** outNode);
+	static	void				_GetDirectories(Node* directory,
+									NameList& names);
+
+private:
+			BLocker				fLock;
+			Node*				fRoot;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_MEMORY_BACKEND_H
@@ -35,9 +35,14 @@ enum {
 		// string "name"
 		// string "comment"
 
-	kMsgLostResource       = 0x2003
+	kMsgLostResource       = 0x2003,
 		// string "directory url"
 		// string "name"
+
+	kMsgResourceBatch      = 0x2004
+		// raw    "records"
+		//   Found and lost resources in the order they happened, see
+		//   ResourceBatch
 };
 
 
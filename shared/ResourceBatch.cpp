@@ -0,0 +1,148 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "ResourceBatch.h"
+
+#include <Message.h>
+
+#include <string.h>
+
+
+using namespace Smb;
+
+
+ResourceBatch::ResourceBatch()
+	:
+	fReadPosition(0)
+{
+}
+
+
+void
+ResourceBatch::AddFound(NodeType type, const BString& directoryURL,
+	const BString& name, const BString& comment)
+{
+	fData.push_back(kFound);
+	fData.push_back(type);
+	_AddString(directoryURL);
+	_AddString(name);
+	_AddString(comment);
+}
+
+
+void
+ResourceBatch::AddLost(const BString& directoryURL, const BString& name)
+{
+	fData.push_back(kLost);
+	_AddString(directoryURL);
+	_AddString(name);
+}
+
+
+bool
+ResourceBatch::IsEmpty() const
+{
+	return fData.empty();
+}
+
+
+size_t
+ResourceBatch::Size() const
+{
+	return fData.size();
+}
+
+
+void
+ResourceBatch::MakeEmpty()
+{
+	fData.clear();
+	fReadPosition = 0;
+}
+
+
+status_t
+ResourceBatch::AddTo(BMessage& message) const
+{
+	if (fData.empty())
+		return B_BAD_VALUE;
+
+	return message.AddData("records", B_RAW_TYPE, &fData[0], fData.size(),
+		false);
+}
+
+
+status_t
+ResourceBatch::SetTo(const BMessage& message)
+{
+	MakeEmpty();
+
+	const void* data;
+	ssize_t size;
+	status_t status = message.FindData("records", B_RAW_TYPE, &data, &size);
+	if (status != B_OK)
+		return status;
+
+	fData.assign((const char*)data, (const char*)data + size);
+	return B_OK;
+}
+
+
+/*! Returns the next record, its strings point into the batch. Returns false
+    at the end, or if the rest of the batch is malformed.
+*/
+bool
+ResourceBatch::GetNextRecord(Record& record)
+{
+	if (fReadPosition >= fData.size())
+		return false;
+
+	const uint8 action = fData[fReadPosition++];
+	record.found = action == kFound;
+	record.type = kNetwork;
+	if (record.found && fReadPosition < fData.size())
+		record.type = static_cast<NodeType>(fData[fReadPosition++]);
+
+	record.directoryURL = _NextString();
+	record.name = _NextString();
+	record.comment = record.found ? _NextString() : "";
+
+	if ((action != kFound && action != kLost)
+		|| (record.found && !node_type_valid(record.type))
+		|| record.directoryURL == NULL || record.name == NULL
+		|| record.comment == NULL) {
+		// Don't read on in garbage
+		fReadPosition = fData.size();
+		return false;
+	}
+	return true;
+}
+
+
+void
+ResourceBatch::_AddString(const BString& string)
+{
+	fData.insert(fData.end(), string.String(),
+		string.String() + string.Length() + 1);
+}
+
+
+const char*
+ResourceBatch::_NextString()
+{
+	if (fReadPosition >= fData.size())
+		return NULL;
+
+	const char* const string = &fData[fReadPosition];
+	const void* const end = memchr(string, '\0',
+		fData.size() - fReadPosition);
+	if (end == NULL) {
+		fReadPosition = fData.size();
+		return NULL;
+	}
+
+	fReadPosition += (const char*)end - string + 1;
+	return string;
+}
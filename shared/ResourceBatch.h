@@ -0,0 +1,76 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_RESOURCE_BATCH_H
+#define SMBFS_RESOURCE_BATCH_H
+
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <vector>
+
+#include "NodeDefs.h"
+
+
+class BMessage;
+
+
+namespace Smb {
+
+
+/*! Found and lost resources, packed one after the other into a single
+    buffer, which travels as one kMsgResourceBatch message. Each record is
+    the action byte, the node type byte, and then the directory URL, name
+    and comment as NUL terminated strings (lost resources have no type and
+    comment).
+*/
+class ResourceBatch {
+public:
+	struct Record {
+		bool			found;
+		NodeType		type;
+		const char*		directoryURL;
+		const char*		name;
+		const char*		comment;
+	};
+
+								ResourceBatch();
+
+			void				AddFound(NodeType type,
+									const BString& directoryURL,
+									const BString& name,
+									const BString& comment);
+			void				AddLost(const BString& directoryURL,
+									const BString& name);
+
+			bool				IsEmpty() const;
+			size_t				Size() const;
+			void				MakeEmpty();
+
+			status_t			AddTo(BMessage& message) const;
+			status_t			SetTo(const BMessage& message);
+
+			bool				GetNextRecord(Record& record);
+
+private:
+	enum {
+		kFound	= 1,
+		kLost	= 2
+	};
+
+private:
+			void				_AddString(const BString& string);
+			const char*			_NextString();
+
+private:
+			std::vector<char>	fData;
+			size_t				fReadPosition;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_RESOURCE_BATCH_H
@@ -12,212 +12,148 @@
 
 #include <libsmbclient.h>
 #include <private/shared/AutoLocker.h>
-#include <sys/time.h>
 
-#include <assert.h>
-#include <errno.h>
 #include <time.h>
 
 
 namespace Smb {
 
 
-extern BLocker gGlobalSambaLock;
-typedef AutoLocker<BLocker> GlobalSambaLocker;
-
-
-extern void get_authentication(const char* server, const char* share,
-	char*, int,
-	char* username, int usernameMaxLength,
-	char* password, int passwordMaxLength);
-
-
+/*! The operations on the data of the shares, through one connection to
+    wherever that data lives (see Backend). A context (and every file or
+    directory handle opened through it) may only be used by one thread at a
+    time, so all operations require the context to be locked. Contexts are
+    normally handed out by a SambaContextPool, which does the locking.
+    Handles are SMBCFILE pointers for every backend. Backends other than
+    libsmbclient hand out their own objects as such, and only ever get them
+    back from the context which opened them.
+*/
 class SambaContext {
 public:
 	SambaContext()
-		:
-		fContext(smbc_new_context())
-	{
-		smbc_init(get_authentication, 0);
-			// TODO, only once
-
-		smbc_init_context(fContext);
-		smbc_setFunctionAuthData(fContext, get_authentication);
-
-		//SetDebug(10);
-	}
-
-	~SambaContext()
-	{
-		smbc_free_context(fContext, 1);
-	}
-
-	int GetDebug()
-	{
-		return smbc_getDebug(fContext);
-	}
-
-	void SetDebug(int level)
-	{
-		smbc_setDebug(fContext, level);
-	}
-
-	status_t Stat(const BString& url, struct stat* destination)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionStat(fContext)(fContext,
-			url.String(), destination));
-	}
-
-	status_t FileTruncate(SMBCFILE* file, off_t newSize)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionFtruncate(fContext)(fContext, file,
-			newSize));
-	}
-
-	status_t UpdateTime(const BString& url,
-		const struct timespec& modificationTime)
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		timeval modificationTimeVal;
-		modificationTimeVal.tv_sec = modificationTime.tv_sec;
-		modificationTimeVal.tv_usec = modificationTime.tv_nsec / 1000;
-		return _GetStatus(smbc_getFunctionUtimes(fContext)(fContext,
-			url.String(), &modificationTimeVal));
 	}
 
-	status_t Open(const BString& url, int flags, SMBCFILE** outFile)
+	virtual ~SambaContext()
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		*outFile = smbc_getFunctionOpen(fContext)(fContext, url.String(),
-			flags, 0);
-		return *outFile != NULL ? B_OK : errno;
 	}
 
-	status_t Close(SMBCFILE* file)
+	bool Lock()
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionClose(fContext)(fContext, file));
+		return fLock.Lock();
 	}
 
-	status_t Create(const BString& url, mode_t mode, SMBCFILE** outFile)
+	bool TryLock()
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		*outFile = smbc_getFunctionCreat(fContext)(fContext, url, mode);
-		return *outFile != NULL ? B_OK : errno;
+		return fLock.LockWithTimeout(0) == B_OK;
 	}
 
-	status_t Seek(SMBCFILE* file, off_t offset)
+	void Unlock()
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		off_t result = smbc_getFunctionLseek(fContext)(fContext, file, offset,
-			SEEK_SET);
-		return result != -1 ? B_OK : errno;
+		fLock.Unlock();
 	}
 
-	status_t Read(SMBCFILE* file, void* buffer, size_t* count)
+	bool IsLocked() const
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		ssize_t bytesRead = smbc_getFunctionRead(fContext)(fContext, file,
-			buffer, *count);
-		if (bytesRead < 0)
-			return errno;
-		*count = bytesRead;
-		return B_OK;
+		return fLock.IsLocked();
 	}
 
-	status_t Write(SMBCFILE* file, const void* buffer, size_t* count)
+	thread_id LockingThread() const
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		ssize_t bytesWritten = smbc_getFunctionWrite(fContext)(fContext, file,
-			buffer, *count);
-		if (bytesWritten < 0)
-			return errno;
-		*count = bytesWritten;
-		return B_OK;
+		return fLock.LockingThread();
 	}
 
-	status_t Unlink(const BString& url)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionUnlink(fContext)(fContext,
-			url.String()));
-	}
+	virtual status_t Stat(const BString& url, struct stat* destination) = 0;
+	virtual status_t FileTruncate(SMBCFILE* file, off_t newSize) = 0;
+	virtual status_t UpdateTime(const BString& url,
+		const struct timespec& modificationTime) = 0;
 
-	status_t Rename(const BString& fromURL, const BString& toURL)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionRename(fContext)(fContext,
-			fromURL.String(), fContext, toURL.String()));
-	}
+	virtual status_t Open(const BString& url, int flags,
+		SMBCFILE** outFile) = 0;
+	virtual status_t Close(SMBCFILE* file) = 0;
+	virtual status_t Create(const BString& url, mode_t mode,
+		SMBCFILE** outFile) = 0;
+	virtual status_t Seek(SMBCFILE* file, off_t offset) = 0;
+	virtual status_t Read(SMBCFILE* file, void* buffer, size_t* count) = 0;
+	virtual status_t Write(SMBCFILE* file, const void* buffer,
+		size_t* count) = 0;
 
-	status_t CreateDir(const BString& url, mode_t mode)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionMkdir(fContext)(fContext,
-			url.String(), mode));
-	}
+	virtual status_t Unlink(const BString& url) = 0;
+	virtual status_t Rename(const BString& fromURL,
+		const BString& toURL) = 0;
+	virtual status_t CreateDir(const BString& url, mode_t mode) = 0;
+	virtual status_t RemoveDir(const BString& url) = 0;
 
-	status_t RemoveDir(const BString& url)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionRmdir(fContext)(fContext,
-			url.String()));
-	}
+	virtual status_t OpenDir(const BString& url, SMBCFILE** outDir) = 0;
+	virtual status_t CloseDir(SMBCFILE* dir) = 0;
+	virtual status_t SeekDir(SMBCFILE* dir, off_t offset) = 0;
+	virtual status_t GetDirectoryEntry(SMBCFILE* dir,
+		smbc_dirent** outEntry) = 0;
 
-	status_t OpenDir(const BString& url, SMBCFILE** outDir)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		*outDir = smbc_getFunctionOpendir(fContext)(fContext, url.String());
-		return *outDir != NULL ? B_OK : errno;
-	}
+	/*! Like GetDirectoryEntry(), but also gives the size, times and DOS
+	    attributes the server sent along with the directory listing.
+	*/
+	virtual status_t GetDirectoryEntryPlus(SMBCFILE* dir,
+		const libsmb_file_info** outInfo) = 0;
 
-	status_t CloseDir(SMBCFILE* dir)
+	// pread()/pwrite() style variants: the caller tracks the current file
+	// position of the handle in *position, we only seek when the offset
+	// differs from it. On error the position is set to kUnknownPosition.
+	status_t ReadAt(SMBCFILE* file, off_t* position, off_t offset,
+		void* buffer, size_t* count)
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionClosedir(fContext)(fContext, dir));
-	}
+		status_t status = _SeekIfNeeded(file, position, offset);
+		if (status != B_OK)
+			return status;
 
-	status_t GetDirectoryEntries(SMBCFILE* dir, struct smbc_dirent* entries,
-		int count)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionGetdents(fContext)(fContext, dir,
-			entries, count));
+		status = Read(file, buffer, count);
+		if (status != B_OK) {
+			*position = kUnknownPosition;
+			return status;
+		}
+		*position += *count;
+		return B_OK;
 	}
 
-	status_t SeekDir(SMBCFILE* dir, off_t offset)
+	status_t WriteAt(SMBCFILE* file, off_t* position, off_t offset,
+		const void* buffer, size_t* count)
 	{
-		assert(gGlobalSambaLock.IsLocked());
-		return _GetStatus(smbc_getFunctionLseekdir(fContext)(fContext, dir,
-			offset));
-	}
+		status_t status = _SeekIfNeeded(file, position, offset);
+		if (status != B_OK)
+			return status;
 
-	status_t GetDirectoryEntry(SMBCFILE* dir, smbc_dirent** outEntry)
-	{
-		assert(gGlobalSambaLock.IsLocked());
-		*outEntry = smbc_getFunctionReaddir(fContext)(fContext, dir);
-		if (*outEntry == NULL) {
-			if (errno == B_OK)
-				return B_ENTRY_NOT_FOUND;
-			else
-				return errno;
+		status = Write(file, buffer, count);
+		if (status != B_OK) {
+			*position = kUnknownPosition;
+			return status;
 		}
+		*position += *count;
 		return B_OK;
 	}
 
+	enum {
+		kUnknownPosition = -1
+	};
+
 private:
-	status_t _GetStatus(int smbStatus)
+	status_t _SeekIfNeeded(SMBCFILE* file, off_t* position, off_t offset)
 	{
-		return smbStatus == 0 ? B_OK : errno;
+		if (*position == offset)
+			return B_OK;
+
+		status_t status = Seek(file, offset);
+		*position = status == B_OK ? offset : (off_t)kUnknownPosition;
+		return status;
 	}
 
 private:
-	SMBCCTX* fContext;
+	BLocker  fLock;
 };
 
 
+typedef AutoLocker<SambaContext> SambaContextLocker;
+
+
 } // namespace Smb
 
 
@@ -0,0 +1,238 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "SambaContextPool.h"
+
+#include <OS.h>
+#include <private/shared/AutoLocker.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "Backend.h"
+#include "SambaContext.h"
+
+
+//#define TRACE_CONTEXT_POOL
+#ifdef TRACE_CONTEXT_POOL
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [SambaContextPool %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+// #pragma mark - SambaContextPool::Server
+
+
+SambaContextPool::Server::Server()
+	:
+	fNextWaitIndex(0)
+{
+}
+
+
+SambaContextPool::Server::~Server()
+{
+	for (uint32 i = 0; i < fContexts.size(); i++)
+		delete fContexts[i];
+}
+
+
+// #pragma mark - SambaContextPool
+
+
+SambaContextPool::SambaContextPool(Backend* backend,
+	int32 maxContextsPerServer)
+	:
+	fBackend(backend),
+	fMaxContextsPerServer(maxContextsPerServer)
+{
+}
+
+
+SambaContextPool::~SambaContextPool()
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	ServerMap::Iterator iterator = fServers.GetIterator();
+	while (iterator.HasNext())
+		delete *(iterator.NextValue());
+	fServers.Clear();
+}
+
+
+/*! Returns a locked context for the server of the given URL, or NULL if out
+    of memory. Must be given back with Release().
+*/
+SambaContext*
+SambaContextPool::Acquire(const BString& url)
+{
+	const BString serverName = ServerName(url);
+
+	AutoLocker<BLocker> locker(fLock);
+
+	Server* server = fServers.Get(serverName.String());
+	if (server == NULL) {
+		server = new(std::nothrow) Server;
+		if (server == NULL || fServers.Put(serverName.String(), server)
+				!= B_OK) {
+			delete server;
+			return NULL;
+		}
+	}
+
+	// Prefer an idle context. The contexts' locks are recursive, so one the
+	// calling thread holds already would seem idle, and we'd mix up the
+	// operation in progress on it with the new one.
+	const thread_id thread = find_thread(NULL);
+	int32 heldCount = 0;
+	for (uint32 i = 0; i < server->fContexts.size(); i++) {
+		SambaContext* const context = server->fContexts[i];
+		if (context->LockingThread() == thread) {
+			heldCount++;
+			continue;
+		}
+		if (context->TryLock())
+			return context;
+	}
+
+	// All busy, open another connection if we may. Also if the calling
+	// thread holds all of them, it would wait for itself otherwise.
+	if ((int32)server->fContexts.size() < fMaxContextsPerServer
+		|| heldCount == (int32)server->fContexts.size()) {
+		TRACE("new context #%" B_PRIuSIZE " for server '%s'",
+			server->fContexts.size(), serverName.String());
+
+		SambaContext* const context = fBackend->CreateContext();
+		if (context != NULL) {
+			server->fContexts.push_back(context);
+			context->Lock();
+			return context;
+		}
+		if (heldCount == (int32)server->fContexts.size())
+			return NULL;
+	}
+
+	// Queue up on one of the busy contexts. Spread the waiters over all
+	// contexts, we can't know which one will be done first.
+	SambaContext* context;
+	do {
+		context = server->fContexts[
+			server->fNextWaitIndex++ % server->fContexts.size()];
+	} while (context->LockingThread() == thread);
+	locker.Unlock();
+
+	context->Lock();
+	return context;
+}
+
+
+void
+SambaContextPool::Release(SambaContext* context)
+{
+	assert(context->IsLocked());
+	context->Unlock();
+}
+
+
+/*! Returns a new context of the pool's backend, which is not pooled, for
+    callers which keep their own contexts. NULL if out of memory.
+*/
+SambaContext*
+SambaContextPool::CreateContext()
+{
+	return fBackend->CreateContext();
+}
+
+
+/*! Extracts the server part of an "smb://server/share/path" URL. Returns an
+    empty string for the network URL itself.
+*/
+/*static*/ BString
+SambaContextPool::ServerName(const BString& url)
+{
+	static const char kPrefix[] = "smb://";
+	const int32 prefixLength = sizeof(kPrefix) - 1;
+
+	int32 start = url.FindFirst(kPrefix) == 0 ? prefixLength : 0;
+	int32 end = url.FindFirst('/', start);
+	if (end < 0)
+		end = url.Length();
+
+	BString serverName;
+	url.CopyInto(serverName, start, end - start);
+	return serverName;
+}
+
+
+// #pragma mark - SambaContextLease
+
+
+SambaContextLease::SambaContextLease(SambaContextPool* pool,
+	const BString& url, bool dedicated)
+	:
+	fPool(dedicated ? NULL : pool),
+	fContext(dedicated ? pool->CreateContext() : pool->Acquire(url))
+{
+	if (dedicated && fContext != NULL)
+		fContext->Lock();
+}
+
+
+SambaContextLease::SambaContextLease(SambaContext* context)
+	:
+	fPool(NULL),
+	fContext(context)
+{
+	fContext->Lock();
+}
+
+
+SambaContextLease::~SambaContextLease()
+{
+	Release();
+}
+
+
+status_t
+SambaContextLease::InitCheck() const
+{
+	return fContext != NULL ? B_OK : B_NO_MEMORY;
+}
+
+
+SambaContext*
+SambaContextLease::Get() const
+{
+	return fContext;
+}
+
+
+SambaContext*
+SambaContextLease::operator->() const
+{
+	return fContext;
+}
+
+
+/*! Gives the context back before the lease goes out of scope.
+*/
+void
+SambaContextLease::Release()
+{
+	if (fContext == NULL)
+		return;
+
+	if (fPool != NULL)
+		fPool->Release(fContext);
+	else
+		fContext->Unlock();
+	fContext = NULL;
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_SAMBA_CONTEXT_POOL_H
+#define SMBFS_SAMBA_CONTEXT_POOL_H
+
+#include <Locker.h>
+#include <String.h>
+#include <SupportDefs.h>
+
+#include <private/shared/HashMap.h>
+#include <private/shared/HashString.h>
+
+#include <vector>
+
+
+namespace Smb {
+
+
+class Backend;
+class SambaContext;
+
+
+/*! Hands out SambaContexts for the duration of one operation. Contexts are
+    kept per server, so a slow server only ever blocks operations on that
+    same server. Up to fMaxContextsPerServer operations can run in parallel
+    against one server; further callers wait for one of its contexts. A
+    thread never gets a context it holds already, it gets a new one if it
+    holds all of them.
+    The contexts are created by the given backend, which must outlive the
+    pool.
+*/
+class SambaContextPool {
+public:
+								SambaContextPool(Backend* backend,
+									int32 maxContextsPerServer
+										= kDefaultMaxContextsPerServer);
+								~SambaContextPool();
+
+			SambaContext*		Acquire(const BString& url);
+			void				Release(SambaContext* context);
+
+			SambaContext*		CreateContext();
+
+	static	BString				ServerName(const BString& url);
+
+private:
+	typedef std::vector<SambaContext*> ContextList;
+
+	struct Server {
+								Server();
+								~Server();
+
+			ContextList			fContexts;
+			uint32				fNextWaitIndex;
+	};
+
+	typedef HashMap<HashString, Server*> ServerMap;
+
+	enum {
+		kDefaultMaxContextsPerServer = 4
+	};
+
+private:
+			Backend*			fBackend;
+			BLocker				fLock;
+			ServerMap			fServers;
+			int32				fMaxContextsPerServer;
+};
+
+
+/*! Leases a locked SambaContext, either any context for the server of an URL
+    from a pool, or one specific context (for handles which are bound to the
+    context they were opened with). The context is given back on destruction.
+    A dedicated lease gets a new context which isn't pooled, for handles
+    that keep their context busy for a long time. It is only unlocked on
+    destruction, the caller takes it over and must delete it.
+*/
+class SambaContextLease {
+public:
+								SambaContextLease(SambaContextPool* pool,
+									const BString& url,
+									bool dedicated = false);
+								SambaContextLease(SambaContext* context);
+								~SambaContextLease();
+
+			status_t			InitCheck() const;
+
+			SambaContext*		Get() const;
+			SambaContext*		operator->() const;
+
+			void				Release();
+
+private:
+			SambaContextPool*	fPool;
+			SambaContext*		fContext;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_SAMBA_CONTEXT_POOL_H
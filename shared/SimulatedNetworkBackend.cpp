@@ -0,0 +1,426 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "SimulatedNetworkBackend.h"
+
+#include <driver_settings.h>
+#include <private/shared/AutoLocker.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SambaContext.h"
+
+
+//#define TRACE_SIMULATED_NETWORK
+#ifdef TRACE_SIMULATED_NETWORK
+#	define TRACE(text, ...) \
+	fprintf(stderr, "SMB-FS [SimulatedNetworkBackend %s] : " text "\n", \
+		__FUNCTION__, ##__VA_ARGS__)
+#else
+#	define TRACE(text, ...)
+#endif
+
+
+using namespace Smb;
+
+
+static bool
+get_milliseconds(void* settings, const char* name, bigtime_t* _value)
+{
+	const char* value = get_driver_parameter(settings, name, NULL, NULL);
+	if (value == NULL)
+		return false;
+	*_value = strtoll(value, NULL, 10) * 1000;
+	return true;
+}
+
+
+static bool
+get_rate(void* settings, const char* name, float* _value)
+{
+	const char* value = get_driver_parameter(settings, name, NULL, NULL);
+	if (value == NULL)
+		return false;
+	*_value = strtod(value, NULL);
+	return true;
+}
+
+
+// #pragma mark - SimulatedNetworkBackend::Context
+
+
+class SimulatedNetworkBackend::Context : public SambaContext {
+public:
+	Context(SimulatedNetworkBackend* backend, SambaContext* context)
+		:
+		fBackend(backend),
+		fContext(context)
+	{
+	}
+
+	virtual ~Context()
+	{
+		delete fContext;
+	}
+
+	virtual status_t Stat(const BString& url, struct stat* destination)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->Stat(url, destination);
+	}
+
+	virtual status_t FileTruncate(SMBCFILE* file, off_t newSize)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->FileTruncate(file, newSize);
+	}
+
+	virtual status_t UpdateTime(const BString& url,
+		const struct timespec& modificationTime)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->UpdateTime(url, modificationTime);
+	}
+
+	virtual status_t Open(const BString& url, int flags, SMBCFILE** outFile)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->Open(url, flags, outFile);
+	}
+
+	virtual status_t Close(SMBCFILE* file)
+	{
+		// Never fails, the handle has to go in any case
+		fBackend->_RoundTrip(false);
+
+		SambaContextLocker locker(fContext);
+		return fContext->Close(file);
+	}
+
+	virtual status_t Create(const BString& url, mode_t mode,
+		SMBCFILE** outFile)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->Create(url, mode, outFile);
+	}
+
+	virtual status_t Seek(SMBCFILE* file, off_t offset)
+	{
+		SambaContextLocker locker(fContext);
+		return fContext->Seek(file, offset);
+	}
+
+	virtual status_t Read(SMBCFILE* file, void* buffer, size_t* count)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		status = fContext->Read(file, buffer, count);
+		if (status == B_OK)
+			fBackend->_Transfer(*count);
+		return status;
+	}
+
+	virtual status_t Write(SMBCFILE* file, const void* buffer, size_t* count)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		fBackend->_Transfer(*count);
+
+		SambaContextLocker locker(fContext);
+		return fContext->Write(file, buffer, count);
+	}
+
+	virtual status_t Unlink(const BString& url)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->Unlink(url);
+	}
+
+	virtual status_t Rename(const BString& fromURL, const BString& toURL)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->Rename(fromURL, toURL);
+	}
+
+	virtual status_t CreateDir(const BString& url, mode_t mode)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->CreateDir(url, mode);
+	}
+
+	virtual status_t RemoveDir(const BString& url)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->RemoveDir(url);
+	}
+
+	virtual status_t OpenDir(const BString& url, SMBCFILE** outDir)
+	{
+		status_t status = fBackend->_RoundTrip(true);
+		if (status != B_OK)
+			return status;
+
+		SambaContextLocker locker(fContext);
+		return fContext->OpenDir(url, outDir);
+	}
+
+	virtual status_t CloseDir(SMBCFILE* dir)
+	{
+		fBackend->_RoundTrip(false);
+
+		SambaContextLocker locker(fContext);
+		return fContext->CloseDir(dir);
+	}
+
+	virtual status_t SeekDir(SMBCFILE* dir, off_t offset)
+	{
+		SambaContextLocker locker(fContext);
+		return fContext->SeekDir(dir, offset);
+	}
+
+	virtual status_t GetDirectoryEntry(SMBCFILE* dir, smbc_dirent** outEntry)
+	{
+		SambaContextLocker locker(fContext);
+		return fContext->GetDirectoryEntry(dir, outEntry);
+	}
+
+	virtual status_t GetDirectoryEntryPlus(SMBCFILE* dir,
+		const libsmb_file_info** outInfo)
+	{
+		SambaContextLocker locker(fContext);
+		return fContext->GetDirectoryEntryPlus(dir, outInfo);
+	}
+
+private:
+	SimulatedNetworkBackend*	fBackend;
+	SambaContext*				fContext;
+};
+
+
+// #pragma mark - SimulatedNetworkBackend::Conditions
+
+
+SimulatedNetworkBackend::Conditions::Conditions()
+	:
+	latency(0),
+	jitter(0),
+	bandwidth(0),
+	errorRate(0),
+	timeoutRate(0),
+	timeout(20000000),
+		// libsmbclient's default
+	seed(1)
+{
+}
+
+
+/*! Takes the conditions given in the driver settings, leaves the others as
+    they are. Times are in milliseconds, the bandwidth in KiB/s, the rates
+    are the share of round trips which fail:
+
+        sim_latency 40
+        sim_jitter 5
+        sim_bandwidth 1024
+        sim_error_rate 0.001
+        sim_timeout_rate 0.0001
+        sim_timeout 20000
+        sim_seed 42
+
+    Returns whether any of them were given.
+*/
+bool
+SimulatedNetworkBackend::Conditions::Parse(void* settings)
+{
+	bool found = get_milliseconds(settings, "sim_latency", &latency);
+	found |= get_milliseconds(settings, "sim_jitter", &jitter);
+	found |= get_milliseconds(settings, "sim_timeout", &timeout);
+	found |= get_rate(settings, "sim_error_rate", &errorRate);
+	found |= get_rate(settings, "sim_timeout_rate", &timeoutRate);
+
+	const char* value = get_driver_parameter(settings, "sim_bandwidth", NULL,
+		NULL);
+	if (value != NULL) {
+		bandwidth = strtoll(value, NULL, 10) * 1024;
+		found = true;
+	}
+
+	value = get_driver_parameter(settings, "sim_seed", NULL, NULL);
+	if (value != NULL) {
+		seed = strtoul(value, NULL, 10);
+		found = true;
+	}
+
+	return found;
+}
+
+
+// #pragma mark - SimulatedNetworkBackend
+
+
+/*! Takes over the given backend.
+*/
+SimulatedNetworkBackend::SimulatedNetworkBackend(Backend* backend,
+	const Conditions& conditions)
+	:
+	fBackend(backend),
+	fConditions(conditions),
+	fLinkFreeTime(0),
+	fRandomState(conditions.seed != 0 ? conditions.seed : 1)
+{
+}
+
+
+SimulatedNetworkBackend::~SimulatedNetworkBackend()
+{
+	delete fBackend;
+}
+
+
+SambaContext*
+SimulatedNetworkBackend::CreateContext()
+{
+	SambaContext* const context = fBackend->CreateContext();
+	if (context == NULL)
+		return NULL;
+
+	Context* const simulatedContext = new(std::nothrow) Context(this,
+		context);
+	if (simulatedContext == NULL)
+		delete context;
+	return simulatedContext;
+}
+
+
+/*! Listing servers and shares takes a round trip each.
+*/
+status_t
+SimulatedNetworkBackend::GetServers(NameList& servers)
+{
+	status_t status = _RoundTrip(true);
+	if (status != B_OK)
+		return status;
+	return fBackend->GetServers(servers);
+}
+
+
+status_t
+SimulatedNetworkBackend::GetShares(const char* server, NameList& shares)
+{
+	status_t status = _RoundTrip(true);
+	if (status != B_OK)
+		return status;
+	return fBackend->GetShares(server, shares);
+}
+
+
+/*! Waits for one round trip to the server. If \a mayFail, the answer may be
+    an error, or not come at all, which is B_TIMED_OUT after the timeout.
+*/
+status_t
+SimulatedNetworkBackend::_RoundTrip(bool mayFail)
+{
+	AutoLocker<BLocker> locker(fLock);
+
+	bigtime_t delay = fConditions.latency;
+	if (fConditions.jitter > 0)
+		delay += (bigtime_t)((_Random() * 2 - 1) * fConditions.jitter);
+
+	status_t status = B_OK;
+	if (mayFail) {
+		const float chance = _Random();
+		if (chance < fConditions.errorRate) {
+			TRACE("injecting an error");
+			status = B_IO_ERROR;
+		} else if (chance < fConditions.errorRate + fConditions.timeoutRate) {
+			TRACE("injecting a timeout");
+			status = B_TIMED_OUT;
+			delay = fConditions.timeout;
+		}
+	}
+
+	locker.Unlock();
+
+	if (delay > 0)
+		snooze(delay);
+	return status;
+}
+
+
+/*! Waits until the given amount of data has passed the link, behind the data
+    of all the other contexts which is still on its way.
+*/
+void
+SimulatedNetworkBackend::_Transfer(size_t bytes)
+{
+	if (fConditions.bandwidth <= 0 || bytes == 0)
+		return;
+
+	AutoLocker<BLocker> locker(fLock);
+
+	bigtime_t start = system_time();
+	if (fLinkFreeTime > start)
+		start = fLinkFreeTime;
+	fLinkFreeTime = start + (bigtime_t)bytes * 1000000 / fConditions.bandwidth;
+	const bigtime_t done = fLinkFreeTime;
+
+	locker.Unlock();
+
+	snooze_until(done, B_SYSTEM_TIMEBASE);
+}
+
+
+/*! Returns the next number of the sequence in [0, 1), xorshift32.
+    Must lock.
+*/
+float
+SimulatedNetworkBackend::_Random()
+{
+	fRandomState ^= fRandomState << 13;
+	fRandomState ^= fRandomState >> 17;
+	fRandomState ^= fRandomState << 5;
+	return (fRandomState >> 8) / 16777216.0f;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_SIMULATED_NETWORK_BACKEND_H
+#define SMBFS_SIMULATED_NETWORK_BACKEND_H
+
+#include <Locker.h>
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include "Backend.h"
+
+
+namespace Smb {
+
+
+/*! Puts a made up network between the file system and another backend:
+    every operation which would be a round trip to an SMB server is delayed
+    by the latency (give or take the jitter), file data additionally has to
+    pass a link of the given bandwidth, which all contexts share. Operations
+    may also fail, or time out, at random. The random numbers are seeded, so
+    a run can be repeated.
+    Operations libsmbclient does on the client side (seeking, and reading
+    directory entries, which it fetches when opening the directory) are
+    passed through as they are.
+*/
+class SimulatedNetworkBackend : public Backend {
+public:
+	struct Conditions {
+								Conditions();
+
+			bool				Parse(void* settings);
+
+			bigtime_t			latency;
+			bigtime_t			jitter;
+			int64				bandwidth;
+				// bytes per second, 0 for unlimited
+			float				errorRate;
+			float				timeoutRate;
+			bigtime_t			timeout;
+			uint32				seed;
+	};
+
+								SimulatedNetworkBackend(Backend* backend,
+									const Conditions& conditions);
+	virtual						~SimulatedNetworkBackend();
+
+	virtual	SambaContext*		CreateContext();
+
+	virtual	status_t			GetServers(NameList& servers);
+	virtual	status_t			GetShares(const char* server,
+									NameList& shares);
+
+private:
+	class Context;
+
+private:
+			status_t			_RoundTrip(bool mayFail);
+			void				_Transfer(size_t bytes);
+			float				_Random();
+
+private:
+			Backend*			fBackend;
+			Conditions			fConditions;
+			BLocker				fLock;
+			bigtime_t			fLinkFreeTime;
+				// when the data sent so far has passed the link
+			uint32				fRandomState;
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_SIMULATED_NETWORK_BACKEND_H
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#include "SmbClientContext.h"
+
+#include <stdio.h>
+
+
+using namespace Smb;
+
+
+static int32 sThreadSupportInitialized = 0;
+
+
+void
+Smb::get_authentication(const char* server, const char* share,
+	char*, int,
+	char* username, int usernameMaxLength,
+	char* password, int passwordMaxLength)
+{
+	// TODO
+	(void)server;
+	(void)share;
+	(void)passwordMaxLength;
+	strlcpy(username, "guest", usernameMaxLength);
+	password[0] = '\0';
+}
+
+
+// #pragma mark - SmbClientContext
+
+
+/*static*/ void
+SmbClientContext::_InitThreadSupport()
+{
+	// libsmbclient keeps some global state, it needs to know that several
+	// threads may use (distinct) contexts at the same time
+	if (atomic_test_and_set(&sThreadSupportInitialized, 1, 0) == 0)
+		smbc_thread_posix();
+}
+
+
+// #pragma mark - SmbClientBackend
+
+
+SambaContext*
+SmbClientBackend::CreateContext()
+{
+	return new(std::nothrow) SmbClientContext;
+}
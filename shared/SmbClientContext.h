@@ -0,0 +1,251 @@
+/*
+ * Copyright 2017 Julian Harnath <julian.harnath@rwth-aachen.de>
+ * All rights reserved. Distributed under the terms of the MIT license.
+ */
+
+#ifndef SMBFS_SMB_CLIENT_CONTEXT_H
+#define SMBFS_SMB_CLIENT_CONTEXT_H
+
+#include <sys/time.h>
+
+#include <assert.h>
+#include <errno.h>
+
+#include "Backend.h"
+#include "SambaContext.h"
+
+
+namespace Smb {
+
+
+extern void get_authentication(const char* server, const char* share,
+	char*, int,
+	char* username, int usernameMaxLength,
+	char* password, int passwordMaxLength);
+
+
+/*! Context on one libsmbclient context, i.e. the actual SMB shares.
+*/
+class SmbClientContext : public SambaContext {
+public:
+	SmbClientContext()
+		:
+		fContext(smbc_new_context())
+	{
+		_InitThreadSupport();
+		smbc_init(get_authentication, 0);
+			// TODO, only once
+
+		smbc_init_context(fContext);
+		smbc_setFunctionAuthData(fContext, get_authentication);
+
+		//SetDebug(10);
+	}
+
+	virtual ~SmbClientContext()
+	{
+		smbc_free_context(fContext, 1);
+	}
+
+	int GetDebug()
+	{
+		return smbc_getDebug(fContext);
+	}
+
+	void SetDebug(int level)
+	{
+		smbc_setDebug(fContext, level);
+	}
+
+	/*! How long to wait for a server to answer, in milliseconds.
+	*/
+	void SetTimeout(int32 timeout)
+	{
+		smbc_setTimeout(fContext, timeout);
+	}
+
+	virtual status_t Stat(const BString& url, struct stat* destination)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionStat(fContext)(fContext,
+			url.String(), destination));
+	}
+
+	virtual status_t FileTruncate(SMBCFILE* file, off_t newSize)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionFtruncate(fContext)(fContext, file,
+			newSize));
+	}
+
+	virtual status_t UpdateTime(const BString& url,
+		const struct timespec& modificationTime)
+	{
+		assert(IsLocked());
+		timeval modificationTimeVal;
+		modificationTimeVal.tv_sec = modificationTime.tv_sec;
+		modificationTimeVal.tv_usec = modificationTime.tv_nsec / 1000;
+		return _GetStatus(smbc_getFunctionUtimes(fContext)(fContext,
+			url.String(), &modificationTimeVal));
+	}
+
+	virtual status_t Open(const BString& url, int flags, SMBCFILE** outFile)
+	{
+		assert(IsLocked());
+		*outFile = smbc_getFunctionOpen(fContext)(fContext, url.String(),
+			flags, 0);
+		return *outFile != NULL ? B_OK : errno;
+	}
+
+	virtual status_t Close(SMBCFILE* file)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionClose(fContext)(fContext, file));
+	}
+
+	virtual status_t Create(const BString& url, mode_t mode,
+		SMBCFILE** outFile)
+	{
+		assert(IsLocked());
+		*outFile = smbc_getFunctionCreat(fContext)(fContext, url, mode);
+		return *outFile != NULL ? B_OK : errno;
+	}
+
+	virtual status_t Seek(SMBCFILE* file, off_t offset)
+	{
+		assert(IsLocked());
+		off_t result = smbc_getFunctionLseek(fContext)(fContext, file, offset,
+			SEEK_SET);
+		return result != -1 ? B_OK : errno;
+	}
+
+	virtual status_t Read(SMBCFILE* file, void* buffer, size_t* count)
+	{
+		assert(IsLocked());
+		ssize_t bytesRead = smbc_getFunctionRead(fContext)(fContext, file,
+			buffer, *count);
+		if (bytesRead < 0)
+			return errno;
+		*count = bytesRead;
+		return B_OK;
+	}
+
+	virtual status_t Write(SMBCFILE* file, const void* buffer, size_t* count)
+	{
+		assert(IsLocked());
+		ssize_t bytesWritten = smbc_getFunctionWrite(fContext)(fContext, file,
+			buffer, *count);
+		if (bytesWritten < 0)
+			return errno;
+		*count = bytesWritten;
+		return B_OK;
+	}
+
+	virtual status_t Unlink(const BString& url)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionUnlink(fContext)(fContext,
+			url.String()));
+	}
+
+	virtual status_t Rename(const BString& fromURL, const BString& toURL)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionRename(fContext)(fContext,
+			fromURL.String(), fContext, toURL.String()));
+	}
+
+	virtual status_t CreateDir(const BString& url, mode_t mode)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionMkdir(fContext)(fContext,
+			url.String(), mode));
+	}
+
+	virtual status_t RemoveDir(const BString& url)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionRmdir(fContext)(fContext,
+			url.String()));
+	}
+
+	virtual status_t OpenDir(const BString& url, SMBCFILE** outDir)
+	{
+		assert(IsLocked());
+		*outDir = smbc_getFunctionOpendir(fContext)(fContext, url.String());
+		return *outDir != NULL ? B_OK : errno;
+	}
+
+	virtual status_t CloseDir(SMBCFILE* dir)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionClosedir(fContext)(fContext, dir));
+	}
+
+	status_t GetDirectoryEntries(SMBCFILE* dir, struct smbc_dirent* entries,
+		int count)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionGetdents(fContext)(fContext, dir,
+			entries, count));
+	}
+
+	virtual status_t SeekDir(SMBCFILE* dir, off_t offset)
+	{
+		assert(IsLocked());
+		return _GetStatus(smbc_getFunctionLseekdir(fContext)(fContext, dir,
+			offset));
+	}
+
+	virtual status_t GetDirectoryEntry(SMBCFILE* dir, smbc_dirent** outEntry)
+	{
+		assert(IsLocked());
+		*outEntry = smbc_getFunctionReaddir(fContext)(fContext, dir);
+		if (*outEntry == NULL) {
+			if (errno == B_OK)
+				return B_ENTRY_NOT_FOUND;
+			else
+				return errno;
+		}
+		return B_OK;
+	}
+
+	virtual status_t GetDirectoryEntryPlus(SMBCFILE* dir,
+		const libsmb_file_info** outInfo)
+	{
+		assert(IsLocked());
+		*outInfo = smbc_getFunctionReaddirPlus(fContext)(fContext, dir);
+		if (*outInfo == NULL) {
+			if (errno == B_OK)
+				return B_ENTRY_NOT_FOUND;
+			else
+				return errno;
+		}
+		return B_OK;
+	}
+
+private:
+	static void _InitThreadSupport();
+
+	status_t _GetStatus(int smbStatus)
+	{
+		return smbStatus == 0 ? B_OK : errno;
+	}
+
+private:
+	SMBCCTX* fContext;
+};
+
+
+/*! The SMB shares of the network, through libsmbclient.
+*/
+class SmbClientBackend : public Backend {
+public:
+	virtual	SambaContext*		CreateContext();
+};
+
+
+} // namespace Smb
+
+
+#endif // SMBFS_SMB_CLIENT_CONTEXT_H